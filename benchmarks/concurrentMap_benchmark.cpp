@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <jbkvs/detail/concurrentMap.h>
+
+// Measures throughput of detail::ConcurrentMap implementations under a mixed get/put workload.
+//
+// Usage: jbkvs_concurrentMap_benchmark [duration in milliseconds per measurement]
+
+namespace
+{
+
+    const uint32_t _keyCount = 1 << 16;
+    const size_t _threadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    const uint32_t _readPercents[] = { 100, 90, 50 };
+
+    // Keeps lookups observable so that they are not optimized away.
+    std::atomic<uint64_t> _checksum(0);
+
+    uint32_t _nextRandom(uint64_t& state) noexcept
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return uint32_t(state >> 33);
+    }
+
+    template <typename TMap>
+    double _measure(size_t threadCount, uint32_t readPercent, std::chrono::milliseconds duration)
+    {
+        TMap map;
+        for (uint32_t key = 0; key < _keyCount; ++key)
+        {
+            map.put(key, uint64_t(key));
+        }
+
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> started(false);
+        std::atomic<bool> stopped(false);
+        std::atomic<uint64_t> totalOperations(0);
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+        for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            threads.emplace_back([&, threadIndex]()
+            {
+                uint64_t state = threadIndex + 1;
+                uint64_t operations = 0;
+                uint64_t checksum = 0;
+
+                ++ready;
+                while (!started.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                while (!stopped.load(std::memory_order_relaxed))
+                {
+                    for (size_t i = 0; i < 64; ++i)
+                    {
+                        uint32_t random = _nextRandom(state);
+                        uint32_t key = random % _keyCount;
+                        if ((random >> 16) % 100 < readPercent)
+                        {
+                            auto value = map.get(key);
+                            checksum += value ? *value : 0;
+                        }
+                        else
+                        {
+                            map.put(key, uint64_t(random));
+                        }
+                    }
+                    operations += 64;
+                }
+
+                totalOperations += operations;
+                _checksum += checksum;
+            });
+        }
+
+        while (ready.load() != threadCount)
+        {
+            std::this_thread::yield();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        started.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(duration);
+        stopped = true;
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        return double(totalOperations.load()) / elapsed / 1e6;
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::chrono::milliseconds duration(argc > 1 ? atoi(argv[1]) : 500);
+
+    printf("ConcurrentMap throughput, %u keys, Mops/s (hardware threads: %u)\n", _keyCount, std::thread::hardware_concurrency());
+
+    for (uint32_t readPercent : _readPercents)
+    {
+        printf("\n%u%% reads\n", readPercent);
+        printf("%8s %16s %16s %16s %16s\n", "threads", "SharedMutexMap", "LockFreeHashMap", "ShardedMap", "PersistentMap");
+
+        for (size_t threadCount : _threadCounts)
+        {
+            double sharedMutex = _measure<jbkvs::detail::SharedMutexMap<uint32_t, uint64_t>>(threadCount, readPercent, duration);
+            double lockFree = _measure<jbkvs::detail::LockFreeHashMap<uint32_t, uint64_t>>(threadCount, readPercent, duration);
+            double sharded = _measure<jbkvs::detail::ShardedMap<uint32_t, uint64_t>>(threadCount, readPercent, duration);
+            double persistent = _measure<jbkvs::detail::PersistentMap<uint32_t, uint64_t>>(threadCount, readPercent, duration);
+
+            printf("%8zu %16.2f %16.2f %16.2f %16.2f\n", threadCount, sharedMutex, lockFree, sharded, persistent);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <new>
+#include <string>
+#include <variant>
+
+#include <jbkvs/detail/concurrentMap.h>
+#include <jbkvs/types/blob.h>
+
+// Compares memory footprint and get() latency of SharedMutexMap backed by std::map and by FlatHashMap.
+// Bytes are counted as requested from operator new; every allocation costs the allocator's own header on top.
+//
+// Usage: jbkvs_flatHashMap_benchmark [lookups per measurement]
+
+namespace
+{
+
+    std::atomic<size_t> _allocatedBytes(0);
+    std::atomic<size_t> _allocationCount(0);
+
+    // Every allocation is prefixed with its size, so that frees can be accounted too.
+    const size_t _allocationHeader = alignof(std::max_align_t);
+
+    using TValue = std::variant<uint32_t, uint64_t, float, double, std::string, jbkvs::types::BlobPtr>;
+    using TreeMap = jbkvs::detail::SharedMutexMap<uint32_t, TValue, std::map<uint32_t, TValue, std::less<>>>;
+    using FlatMap = jbkvs::detail::SharedMutexMap<uint32_t, TValue, jbkvs::detail::FlatHashMap<uint32_t, TValue>>;
+
+    const size_t _keyCounts[] = { 10000, 100000, 1000000, 4000000 };
+
+    uint32_t _nextRandom(uint64_t& state) noexcept
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return uint32_t(state >> 33);
+    }
+
+    template <typename TMap>
+    void _measure(const char* name, size_t keyCount, size_t lookupCount)
+    {
+        size_t allocatedBefore = _allocatedBytes.load();
+        size_t allocationsBefore = _allocationCount.load();
+
+        TMap* map = new TMap();
+        for (uint32_t key = 0; key < keyCount; ++key)
+        {
+            map->put(key * 2654435761u, TValue(uint64_t(key)));
+        }
+
+        size_t allocated = _allocatedBytes.load() - allocatedBefore;
+        size_t allocations = _allocationCount.load() - allocationsBefore;
+
+        uint64_t state = 1;
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < lookupCount; ++i)
+        {
+            uint32_t key = uint32_t(_nextRandom(state) % keyCount) * 2654435761u;
+            auto value = map->get(key);
+            checksum += value ? std::get<uint64_t>(*value) : 0;
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        delete map;
+
+        printf("%10s %10zu %14.1f %14.3f %14.1f %20llu\n", name, keyCount, double(allocated) / keyCount, double(allocations) / keyCount, elapsed / lookupCount, (unsigned long long)checksum);
+    }
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    void* memory = malloc(size + _allocationHeader);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    *static_cast<size_t*>(memory) = size;
+    _allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    _allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<char*>(memory) + _allocationHeader;
+}
+
+void operator delete(void* memory) noexcept
+{
+    if (memory)
+    {
+        void* block = static_cast<char*>(memory) - _allocationHeader;
+        _allocatedBytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+        _allocationCount.fetch_sub(1, std::memory_order_relaxed);
+        free(block);
+    }
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    operator delete(memory);
+}
+
+int main(int argc, char** argv)
+{
+    size_t lookupCount = argc > 1 ? size_t(atoll(argv[1])) : 10000000;
+
+    printf("%10s %10s %14s %14s %14s %20s\n", "container", "keys", "bytes/key", "allocs/key", "ns/get", "checksum");
+
+    for (size_t keyCount : _keyCounts)
+    {
+        _measure<TreeMap>("std::map", keyCount, lookupCount);
+        _measure<FlatMap>("flat", keyCount, lookupCount);
+    }
+
+    return 0;
+}
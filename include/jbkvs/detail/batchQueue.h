@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Queue of items applied in batches by a worker thread that the queue owns. Producers only append under a
+    // mutex; the worker takes everything queued at once and applies it without holding the mutex, so that the
+    // batch may be reordered and coalesced as a whole. Items still queued when the queue is destroyed are dropped.
+
+    template <typename T>
+    class BatchQueue
+        : NonCopyableMixin<BatchQueue<T>>
+    {
+    public:
+        // May reorder and remove the items of the batch.
+        using Apply = std::function<void(std::vector<T>& batch)>;
+
+    private:
+        const Apply _apply;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        // Notified whenever the worker finishes a batch.
+        std::condition_variable _appliedCondition;
+        std::vector<T> _items;
+        uint64_t _pushedCount;
+        uint64_t _appliedCount;
+        bool _isStopping;
+        std::thread _thread;
+
+    public:
+        explicit BatchQueue(Apply&& apply)
+            : _apply(std::move(apply))
+            , _mutex()
+            , _condition()
+            , _appliedCondition()
+            , _items()
+            , _pushedCount(0)
+            , _appliedCount(0)
+            , _isStopping(false)
+            , _thread()
+        {
+            _thread = std::thread([this]() { _run(); });
+        }
+
+        ~BatchQueue()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _isStopping = true;
+            }
+            _condition.notify_one();
+            _appliedCondition.notify_all();
+            _thread.join();
+        }
+
+        void push(T&& item)
+        {
+            std::lock_guard lock(_mutex);
+
+            bool wasEmpty = _items.empty();
+            _items.push_back(std::move(item));
+            ++_pushedCount;
+            if (wasEmpty)
+            {
+                _condition.notify_one();
+            }
+        }
+
+        // Waits until the items pushed before the call are applied. Must not be called by the worker.
+        void flush()
+        {
+            std::unique_lock lock(_mutex);
+
+            uint64_t pushedCount = _pushedCount;
+            _appliedCondition.wait(lock, [this, pushedCount]()
+            {
+                return _appliedCount >= pushedCount || _isStopping;
+            });
+        }
+
+    private:
+        void _run()
+        {
+            std::vector<T> batch;
+
+            std::unique_lock lock(_mutex);
+            while (!_isStopping)
+            {
+                if (_items.empty())
+                {
+                    _condition.wait(lock);
+                    continue;
+                }
+
+                batch.swap(_items);
+                size_t batchSize = batch.size();
+                lock.unlock();
+
+                _apply(batch);
+                batch.clear();
+
+                lock.lock();
+                _appliedCount += batchSize;
+                _appliedCondition.notify_all();
+            }
+        }
+    };
+
+} // namespace jbkvs::detail
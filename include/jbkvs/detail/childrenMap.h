@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/flatHashMap.h>
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/nameTable.h>
+
+namespace jbkvs::detail
+{
+
+    // Children of a tree node by name. Names are interned, so the map is a flat hash table keyed by InternedName
+    // addresses holding a pointer and the value per child, and a lookup by string_view costs a probe of the
+    // NameTable and a probe of the map. Iteration yields pairs of references to the name and the value, in no
+    // particular order. Not synchronized: the owner guards it like it did the map it replaces.
+
+    template <typename TValue>
+    class ChildrenMap
+        : NonCopyableMixin<ChildrenMap<TValue>>
+    {
+        struct NameHash
+        {
+            size_t operator()(const InternedName* name) const noexcept { return name->getHash(); }
+        };
+
+        using Map = FlatHashMap<const InternedName*, TValue, NameHash>;
+
+        Map _map;
+
+    public:
+        class const_iterator
+        {
+            typename Map::const_iterator _it;
+
+        public:
+            explicit const_iterator(const typename Map::const_iterator& it) noexcept : _it(it) {}
+
+            std::pair<const std::string&, const TValue&> operator*() const noexcept
+            {
+                return { _it->first->getValue(), _it->second };
+            }
+
+            const_iterator& operator++() noexcept
+            {
+                ++_it;
+                return *this;
+            }
+
+            bool operator==(const const_iterator& other) const noexcept { return _it == other._it; }
+            bool operator!=(const const_iterator& other) const noexcept { return _it != other._it; }
+        };
+
+        ChildrenMap() noexcept
+            : _map()
+        {
+        }
+
+        ~ChildrenMap()
+        {
+            clear();
+        }
+
+        size_t size() const noexcept { return _map.size(); }
+        bool empty() const noexcept { return _map.empty(); }
+
+        const_iterator begin() const noexcept { return const_iterator(_map.begin()); }
+        const_iterator end() const noexcept { return const_iterator(_map.end()); }
+
+        // Returns the value of the child, or null. The pointer is valid until the map is modified.
+        TValue* find(const std::string_view& name) noexcept
+        {
+            return _find(_map, name);
+        }
+
+        const TValue* find(const std::string_view& name) const noexcept
+        {
+            return _find(_map, name);
+        }
+
+        // Returns the value of the child, inserting a default one if there is no child with the name.
+        TValue& operator[](const std::string_view& name)
+        {
+            TValue* value = find(name);
+            if (value)
+            {
+                return *value;
+            }
+
+            const InternedName* internedName = NameTable::acquire(name);
+            try
+            {
+                return _map[internedName];
+            }
+            catch (...)
+            {
+                NameTable::release(internedName);
+                throw;
+            }
+        }
+
+        bool erase(const std::string_view& name)
+        {
+            EpochGuard guard;
+
+            const InternedName* internedName = NameTable::find(name);
+            if (!internedName || !_map.erase(internedName))
+            {
+                return false;
+            }
+            NameTable::release(internedName);
+            return true;
+        }
+
+        void clear()
+        {
+            // The guard keeps the released names alive until the map no longer holds them.
+            EpochGuard guard;
+
+            for (const auto& [name, value] : _map)
+            {
+                NameTable::release(name);
+            }
+            _map.clear();
+        }
+
+        void swap(ChildrenMap& other) noexcept
+        {
+            _map.swap(other._map);
+        }
+
+    private:
+        template <typename TMap>
+        static auto _find(TMap& map, const std::string_view& name) noexcept -> decltype(&map.begin()->second)
+        {
+            // Keeps a name that no child holds from being destroyed and its address reused during the probe.
+            EpochGuard guard;
+
+            const InternedName* internedName = NameTable::find(name);
+            if (!internedName)
+            {
+                return nullptr;
+            }
+            auto it = map.find(internedName);
+            return (it != map.end()) ? &it->second : nullptr;
+        }
+    };
+
+} // namespace jbkvs::detail
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <mutex>
 #include <shared_mutex>
 #include <map>
 #include <optional>
+#include <utility>
+#include <vector>
 
+#include <jbkvs/detail/flatHashMap.h>
+#include <jbkvs/detail/lockFreeHashMap.h>
 #include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/persistentMap.h>
+#include <jbkvs/detail/pinnedValue.h>
+#include <jbkvs/detail/shardedMap.h>
 
 namespace jbkvs::detail
 {
@@ -13,16 +21,16 @@ namespace jbkvs::detail
     {
     };
 
-    template <typename TKey, typename TValue>
+    template <typename TKey, typename TValue, typename TContainer = std::map<TKey, TValue, std::less<>>>
     class SharedMutexMapConstIterator
-        : NonCopyableMixin<SharedMutexMapConstIterator<TKey, TValue>>
+        : NonCopyableMixin<SharedMutexMapConstIterator<TKey, TValue, TContainer>>
     {
         std::shared_lock<std::shared_mutex> _lock;
-        typename std::map<TKey, TValue, std::less<>>::const_iterator _it;
-        typename std::map<TKey, TValue, std::less<>>::const_iterator _endIt;
+        typename TContainer::const_iterator _it;
+        typename TContainer::const_iterator _endIt;
 
     public:
-        SharedMutexMapConstIterator(std::shared_mutex& mutex, const std::map<TKey, TValue, std::less<>>& map)
+        SharedMutexMapConstIterator(std::shared_mutex& mutex, const TContainer& map)
             : _lock(mutex)
             , _it(map.begin())
             , _endIt(map.end())
@@ -33,7 +41,7 @@ namespace jbkvs::detail
         {
         }
 
-        const std::pair<const TKey, TValue>& operator*() const noexcept
+        decltype(auto) operator*() const noexcept
         {
             return *_it;
         }
@@ -50,13 +58,17 @@ namespace jbkvs::detail
         }
     };
 
-    template <typename TKey, typename TValue>
+    template <typename TKey, typename TValue, typename TContainer = LockingMapContainer<TKey, TValue>>
     class SharedMutexMap
-        : public NonCopyableMixin<SharedMutexMap<TKey, TValue>>
+        : public NonCopyableMixin<SharedMutexMap<TKey, TValue, TContainer>>
     {
         mutable std::shared_mutex _mutex;
-        std::map<TKey, TValue, std::less<>> _map;
+        TContainer _map;
     public:
+        // Holds the map locked for reading.
+        using PinnedValue = detail::PinnedValue<TValue, std::shared_lock<std::shared_mutex>>;
+        using Snapshot = PersistentMapSnapshot<TKey, TValue>;
+
         SharedMutexMap() noexcept
             : _mutex()
             , _map()
@@ -76,6 +88,49 @@ namespace jbkvs::detail
             return it != _map.end() ? it->second : std::optional<TValue>();
         }
 
+        // Calls visitor(value) in place under the read lock. Returns false if the key is absent.
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            std::shared_lock lock(_mutex);
+
+            auto it = _map.find(key);
+            if (it == _map.end())
+            {
+                return false;
+            }
+            visitor(it->second);
+            return true;
+        }
+
+        PinnedValue pin(const TKey& key) const
+        {
+            std::shared_lock lock(_mutex);
+
+            auto it = _map.find(key);
+            if (it == _map.end())
+            {
+                return PinnedValue();
+            }
+            return PinnedValue(std::move(lock), &it->second);
+        }
+
+        // Calls visitor(index, value) for every key present, under a single lock acquisition.
+        template <typename TVisitor>
+        void visitMany(const std::vector<TKey>& keys, TVisitor&& visitor) const
+        {
+            std::shared_lock lock(_mutex);
+
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                auto it = _map.find(keys[i]);
+                if (it != _map.end())
+                {
+                    visitor(i, it->second);
+                }
+            }
+        }
+
         void put(const TKey& key, const TValue& value)
         {
             std::unique_lock lock(_mutex);
@@ -83,6 +138,17 @@ namespace jbkvs::detail
             _map[key] = value;
         }
 
+        template <typename T>
+        void putMany(const std::vector<std::pair<TKey, T>>& items)
+        {
+            std::unique_lock lock(_mutex);
+
+            for (const auto& [key, value] : items)
+            {
+                _map[key] = value;
+            }
+        }
+
         void put(const TKey& key, TValue&& value)
         {
             std::unique_lock lock(_mutex);
@@ -90,6 +156,38 @@ namespace jbkvs::detail
             _map[key] = std::move(value);
         }
 
+        // Calls updater(std::optional<TValue>&) under the write lock with the current value, or nothing if the key
+        // is absent; the value it leaves is stored, or the key is removed if it leaves nothing.
+        template <typename TUpdater>
+        void update(const TKey& key, TUpdater&& updater)
+        {
+            std::unique_lock lock(_mutex);
+
+            auto it = _map.find(key);
+            std::optional<TValue> value;
+            if (it != _map.end())
+            {
+                value = std::move(it->second);
+            }
+            updater(value);
+
+            if (value)
+            {
+                if (it != _map.end())
+                {
+                    it->second = std::move(*value);
+                }
+                else
+                {
+                    _map[key] = std::move(*value);
+                }
+            }
+            else if (it != _map.end())
+            {
+                _map.erase(key);
+            }
+        }
+
         bool remove(const TKey& key)
         {
             std::unique_lock lock(_mutex);
@@ -112,9 +210,25 @@ namespace jbkvs::detail
             return _map.size();
         }
 
-        SharedMutexMapConstIterator<TKey, TValue> begin() const
+        // Copies the items under the read lock; building the snapshot happens outside of it.
+        Snapshot snapshot() const
         {
-            return SharedMutexMapConstIterator<TKey, TValue>(_mutex, _map);
+            PersistentMapBuilder<TKey, TValue> builder;
+            {
+                std::shared_lock lock(_mutex);
+
+                builder.reserve(_map.size());
+                for (const auto& [key, value] : _map)
+                {
+                    builder.add(key, value);
+                }
+            }
+            return builder.build();
+        }
+
+        SharedMutexMapConstIterator<TKey, TValue, TContainer> begin() const
+        {
+            return SharedMutexMapConstIterator<TKey, TValue, TContainer>(_mutex, _map);
         }
 
         SharedMutexMapConstIteratorEndTag end() const
@@ -123,9 +237,22 @@ namespace jbkvs::detail
         }
     };
 
-    // TODO: provide lock-free map implementation.
+    // The implementation is selected at build time with the JBKVS_CONCURRENT_MAP CMake option.
 
+#if defined(JBKVS_CONCURRENT_MAP_SHARED_MUTEX)
     template <typename TKey, typename TValue>
     using ConcurrentMap = SharedMutexMap<TKey, TValue>;
+#elif defined(JBKVS_CONCURRENT_MAP_SHARDED)
+    template <typename TKey, typename TValue>
+    using ConcurrentMap = ShardedMap<TKey, TValue>;
+#elif defined(JBKVS_CONCURRENT_MAP_PERSISTENT)
+    // Snapshots take constant time, at the cost of copying a path of the trie on every write.
+    template <typename TKey, typename TValue>
+    using ConcurrentMap = PersistentMap<TKey, TValue>;
+#else
+    // Lookups never wait for writers, which keeps Node::get free of locks.
+    template <typename TKey, typename TValue>
+    using ConcurrentMap = LockFreeHashMap<TKey, TValue>;
+#endif
 
 } // namespace jbkvs::detail
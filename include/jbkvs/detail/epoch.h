@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Epoch-based memory reclamation.
+    //
+    // Readers pin the current global epoch for the lifetime of an EpochGuard. Pinning only stores into a
+    // thread-owned slot, so readers never wait and never perform read-modify-write operations on shared state.
+    // Writers unlink objects from shared structures and hand them to Epoch::retire(); an object is destroyed
+    // once the global epoch has advanced twice, which guarantees that no guard that could have observed it is
+    // still alive.
+
+    class Epoch
+        : NonCopyableMixin<Epoch>
+    {
+        friend class EpochGuard;
+
+        struct Retired
+        {
+            void* pointer;
+            void (*deleter)(void*);
+            uint64_t epoch;
+        };
+
+        struct ThreadRecord
+        {
+            // Pinned epoch shifted left by one with the lowest bit set, or zero when the thread is quiescent.
+            alignas(64) std::atomic<uint64_t> pinnedEpoch;
+            std::atomic<bool> inUse;
+            ThreadRecord* next;
+
+            // Accessed by the owning thread only.
+            size_t nesting;
+            size_t retiredSinceCollect;
+            std::vector<Retired> retired;
+
+            ThreadRecord() noexcept : pinnedEpoch(0), inUse(true), next(nullptr), nesting(0), retiredSinceCollect(0), retired() {}
+        };
+
+        struct OrphanedObjects;
+
+        static inline std::atomic<uint64_t> _globalEpoch = 1;
+        static inline std::atomic<ThreadRecord*> _threadRecords = nullptr;
+        static inline thread_local ThreadRecord* _threadRecord = nullptr;
+
+    public:
+        static void retire(void* pointer, void (*deleter)(void*));
+
+        template <typename T>
+        static void retire(T* pointer)
+        {
+            retire(const_cast<void*>(static_cast<const void*>(pointer)), [](void* p)
+            {
+                delete static_cast<T*>(p);
+            });
+        }
+
+        // Tries to advance the global epoch and destroys the objects retired by the calling thread that are no
+        // longer reachable by any guard.
+        static void collect();
+
+    private:
+        static ThreadRecord& _registerThread();
+
+        static ThreadRecord& _getThreadRecord()
+        {
+            ThreadRecord* record = _threadRecord;
+            return record ? *record : _registerThread();
+        }
+
+        static void _pin(ThreadRecord& record) noexcept
+        {
+            uint64_t epoch = _globalEpoch.load(std::memory_order_relaxed);
+            record.pinnedEpoch.store((epoch << 1) | 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        static bool _tryAdvance(uint64_t& epoch) noexcept;
+        static void _destroyReclaimable(std::vector<Retired>& retired, uint64_t epoch);
+        static OrphanedObjects& _getOrphanedObjects();
+        static void _releaseThread(ThreadRecord& record);
+    };
+
+    class EpochGuard
+        : NonCopyableMixin<EpochGuard>
+    {
+        Epoch::ThreadRecord& _record;
+
+    public:
+        EpochGuard()
+            : _record(Epoch::_getThreadRecord())
+        {
+            if (_record.nesting++ == 0)
+            {
+                Epoch::_pin(_record);
+            }
+        }
+
+        // Both guards keep the thread pinned, so the moved-from one can be released independently.
+        EpochGuard(EpochGuard&& other) noexcept
+            : _record(other._record)
+        {
+            ++_record.nesting;
+        }
+
+        ~EpochGuard()
+        {
+            if (--_record.nesting == 0)
+            {
+                _record.pinnedEpoch.store(0, std::memory_order_release);
+            }
+        }
+    };
+
+} // namespace jbkvs::detail
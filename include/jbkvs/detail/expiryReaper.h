@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/timerWheel.h>
+
+namespace jbkvs
+{
+
+    class Node;
+
+} // namespace jbkvs
+
+namespace jbkvs::detail
+{
+
+    // Removes the keys put with a TTL once it passes, so that expired keys are reclaimed even if they are never
+    // read again. Deadlines are kept in timer wheels with millisecond ticks that a background thread, started by
+    // the first scheduled key, advances periodically. Writers schedule into per-thread stripes, each with its own
+    // wheel and lock, so they don't contend with each other. The node validates an expiring key against its current
+    // deadline, so rewriting or removing a key needs no cancellation.
+
+    class ExpiryReaper
+        : NonCopyableMixin<ExpiryReaper>
+    {
+        struct Timer
+        {
+            std::weak_ptr<const Node> node;
+            uint32_t key;
+            uint64_t deadline;
+        };
+
+        struct alignas(64) Stripe
+        {
+            std::mutex mutex;
+            TimerWheel<Timer> wheel;
+
+            Stripe() : mutex(), wheel(now()) {}
+        };
+
+        static inline const size_t _stripeCount = 16;
+
+        std::array<Stripe, _stripeCount> _stripes;
+        // Wakes the thread up when a stripe gets its first timer.
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _wakeUp;
+
+    public:
+        // Current time in ticks, which deadlines are expressed in.
+        static uint64_t now() noexcept
+        {
+            return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        static void schedule(const std::weak_ptr<const Node>& node, uint32_t key, uint64_t deadline);
+
+        // Number of pending timers, summed over the stripes.
+        static size_t getTimerCount();
+
+    private:
+        ExpiryReaper();
+
+        static ExpiryReaper& _getInstance();
+        static size_t _getStripeIndex() noexcept;
+
+        void _run();
+    };
+
+} // namespace jbkvs::detail
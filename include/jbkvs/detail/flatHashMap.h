@@ -0,0 +1,462 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JBKVS_FLAT_HASH_MAP_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Open-addressing hash map in the style of Swiss tables.
+    //
+    // Control bytes live in their own array, one per slot: the top bit marks empty or deleted slots, and full slots
+    // keep the lowest 7 bits of the key hash. Lookups compare a whole group of 16 control bytes against those bits
+    // at once and only touch the slots that match. Items are stored inline, without a per-item allocation.
+    // Not thread-safe: used as the underlying container of the locking maps.
+
+    namespace flatHashMap
+    {
+
+        using ControlByte = int8_t;
+
+        const ControlByte empty = -128;
+        const ControlByte deleted = -2;
+        const size_t groupWidth = 16;
+
+        struct alignas(groupWidth) ControlGroup
+        {
+            ControlByte bytes[groupWidth];
+        };
+
+        // Set of slot indices within a group, iterated from the lowest.
+        class GroupMask
+        {
+            uint32_t _bits;
+
+        public:
+            explicit GroupMask(uint32_t bits) noexcept : _bits(bits) {}
+
+            explicit operator bool() const noexcept { return _bits != 0; }
+
+            size_t lowest() const noexcept
+            {
+#if defined(_MSC_VER)
+                unsigned long index;
+                _BitScanForward(&index, _bits);
+                return index;
+#else
+                return size_t(__builtin_ctz(_bits));
+#endif
+            }
+
+            GroupMask& operator++() noexcept
+            {
+                _bits &= _bits - 1;
+                return *this;
+            }
+        };
+
+#if defined(JBKVS_FLAT_HASH_MAP_SSE2)
+        class Group
+        {
+            __m128i _bytes;
+
+        public:
+            explicit Group(const ControlGroup& group) noexcept
+                : _bytes(_mm_load_si128(reinterpret_cast<const __m128i*>(group.bytes)))
+            {
+            }
+
+            GroupMask match(ControlByte hash) const noexcept
+            {
+                return GroupMask(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_bytes, _mm_set1_epi8(hash)))));
+            }
+
+            GroupMask matchEmpty() const noexcept
+            {
+                return match(empty);
+            }
+
+            GroupMask matchEmptyOrDeleted() const noexcept
+            {
+                return GroupMask(uint32_t(_mm_movemask_epi8(_bytes)));
+            }
+        };
+#else
+        class Group
+        {
+            const ControlGroup& _group;
+
+        public:
+            explicit Group(const ControlGroup& group) noexcept
+                : _group(group)
+            {
+            }
+
+            GroupMask match(ControlByte hash) const noexcept
+            {
+                uint32_t bits = 0;
+                for (size_t i = 0; i < groupWidth; ++i)
+                {
+                    bits |= uint32_t(_group.bytes[i] == hash) << i;
+                }
+                return GroupMask(bits);
+            }
+
+            GroupMask matchEmpty() const noexcept
+            {
+                return match(empty);
+            }
+
+            GroupMask matchEmptyOrDeleted() const noexcept
+            {
+                uint32_t bits = 0;
+                for (size_t i = 0; i < groupWidth; ++i)
+                {
+                    bits |= uint32_t(_group.bytes[i] < 0) << i;
+                }
+                return GroupMask(bits);
+            }
+        };
+#endif
+
+    } // namespace flatHashMap
+
+    template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+    class FlatHashMap
+        : public NonCopyableMixin<FlatHashMap<TKey, TValue, THash>>
+    {
+        using ControlByte = flatHashMap::ControlByte;
+        using ControlGroup = flatHashMap::ControlGroup;
+        using Group = flatHashMap::Group;
+        using Slot = std::pair<const TKey, TValue>;
+
+        static inline const size_t _groupWidth = flatHashMap::groupWidth;
+
+        std::unique_ptr<ControlGroup[]> _control;
+        Slot* _slots;
+        size_t _groupMask;
+        size_t _capacity;
+        size_t _size;
+        size_t _growthLeft;
+
+    public:
+        template <typename TSlot>
+        class Iterator
+        {
+            friend class FlatHashMap;
+
+            const ControlByte* _control;
+            TSlot* _slots;
+            size_t _index;
+            size_t _capacity;
+
+            Iterator(const ControlByte* control, TSlot* slots, size_t index, size_t capacity) noexcept
+                : _control(control)
+                , _slots(slots)
+                , _index(index)
+                , _capacity(capacity)
+            {
+                _skipFree();
+            }
+
+        public:
+            TSlot& operator*() const noexcept { return _slots[_index]; }
+            TSlot* operator->() const noexcept { return &_slots[_index]; }
+
+            Iterator& operator++() noexcept
+            {
+                ++_index;
+                _skipFree();
+                return *this;
+            }
+
+            bool operator==(const Iterator& other) const noexcept { return _index == other._index; }
+            bool operator!=(const Iterator& other) const noexcept { return _index != other._index; }
+
+        private:
+            void _skipFree() noexcept
+            {
+                while (_index < _capacity && _control[_index] < 0)
+                {
+                    ++_index;
+                }
+            }
+        };
+
+        using iterator = Iterator<Slot>;
+        using const_iterator = Iterator<const Slot>;
+
+        FlatHashMap() noexcept
+            : _control()
+            , _slots(nullptr)
+            , _groupMask(0)
+            , _capacity(0)
+            , _size(0)
+            , _growthLeft(0)
+        {
+        }
+
+        ~FlatHashMap()
+        {
+            clear();
+            _deallocate(_slots, _capacity);
+        }
+
+        size_t size() const noexcept { return _size; }
+        bool empty() const noexcept { return _size == 0; }
+
+        iterator begin() noexcept { return iterator(_controlBytes(), _slots, 0, _capacity); }
+        iterator end() noexcept { return iterator(_controlBytes(), _slots, _capacity, _capacity); }
+        const_iterator begin() const noexcept { return const_iterator(_controlBytes(), _slots, 0, _capacity); }
+        const_iterator end() const noexcept { return const_iterator(_controlBytes(), _slots, _capacity, _capacity); }
+
+        iterator find(const TKey& key) noexcept
+        {
+            size_t index = _find(key, _hash(key));
+            return iterator(_controlBytes(), _slots, index, _capacity);
+        }
+
+        const_iterator find(const TKey& key) const noexcept
+        {
+            size_t index = _find(key, _hash(key));
+            return const_iterator(_controlBytes(), _slots, index, _capacity);
+        }
+
+        TValue& operator[](const TKey& key)
+        {
+            size_t hash = _hash(key);
+            size_t index = _find(key, hash);
+            if (index == _capacity)
+            {
+                index = _insert(key, hash);
+            }
+            return _slots[index].second;
+        }
+
+        size_t erase(const TKey& key) noexcept
+        {
+            size_t index = _find(key, _hash(key));
+            if (index == _capacity)
+            {
+                return 0;
+            }
+
+            _slots[index].~Slot();
+            --_size;
+
+            // A group that still has an empty slot has never been full since the last rehash, so no probe sequence
+            // continues past it and the slot can become empty instead of a tombstone.
+            Group group(_control[index / _groupWidth]);
+            if (group.matchEmpty())
+            {
+                _controlBytes()[index] = flatHashMap::empty;
+                ++_growthLeft;
+            }
+            else
+            {
+                _controlBytes()[index] = flatHashMap::deleted;
+            }
+            return 1;
+        }
+
+        void clear() noexcept
+        {
+            if (_size > 0)
+            {
+                for (size_t i = 0; i < _capacity; ++i)
+                {
+                    if (_controlBytes()[i] >= 0)
+                    {
+                        _slots[i].~Slot();
+                    }
+                }
+            }
+
+            _resetControl();
+            _size = 0;
+        }
+
+        void swap(FlatHashMap& other) noexcept
+        {
+            std::swap(_control, other._control);
+            std::swap(_slots, other._slots);
+            std::swap(_groupMask, other._groupMask);
+            std::swap(_capacity, other._capacity);
+            std::swap(_size, other._size);
+            std::swap(_growthLeft, other._growthLeft);
+        }
+
+    private:
+        static size_t _hash(const TKey& key) noexcept
+        {
+            uint64_t hash = uint64_t(THash{}(key)) * 0x9E3779B97F4A7C15ull;
+            return size_t(hash ^ (hash >> 32));
+        }
+
+        static ControlByte _controlHash(size_t hash) noexcept
+        {
+            return ControlByte(hash & 0x7F);
+        }
+
+        static size_t _maxSizeForCapacity(size_t capacity) noexcept
+        {
+            return capacity - capacity / 8;
+        }
+
+        static Slot* _allocate(size_t capacity)
+        {
+            return capacity ? std::allocator<Slot>().allocate(capacity) : nullptr;
+        }
+
+        static void _deallocate(Slot* slots, size_t capacity) noexcept
+        {
+            if (slots)
+            {
+                std::allocator<Slot>().deallocate(slots, capacity);
+            }
+        }
+
+        ControlByte* _controlBytes() const noexcept
+        {
+            return reinterpret_cast<ControlByte*>(_control.get());
+        }
+
+        void _resetControl() noexcept
+        {
+            for (size_t i = 0; i < _capacity; ++i)
+            {
+                _controlBytes()[i] = flatHashMap::empty;
+            }
+            _growthLeft = _maxSizeForCapacity(_capacity);
+        }
+
+        // Returns the index of the slot holding the key, or the capacity if there is none.
+        size_t _find(const TKey& key, size_t hash) const noexcept
+        {
+            if (_capacity == 0)
+            {
+                return _capacity;
+            }
+
+            ControlByte controlHash = _controlHash(hash);
+            size_t groupIndex = (hash >> 7) & _groupMask;
+
+            // Triangular probing visits every group once when the number of groups is a power of two.
+            for (size_t probe = 1; probe <= _groupMask + 1; ++probe)
+            {
+                Group group(_control[groupIndex]);
+                for (auto mask = group.match(controlHash); mask; ++mask)
+                {
+                    size_t index = groupIndex * _groupWidth + mask.lowest();
+                    if (_slots[index].first == key)
+                    {
+                        return index;
+                    }
+                }
+
+                if (group.matchEmpty())
+                {
+                    break;
+                }
+
+                groupIndex = (groupIndex + probe) & _groupMask;
+            }
+
+            return _capacity;
+        }
+
+        size_t _findFreeSlot(size_t hash) const noexcept
+        {
+            size_t groupIndex = (hash >> 7) & _groupMask;
+            for (size_t probe = 1; ; ++probe)
+            {
+                auto mask = Group(_control[groupIndex]).matchEmptyOrDeleted();
+                if (mask)
+                {
+                    return groupIndex * _groupWidth + mask.lowest();
+                }
+                groupIndex = (groupIndex + probe) & _groupMask;
+            }
+        }
+
+        size_t _insert(const TKey& key, size_t hash)
+        {
+            size_t index = _capacity > 0 ? _findFreeSlot(hash) : 0;
+            if (_capacity == 0 || (_growthLeft == 0 && _controlBytes()[index] == flatHashMap::empty))
+            {
+                _rehash();
+                index = _findFreeSlot(hash);
+            }
+
+            new (&_slots[index]) Slot(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+
+            if (_controlBytes()[index] == flatHashMap::empty)
+            {
+                --_growthLeft;
+            }
+            _controlBytes()[index] = _controlHash(hash);
+            ++_size;
+
+            return index;
+        }
+
+        void _rehash()
+        {
+            // Grow unless most of the occupied capacity is tombstones, in which case rehashing in place frees it.
+            size_t newCapacity = _capacity == 0 ? _groupWidth : (_size * 2 > _maxSizeForCapacity(_capacity) ? _capacity * 2 : _capacity);
+
+            std::unique_ptr<ControlGroup[]> oldControl = std::move(_control);
+            Slot* oldSlots = _slots;
+            size_t oldCapacity = _capacity;
+
+            _control.reset(new ControlGroup[newCapacity / _groupWidth]);
+            _slots = _allocate(newCapacity);
+            _capacity = newCapacity;
+            _groupMask = newCapacity / _groupWidth - 1;
+            _resetControl();
+
+            for (size_t i = 0; i < oldCapacity; ++i)
+            {
+                if (oldControl[i / _groupWidth].bytes[i % _groupWidth] < 0)
+                {
+                    continue;
+                }
+
+                Slot& slot = oldSlots[i];
+                size_t hash = _hash(slot.first);
+                size_t index = _findFreeSlot(hash);
+
+                new (&_slots[index]) Slot(slot.first, std::move(slot.second));
+                slot.~Slot();
+
+                _controlBytes()[index] = _controlHash(hash);
+                --_growthLeft;
+            }
+
+            _deallocate(oldSlots, oldCapacity);
+        }
+    };
+
+    // Container behind the locking maps: integral keys get the flat table, other keys keep the ordered tree.
+    template <typename TKey, typename TValue>
+    using LockingMapContainer = std::conditional_t<std::is_integral_v<TKey>, FlatHashMap<TKey, TValue>, std::map<TKey, TValue, std::less<>>>;
+
+} // namespace jbkvs::detail
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <functional>
+#include <memory>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Concurrent Bloom filter over the keys of a map, used to skip maps that don't hold a key. The filter is
+    // blocked: a key sets one bit in each of the eight words of a single cache line, so a query costs one cache
+    // line per segment. Segments are only ever added: once the newest one has taken its capacity of new keys and
+    // the owner confirms that the map outgrew the filter, a segment three times larger than the whole filter is
+    // prepended, keeping the filter at about 16 bits per key. Adding a key never races with growth, as the
+    // segments a query reads are never modified other than by setting bits. Removed keys keep their bits.
+
+    template <typename TKey, typename THash = std::hash<TKey>>
+    class KeyFilter
+        : NonCopyableMixin<KeyFilter<TKey, THash>>
+    {
+    public:
+        struct Statistics
+        {
+            size_t segmentCount;
+            size_t bitCount;
+            size_t setBitCount;
+            // Expected from the fill of the segments.
+            double estimatedFalsePositiveRate;
+            // Queries reported by the owner as having found nothing in the map.
+            uint64_t falsePositiveCount;
+        };
+
+    private:
+        static inline const size_t _initialCapacity = 64;
+        static inline const size_t _bitsPerKey = 16;
+        static inline const size_t _wordCount = 8;
+        static inline const size_t _blockBits = _wordCount * 64;
+        static inline const uint32_t _salts[_wordCount] = { 0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u };
+
+        struct alignas(64) Block
+        {
+            std::atomic<uint64_t> words[_wordCount];
+        };
+
+        struct Segment
+        {
+            // Of this segment and of the older ones it links to.
+            const size_t totalCapacity;
+            const size_t blockMask;
+            const std::unique_ptr<Block[]> blocks;
+            const Segment* const next;
+            std::atomic<size_t> addedCount;
+
+            Segment(size_t capacity, const Segment* next)
+                : totalCapacity(capacity + (next ? next->totalCapacity : 0))
+                , blockMask(_getBlockCount(capacity) - 1)
+                , blocks(new Block[blockMask + 1]())
+                , next(next)
+                , addedCount(0)
+            {
+            }
+
+            size_t getCapacity() const noexcept
+            {
+                return totalCapacity - (next ? next->totalCapacity : 0);
+            }
+        };
+
+        std::atomic<Segment*> _head;
+        // Updated by readers, so kept apart from the head.
+        alignas(64) mutable std::atomic<uint64_t> _falsePositiveCount;
+
+    public:
+        KeyFilter()
+            : _head(new Segment(_initialCapacity, nullptr))
+            , _falsePositiveCount(0)
+        {
+        }
+
+        ~KeyFilter()
+        {
+            const Segment* segment = _head.load(std::memory_order_relaxed);
+            while (segment)
+            {
+                const Segment* next = segment->next;
+                delete segment;
+                segment = next;
+            }
+        }
+
+        // Adds the key; callers add it before storing it in the map. Returns true if the filter took as many new
+        // keys as it was sized for, in which case the owner should call grow() once the map holds more keys than
+        // getCapacity().
+        bool add(const TKey& key) noexcept
+        {
+            uint64_t hash = _getHash(key);
+            Segment& segment = *_head.load(std::memory_order_acquire);
+            Block& block = segment.blocks[size_t(hash >> 32) & segment.blockMask];
+
+            bool added = false;
+            for (size_t i = 0; i < _wordCount; ++i)
+            {
+                uint64_t mask = _getMask(hash, i);
+                // Keys that are already present don't write the shared cache line.
+                if (!(block.words[i].load(std::memory_order_relaxed) & mask))
+                {
+                    block.words[i].fetch_or(mask, std::memory_order_relaxed);
+                    added = true;
+                }
+            }
+
+            return added && segment.addedCount.fetch_add(1, std::memory_order_relaxed) + 1 >= segment.getCapacity();
+        }
+
+        // Returns false only if the key was never added.
+        bool mayContain(const TKey& key) const noexcept
+        {
+            uint64_t hash = _getHash(key);
+            for (const Segment* segment = _head.load(std::memory_order_acquire); segment; segment = segment->next)
+            {
+                const Block& block = segment->blocks[size_t(hash >> 32) & segment->blockMask];
+
+                bool contains = true;
+                for (size_t i = 0; i < _wordCount && contains; ++i)
+                {
+                    uint64_t mask = _getMask(hash, i);
+                    contains = (block.words[i].load(std::memory_order_relaxed) & mask) == mask;
+                }
+                if (contains)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Number of keys the filter is sized for.
+        size_t getCapacity() const noexcept
+        {
+            return _head.load(std::memory_order_acquire)->totalCapacity;
+        }
+
+        void grow()
+        {
+            Segment* head = _head.load(std::memory_order_acquire);
+            Segment* segment = new Segment(3 * head->totalCapacity, head);
+            if (!_head.compare_exchange_strong(head, segment, std::memory_order_acq_rel))
+            {
+                // Another thread has grown the filter.
+                delete segment;
+            }
+        }
+
+        void reportFalsePositive() const noexcept
+        {
+            _falsePositiveCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Counts the set bits, so it takes time linear in the size of the filter.
+        Statistics getStatistics() const
+        {
+            Statistics statistics = {};
+
+            double passRate = 1.0;
+            for (const Segment* segment = _head.load(std::memory_order_acquire); segment; segment = segment->next)
+            {
+                size_t bitCount = (segment->blockMask + 1) * _blockBits;
+                size_t setBitCount = 0;
+                for (size_t i = 0; i <= segment->blockMask; ++i)
+                {
+                    for (const std::atomic<uint64_t>& word : segment->blocks[i].words)
+                    {
+                        setBitCount += std::bitset<64>(word.load(std::memory_order_relaxed)).count();
+                    }
+                }
+
+                ++statistics.segmentCount;
+                statistics.bitCount += bitCount;
+                statistics.setBitCount += setBitCount;
+                passRate *= 1.0 - std::pow(double(setBitCount) / double(bitCount), double(_wordCount));
+            }
+
+            statistics.estimatedFalsePositiveRate = 1.0 - passRate;
+            statistics.falsePositiveCount = _falsePositiveCount.load(std::memory_order_relaxed);
+            return statistics;
+        }
+
+    private:
+        static size_t _getBlockCount(size_t capacity) noexcept
+        {
+            size_t blockCount = 1;
+            while (blockCount * _blockBits < capacity * _bitsPerKey)
+            {
+                blockCount <<= 1;
+            }
+            return blockCount;
+        }
+
+        static uint64_t _getHash(const TKey& key) noexcept
+        {
+            // splitmix64 finalizer, as std::hash of integers is the identity.
+            uint64_t hash = uint64_t(THash()(key));
+            hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+            hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+            return hash ^ (hash >> 31);
+        }
+
+        static uint64_t _getMask(uint64_t hash, size_t word) noexcept
+        {
+            return uint64_t(1) << ((uint32_t(hash) * _salts[word]) >> 26);
+        }
+    };
+
+} // namespace jbkvs::detail
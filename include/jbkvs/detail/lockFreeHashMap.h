@@ -0,0 +1,958 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/persistentMap.h>
+#include <jbkvs/detail/pinnedValue.h>
+#include <jbkvs/detail/spinLock.h>
+
+namespace jbkvs::detail
+{
+
+    // Hash map with lock-free lookups and updates.
+    //
+    // Every key owns an Entry whose value is an immutable item swapped atomically on put(); removal clears the
+    // item, after which the entry is unlinked lazily. Buckets are immutable arrays of entries replaced by CAS,
+    // so readers only follow pointers under an EpochGuard and never wait. Growing the table freezes buckets one
+    // by one; writers that need to change the membership of a frozen bucket wait until the new table is
+    // published, while lookups and updates of existing keys proceed.
+    //
+    // Trivially copyable values of up to 64 bits (and such alternatives of a std::variant) are stored in the entry
+    // itself under a SeqLock instead of in a separate item, so updating them neither allocates nor retires memory
+    // and reading them is a few loads validated by the sequence number.
+
+    class LockFreeHashMapConstIteratorEndTag
+    {
+    };
+
+    namespace lockFreeHashMap
+    {
+
+        template <typename T>
+        inline constexpr bool isInlineScalar = std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(uint64_t);
+
+        // Converts values to and from the inline representation of an entry: an alternative index and 64 bits.
+        template <typename TValue, typename = void>
+        struct InlineValue
+        {
+            static inline const bool enabled = false;
+
+            static bool pack(const TValue& value, uint32_t& index, uint64_t& bits) noexcept
+            {
+                return false;
+            }
+        };
+
+        template <typename TValue>
+        struct InlineValue<TValue, std::enable_if_t<isInlineScalar<TValue>>>
+        {
+            static inline const bool enabled = true;
+
+            static bool pack(const TValue& value, uint32_t& index, uint64_t& bits) noexcept
+            {
+                index = 0;
+                bits = 0;
+                memcpy(&bits, &value, sizeof(TValue));
+                return true;
+            }
+
+            static TValue unpack(uint32_t index, uint64_t bits) noexcept
+            {
+                TValue value;
+                memcpy(&value, &bits, sizeof(TValue));
+                return value;
+            }
+        };
+
+        template <typename... TAlternatives>
+        struct InlineValue<std::variant<TAlternatives...>, std::enable_if_t<(isInlineScalar<TAlternatives> || ...)>>
+        {
+            using Variant = std::variant<TAlternatives...>;
+
+            static inline const bool enabled = true;
+
+            static bool pack(const Variant& value, uint32_t& index, uint64_t& bits) noexcept
+            {
+                return _pack(value, index, bits, std::index_sequence_for<TAlternatives...>());
+            }
+
+            static Variant unpack(uint32_t index, uint64_t bits) noexcept
+            {
+                return _unpack(index, bits, std::index_sequence_for<TAlternatives...>());
+            }
+
+        private:
+            template <size_t... TIndices>
+            static bool _pack(const Variant& value, uint32_t& index, uint64_t& bits, std::index_sequence<TIndices...>) noexcept
+            {
+                return ((value.index() == TIndices && _packAlternative<TIndices>(value, index, bits)) || ...);
+            }
+
+            template <size_t TIndex>
+            static bool _packAlternative(const Variant& value, uint32_t& index, uint64_t& bits) noexcept
+            {
+                using Alternative = std::variant_alternative_t<TIndex, Variant>;
+                if constexpr (isInlineScalar<Alternative>)
+                {
+                    index = uint32_t(TIndex);
+                    bits = 0;
+                    memcpy(&bits, std::get_if<TIndex>(&value), sizeof(Alternative));
+                    return true;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            template <size_t... TIndices>
+            static Variant _unpack(uint32_t index, uint64_t bits, std::index_sequence<TIndices...>) noexcept
+            {
+                std::optional<Variant> value;
+                ((index == TIndices && _unpackAlternative<TIndices>(value, bits)) || ...);
+                return std::move(*value);
+            }
+
+            template <size_t TIndex>
+            static bool _unpackAlternative(std::optional<Variant>& value, uint64_t bits) noexcept
+            {
+                using Alternative = std::variant_alternative_t<TIndex, Variant>;
+                if constexpr (isInlineScalar<Alternative>)
+                {
+                    Alternative alternative;
+                    memcpy(&alternative, &bits, sizeof(Alternative));
+                    value.emplace(std::in_place_index<TIndex>, alternative);
+                }
+                return true;
+            }
+        };
+
+        template <typename TKey, typename TValue>
+        struct Entry
+        {
+            using Item = std::pair<const TKey, TValue>;
+            using Inline = InlineValue<TValue>;
+
+            const TKey key;
+            // Held by writers only around the stores, and validates readers of the inline value.
+            SeqLock lock;
+            std::atomic<uint32_t> inlineIndex;
+            // Serializes writers of the entry, which take lock only once their new value is ready, so that readers
+            // never wait for an updater.
+            SpinLock writeLock;
+            std::atomic<uint64_t> inlineBits;
+            // Null once the entry is dead; inlined() while the value is stored in the entry.
+            std::atomic<const Item*> item;
+
+            Entry(const TKey& key, const Item* item, uint32_t inlineIndex, uint64_t inlineBits) noexcept
+                : key(key)
+                , lock()
+                , inlineIndex(inlineIndex)
+                , writeLock()
+                , inlineBits(inlineBits)
+                , item(item)
+            {
+            }
+
+            static const Item* inlined() noexcept
+            {
+                alignas(Item) static const char marker = 0;
+                return reinterpret_cast<const Item*>(&marker);
+            }
+
+            static bool isAllocated(const Item* item) noexcept
+            {
+                return item && item != inlined();
+            }
+
+            // Must be called under an EpochGuard. Returns nothing if the entry is dead.
+            std::optional<TValue> load() const
+            {
+                if constexpr (Inline::enabled)
+                {
+                    while (true)
+                    {
+                        uint32_t sequence = lock.readBegin();
+                        const Item* current = item.load(std::memory_order_acquire);
+                        if (current != inlined())
+                        {
+                            return current ? current->second : std::optional<TValue>();
+                        }
+
+                        uint32_t index = inlineIndex.load(std::memory_order_relaxed);
+                        uint64_t bits = inlineBits.load(std::memory_order_relaxed);
+                        if (!lock.readRetry(sequence))
+                        {
+                            return Inline::unpack(index, bits);
+                        }
+                    }
+                }
+                else
+                {
+                    const Item* current = item.load(std::memory_order_acquire);
+                    return current ? current->second : std::optional<TValue>();
+                }
+            }
+
+            // Must be called with writeLock held, on a live entry.
+            TValue loadLocked() const
+            {
+                const Item* current = item.load(std::memory_order_relaxed);
+                if constexpr (Inline::enabled)
+                {
+                    if (current == inlined())
+                    {
+                        return Inline::unpack(inlineIndex.load(std::memory_order_relaxed), inlineBits.load(std::memory_order_relaxed));
+                    }
+                }
+                return current->second;
+            }
+
+            // Must be called with both locks held, on a live entry.
+            void storeLocked(const Item* newItem, uint32_t newInlineIndex, uint64_t newInlineBits) noexcept
+            {
+                if (newItem == inlined())
+                {
+                    inlineIndex.store(newInlineIndex, std::memory_order_relaxed);
+                    inlineBits.store(newInlineBits, std::memory_order_relaxed);
+                }
+                item.store(newItem, std::memory_order_release);
+            }
+
+            // Replaces the value of a live entry, passing out the previous item. Fails if the entry is dead.
+            bool store(const Item* newItem, uint32_t newInlineIndex, uint64_t newInlineBits, const Item*& oldItem) noexcept
+            {
+                std::lock_guard writeGuard(writeLock);
+                std::lock_guard guard(lock);
+
+                oldItem = item.load(std::memory_order_relaxed);
+                if (!oldItem)
+                {
+                    return false;
+                }
+
+                storeLocked(newItem, newInlineIndex, newInlineBits);
+                return true;
+            }
+
+            // Marks the entry as dead and returns the previous item, which is null if it was already dead.
+            const Item* kill() noexcept
+            {
+                std::lock_guard writeGuard(writeLock);
+                std::lock_guard guard(lock);
+
+                const Item* oldItem = item.load(std::memory_order_relaxed);
+                item.store(nullptr, std::memory_order_release);
+                return oldItem;
+            }
+        };
+
+        template <typename TKey, typename TValue>
+        struct Bucket
+        {
+            size_t size;
+            Entry<TKey, TValue>* entries[1];
+
+            static Bucket* allocate(size_t size)
+            {
+                size_t bytes = sizeof(Bucket) + (size > 0 ? size - 1 : 0) * sizeof(Entry<TKey, TValue>*);
+                Bucket* bucket = static_cast<Bucket*>(::operator new(bytes));
+                bucket->size = size;
+                return bucket;
+            }
+
+            static void free(Bucket* bucket) noexcept
+            {
+                ::operator delete(bucket);
+            }
+        };
+
+        template <typename TKey, typename TValue>
+        struct Table
+        {
+            // Lowest bit of a bucket word marks the bucket as frozen for migration.
+            static inline const uintptr_t frozenBit = 1;
+
+            const uint32_t shift;
+            const size_t bucketCount;
+            std::unique_ptr<std::atomic<uintptr_t>[]> buckets;
+
+            explicit Table(uint32_t log2BucketCount)
+                : shift(64 - log2BucketCount)
+                , bucketCount(size_t(1) << log2BucketCount)
+                , buckets(new std::atomic<uintptr_t>[bucketCount])
+            {
+                for (size_t i = 0; i < bucketCount; ++i)
+                {
+                    buckets[i].store(0, std::memory_order_relaxed);
+                }
+            }
+
+            ~Table()
+            {
+                for (size_t i = 0; i < bucketCount; ++i)
+                {
+                    Bucket<TKey, TValue>::free(toBucket(buckets[i].load(std::memory_order_relaxed)));
+                }
+            }
+
+            size_t getIndex(size_t hash) const noexcept
+            {
+                // Fibonacci hashing: the upper bits of the product are well mixed even for identity hashes.
+                return bucketCount > 1 ? size_t((uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> shift) : 0;
+            }
+
+            static Bucket<TKey, TValue>* toBucket(uintptr_t word) noexcept
+            {
+                return reinterpret_cast<Bucket<TKey, TValue>*>(word & ~frozenBit);
+            }
+
+            static bool isFrozen(uintptr_t word) noexcept
+            {
+                return word & frozenBit;
+            }
+        };
+
+    } // namespace lockFreeHashMap
+
+    template <typename TKey, typename TValue>
+    class LockFreeHashMapConstIterator
+        : NonCopyableMixin<LockFreeHashMapConstIterator<TKey, TValue>>
+    {
+        using Entry = lockFreeHashMap::Entry<TKey, TValue>;
+        using Table = lockFreeHashMap::Table<TKey, TValue>;
+        using Item = typename Entry::Item;
+
+        EpochGuard _guard;
+        const Table* _table;
+        size_t _bucketIndex;
+        size_t _entryIndex;
+        const Item* _item;
+        std::optional<Item> _inlineItem;
+
+    public:
+        explicit LockFreeHashMapConstIterator(const std::atomic<Table*>& table)
+            : _guard()
+            , _table(table.load(std::memory_order_acquire))
+            , _bucketIndex(0)
+            , _entryIndex(0)
+            , _item(nullptr)
+            , _inlineItem()
+        {
+            _advance();
+        }
+
+        ~LockFreeHashMapConstIterator()
+        {
+        }
+
+        const Item& operator*() const noexcept
+        {
+            return *_item;
+        }
+
+        LockFreeHashMapConstIterator& operator++()
+        {
+            ++_entryIndex;
+            _advance();
+            return *this;
+        }
+
+        bool operator!=(const LockFreeHashMapConstIteratorEndTag& endTag) const noexcept
+        {
+            return _item != nullptr;
+        }
+
+    private:
+        void _advance()
+        {
+            for (; _bucketIndex < _table->bucketCount; ++_bucketIndex, _entryIndex = 0)
+            {
+                const auto* bucket = Table::toBucket(_table->buckets[_bucketIndex].load(std::memory_order_acquire));
+                for (; bucket && _entryIndex < bucket->size; ++_entryIndex)
+                {
+                    const Entry* entry = bucket->entries[_entryIndex];
+                    _item = entry->item.load(std::memory_order_acquire);
+                    if (_item == Entry::inlined())
+                    {
+                        // Inline values have no item of their own, so materialize one for the caller.
+                        std::optional<TValue> value = entry->load();
+                        _item = value ? &_inlineItem.emplace(entry->key, std::move(*value)) : nullptr;
+                    }
+                    if (_item)
+                    {
+                        return;
+                    }
+                }
+            }
+            _item = nullptr;
+        }
+    };
+
+    template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+    class LockFreeHashMap
+        : public NonCopyableMixin<LockFreeHashMap<TKey, TValue, THash>>
+    {
+        using Entry = lockFreeHashMap::Entry<TKey, TValue>;
+        using Bucket = lockFreeHashMap::Bucket<TKey, TValue>;
+        using Table = lockFreeHashMap::Table<TKey, TValue>;
+        using Item = typename Entry::Item;
+        using Inline = typename Entry::Inline;
+
+        static inline const uint32_t _initialLog2BucketCount = 3;
+        static inline const size_t _maxLoadFactor = 2;
+
+        std::atomic<Table*> _table;
+        std::atomic<size_t> _size;
+        std::mutex _resizeMutex;
+
+    public:
+        // Holds the thread pinned, so the item stays alive even if the key is overwritten or removed meanwhile.
+        using PinnedValue = detail::PinnedValue<TValue, EpochGuard>;
+        using Snapshot = PersistentMapSnapshot<TKey, TValue, THash>;
+
+        LockFreeHashMap()
+            : _table(new Table(_initialLog2BucketCount))
+            , _size(0)
+            , _resizeMutex()
+        {
+        }
+
+        ~LockFreeHashMap()
+        {
+            Table* table = _table.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < table->bucketCount; ++i)
+            {
+                Bucket* bucket = Table::toBucket(table->buckets[i].load(std::memory_order_relaxed));
+                for (size_t j = 0; bucket && j < bucket->size; ++j)
+                {
+                    const Item* item = bucket->entries[j]->item.load(std::memory_order_relaxed);
+                    if (Entry::isAllocated(item))
+                    {
+                        delete item;
+                    }
+                    delete bucket->entries[j];
+                }
+            }
+            delete table;
+        }
+
+        std::optional<TValue> get(const TKey& key) const
+        {
+            EpochGuard guard;
+
+            const Entry* entry = _find(key);
+            return entry ? entry->load() : std::optional<TValue>();
+        }
+
+        // Calls visitor(value) under an EpochGuard; heap items are visited in place. Returns false if the key is
+        // absent.
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            EpochGuard guard;
+
+            const Entry* entry = _find(key);
+            bool found = false;
+            if (entry)
+            {
+                _visit(*entry, [&visitor, &found](const TValue& value)
+                {
+                    found = true;
+                    visitor(value);
+                });
+            }
+            return found;
+        }
+
+        PinnedValue pin(const TKey& key) const
+        {
+            EpochGuard guard;
+
+            const Entry* entry = _find(key);
+            const Item* item = entry ? entry->item.load(std::memory_order_acquire) : nullptr;
+            if (item == Entry::inlined())
+            {
+                // Inline values may change in place, so they are pinned by copy.
+                std::optional<TValue> value = entry->load();
+                return value ? PinnedValue(std::move(guard), std::move(*value)) : PinnedValue();
+            }
+            return item ? PinnedValue(std::move(guard), &item->second) : PinnedValue();
+        }
+
+        // Calls visitor(index, value) for every key present, under a single EpochGuard.
+        template <typename TVisitor>
+        void visitMany(const std::vector<TKey>& keys, TVisitor&& visitor) const
+        {
+            EpochGuard guard;
+
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                const Entry* entry = _find(keys[i]);
+                if (entry)
+                {
+                    _visit(*entry, [&visitor, i](const TValue& value)
+                    {
+                        visitor(i, value);
+                    });
+                }
+            }
+        }
+
+        void put(const TKey& key, const TValue& value)
+        {
+            uint32_t inlineIndex;
+            uint64_t inlineBits;
+            if (Inline::pack(value, inlineIndex, inlineBits))
+            {
+                _put(key, nullptr, inlineIndex, inlineBits);
+            }
+            else
+            {
+                _put(key, std::make_unique<Item>(key, value), 0, 0);
+            }
+        }
+
+        void put(const TKey& key, TValue&& value)
+        {
+            uint32_t inlineIndex;
+            uint64_t inlineBits;
+            std::unique_ptr<Item> item = _makeItem(key, std::move(value), inlineIndex, inlineBits);
+            _put(key, std::move(item), inlineIndex, inlineBits);
+        }
+
+        // Calls updater(std::optional<TValue>&) with the current value, or nothing if the key is absent; the value
+        // it leaves is stored, or the key is removed if it leaves nothing. Updates of a key are serialized by the
+        // write lock of its entry, and the seqlock that readers validate against is taken only to store the result,
+        // so lookups proceed while the updater runs and scalar values are updated without allocation. The updater
+        // runs under the write lock and must not access the map. It is called again if the key is concurrently
+        // inserted while absent.
+        template <typename TUpdater>
+        void update(const TKey& key, TUpdater&& updater)
+        {
+            EpochGuard guard;
+
+            while (true)
+            {
+                Entry* entry = _find(key);
+                if (entry)
+                {
+                    std::unique_lock writeLock(entry->writeLock);
+
+                    const Item* oldItem = entry->item.load(std::memory_order_relaxed);
+                    if (oldItem)
+                    {
+                        std::optional<TValue> value = entry->loadLocked();
+                        updater(value);
+
+                        if (!value)
+                        {
+                            {
+                                std::lock_guard lock(entry->lock);
+                                entry->storeLocked(nullptr, 0, 0);
+                            }
+                            writeLock.unlock();
+
+                            _retireItem(oldItem);
+                            _size.fetch_sub(1, std::memory_order_relaxed);
+                            _unlink(entry);
+                            return;
+                        }
+
+                        uint32_t inlineIndex;
+                        uint64_t inlineBits;
+                        std::unique_ptr<Item> newItem = _makeItem(key, std::move(*value), inlineIndex, inlineBits);
+                        {
+                            std::lock_guard lock(entry->lock);
+                            entry->storeLocked(newItem ? newItem.release() : Entry::inlined(), inlineIndex, inlineBits);
+                        }
+                        writeLock.unlock();
+
+                        _retireItem(oldItem);
+                        return;
+                    }
+                }
+
+                std::optional<TValue> value;
+                updater(value);
+                if (!value)
+                {
+                    return;
+                }
+
+                uint32_t inlineIndex;
+                uint64_t inlineBits;
+                std::unique_ptr<Item> newItem = _makeItem(key, std::move(*value), inlineIndex, inlineBits);
+                if (_put(key, std::move(newItem), inlineIndex, inlineBits, true))
+                {
+                    return;
+                }
+            }
+        }
+
+        template <typename T>
+        void putMany(const std::vector<std::pair<TKey, T>>& items)
+        {
+            // Pins once for the whole batch; the guards taken by put() only bump the nesting counter.
+            EpochGuard guard;
+
+            for (const auto& [key, value] : items)
+            {
+                put(key, TValue(value));
+            }
+        }
+
+        bool remove(const TKey& key)
+        {
+            EpochGuard guard;
+
+            Entry* entry = _find(key);
+            if (!entry)
+            {
+                return false;
+            }
+
+            const Item* item = entry->kill();
+            if (!item)
+            {
+                // Concurrently removed by someone else.
+                return false;
+            }
+
+            _retireItem(item);
+            _size.fetch_sub(1, std::memory_order_relaxed);
+
+            _unlink(entry);
+            return true;
+        }
+
+        void clear()
+        {
+            EpochGuard guard;
+            std::lock_guard lock(_resizeMutex);
+
+            Table* table = _table.load(std::memory_order_acquire);
+            for (size_t i = 0; i < table->bucketCount; ++i)
+            {
+                Bucket* bucket = Table::toBucket(table->buckets[i].exchange(0, std::memory_order_acq_rel));
+                if (!bucket)
+                {
+                    continue;
+                }
+
+                // Entries are cleared only after being unlinked, so concurrent updates either land before the
+                // clear or observe a dead entry and insert into the emptied bucket.
+                for (size_t j = 0; j < bucket->size; ++j)
+                {
+                    Entry* entry = bucket->entries[j];
+                    const Item* item = entry->kill();
+                    if (item)
+                    {
+                        _retireItem(item);
+                        _size.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                    Epoch::retire(entry);
+                }
+                _retireBucket(bucket);
+            }
+        }
+
+        size_t size() const
+        {
+            return _size.load(std::memory_order_relaxed);
+        }
+
+        // Copies the items while writers proceed: every item has been current at some point during the copy, but
+        // updates made meanwhile may be partially reflected.
+        Snapshot snapshot() const
+        {
+            PersistentMapBuilder<TKey, TValue, THash> builder;
+            builder.reserve(size());
+            for (const auto& [key, value] : *this)
+            {
+                builder.add(key, value);
+            }
+            return builder.build();
+        }
+
+        LockFreeHashMapConstIterator<TKey, TValue> begin() const
+        {
+            return LockFreeHashMapConstIterator<TKey, TValue>(_table);
+        }
+
+        LockFreeHashMapConstIteratorEndTag end() const
+        {
+            return {};
+        }
+
+    private:
+        static size_t _hash(const TKey& key) noexcept
+        {
+            return THash{}(key);
+        }
+
+        // Must be called under an EpochGuard. Heap items are visited in place, inline values through a copy.
+        template <typename TVisitor>
+        static void _visit(const Entry& entry, TVisitor&& visitor)
+        {
+            const Item* item = entry.item.load(std::memory_order_acquire);
+            if (item == Entry::inlined())
+            {
+                std::optional<TValue> value = entry.load();
+                if (value)
+                {
+                    visitor(*value);
+                }
+            }
+            else if (item)
+            {
+                visitor(item->second);
+            }
+        }
+
+        // Returns null if the value is stored inline.
+        static std::unique_ptr<Item> _makeItem(const TKey& key, TValue&& value, uint32_t& inlineIndex, uint64_t& inlineBits)
+        {
+            if (Inline::pack(value, inlineIndex, inlineBits))
+            {
+                return nullptr;
+            }
+            inlineIndex = 0;
+            inlineBits = 0;
+            return std::make_unique<Item>(key, std::move(value));
+        }
+
+        static void _retireItem(const Item* item)
+        {
+            if (Entry::isAllocated(item))
+            {
+                Epoch::retire(item);
+            }
+        }
+
+        static void _retireBucket(Bucket* bucket)
+        {
+            Epoch::retire(bucket, [](void* p)
+            {
+                Bucket::free(static_cast<Bucket*>(p));
+            });
+        }
+
+        static Entry* _findInBucket(const Bucket* bucket, const TKey& key) noexcept
+        {
+            for (size_t i = 0; bucket && i < bucket->size; ++i)
+            {
+                if (bucket->entries[i]->key == key)
+                {
+                    return bucket->entries[i];
+                }
+            }
+            return nullptr;
+        }
+
+        // Must be called under an EpochGuard. Frozen buckets stay readable until their table is retired.
+        Entry* _find(const TKey& key) const noexcept
+        {
+            const Table* table = _table.load(std::memory_order_acquire);
+            uintptr_t word = table->buckets[table->getIndex(_hash(key))].load(std::memory_order_acquire);
+            return _findInBucket(Table::toBucket(word), key);
+        }
+
+        void _waitForMigration(const Table* table) const noexcept
+        {
+            while (_table.load(std::memory_order_acquire) == table)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        // A null item stores the value inline. Fails without storing if onlyIfAbsent is set and the key is present.
+        bool _put(const TKey& key, std::unique_ptr<Item>&& newItem, uint32_t inlineIndex, uint64_t inlineBits, bool onlyIfAbsent = false)
+        {
+            EpochGuard guard;
+
+            const Item* storedItem = newItem ? newItem.get() : Entry::inlined();
+            size_t hash = _hash(key);
+
+            while (true)
+            {
+                Table* table = _table.load(std::memory_order_acquire);
+                std::atomic<uintptr_t>& bucketWord = table->buckets[table->getIndex(hash)];
+                uintptr_t word = bucketWord.load(std::memory_order_acquire);
+                Bucket* bucket = Table::toBucket(word);
+
+                Entry* entry = _findInBucket(bucket, key);
+                if (entry && onlyIfAbsent)
+                {
+                    if (entry->item.load(std::memory_order_acquire))
+                    {
+                        return false;
+                    }
+                }
+                else if (const Item* oldItem; entry && entry->store(storedItem, inlineIndex, inlineBits, oldItem))
+                {
+                    newItem.release();
+                    _retireItem(oldItem);
+                    return true;
+                }
+                // A dead entry is replaced with a new one.
+
+                if (Table::isFrozen(word))
+                {
+                    _waitForMigration(table);
+                    continue;
+                }
+
+                size_t newSize = bucket ? bucket->size + (entry ? 0 : 1) : 1;
+                Bucket* newBucket = Bucket::allocate(newSize);
+                std::unique_ptr<Entry> newEntry = std::make_unique<Entry>(key, storedItem, inlineIndex, inlineBits);
+
+                size_t j = 0;
+                for (size_t i = 0; bucket && i < bucket->size; ++i)
+                {
+                    if (bucket->entries[i] != entry)
+                    {
+                        newBucket->entries[j++] = bucket->entries[i];
+                    }
+                }
+                newBucket->entries[j] = newEntry.get();
+
+                if (!bucketWord.compare_exchange_strong(word, reinterpret_cast<uintptr_t>(newBucket), std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    Bucket::free(newBucket);
+                    continue;
+                }
+
+                newItem.release();
+                newEntry.release();
+                if (entry)
+                {
+                    Epoch::retire(entry);
+                }
+                if (bucket)
+                {
+                    _retireBucket(bucket);
+                }
+
+                size_t size = _size.fetch_add(1, std::memory_order_relaxed) + 1;
+                if (size > table->bucketCount * _maxLoadFactor)
+                {
+                    _grow(table);
+                }
+                return true;
+            }
+        }
+
+        void _unlink(Entry* entry)
+        {
+            size_t hash = _hash(entry->key);
+
+            while (true)
+            {
+                Table* table = _table.load(std::memory_order_acquire);
+                std::atomic<uintptr_t>& bucketWord = table->buckets[table->getIndex(hash)];
+                uintptr_t word = bucketWord.load(std::memory_order_acquire);
+                Bucket* bucket = Table::toBucket(word);
+
+                size_t index = 0;
+                while (bucket && index < bucket->size && bucket->entries[index] != entry)
+                {
+                    ++index;
+                }
+
+                if (!bucket || index == bucket->size)
+                {
+                    // Already replaced by a concurrent put().
+                    return;
+                }
+
+                if (Table::isFrozen(word))
+                {
+                    _waitForMigration(table);
+                    continue;
+                }
+
+                Bucket* newBucket = nullptr;
+                if (bucket->size > 1)
+                {
+                    newBucket = Bucket::allocate(bucket->size - 1);
+                    std::copy(bucket->entries, bucket->entries + index, newBucket->entries);
+                    std::copy(bucket->entries + index + 1, bucket->entries + bucket->size, newBucket->entries + index);
+                }
+
+                if (bucketWord.compare_exchange_strong(word, reinterpret_cast<uintptr_t>(newBucket), std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    Epoch::retire(entry);
+                    _retireBucket(bucket);
+                    return;
+                }
+
+                Bucket::free(newBucket);
+            }
+        }
+
+        void _grow(Table* table)
+        {
+            std::unique_lock lock(_resizeMutex, std::try_to_lock);
+            if (!lock.owns_lock() || _table.load(std::memory_order_relaxed) != table)
+            {
+                return;
+            }
+
+            std::unique_ptr<Table> newTable = std::make_unique<Table>(64 - table->shift + 1);
+            std::vector<Entry*> halves[2];
+
+            for (size_t i = 0; i < table->bucketCount; ++i)
+            {
+                uintptr_t word = table->buckets[i].fetch_or(Table::frozenBit, std::memory_order_acq_rel);
+                const Bucket* bucket = Table::toBucket(word);
+
+                for (size_t j = 0; bucket && j < bucket->size; ++j)
+                {
+                    Entry* entry = bucket->entries[j];
+                    if (!entry->item.load(std::memory_order_acquire))
+                    {
+                        // Dead entries are not carried over, so their removers won't find them to unlink.
+                        Epoch::retire(entry);
+                        continue;
+                    }
+
+                    // With Fibonacci hashing bucket i splits into buckets 2i and 2i + 1 of the doubled table.
+                    halves[newTable->getIndex(_hash(entry->key)) & 1].push_back(entry);
+                }
+
+                for (size_t half = 0; half < 2; ++half)
+                {
+                    if (halves[half].empty())
+                    {
+                        continue;
+                    }
+
+                    Bucket* newBucket = Bucket::allocate(halves[half].size());
+                    std::copy(halves[half].begin(), halves[half].end(), newBucket->entries);
+                    newTable->buckets[i * 2 + half].store(reinterpret_cast<uintptr_t>(newBucket), std::memory_order_relaxed);
+                    halves[half].clear();
+                }
+            }
+
+            _table.store(newTable.release(), std::memory_order_release);
+            Epoch::retire(table);
+        }
+    };
+
+} // namespace jbkvs::detail
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/scanIterator.h>
+
+namespace jbkvs::detail
+{
+
+    // Merges streams of items sorted by key into a single stream in key order, keeping a heap of the streams by
+    // their current key. When several streams hold a key, the item of the stream that comes last wins and the
+    // others are skipped, so streams are passed from the lowest priority to the highest. Only the current item of
+    // every stream is held, so the merge costs O(log k) per item over k streams.
+
+    template <typename TKey, typename TValue, typename TIterator>
+    class MergeIterator
+        : NonCopyableMixin<MergeIterator<TKey, TValue, TIterator>>
+    {
+        std::vector<std::unique_ptr<TIterator>> _iterators;
+        // Indices of the streams with items left; the front one holds the smallest key and wins ties.
+        std::vector<size_t> _heap;
+
+    public:
+        explicit MergeIterator(std::vector<std::unique_ptr<TIterator>>&& iterators)
+            : _iterators(std::move(iterators))
+            , _heap()
+        {
+            _heap.reserve(_iterators.size());
+            for (size_t i = 0; i < _iterators.size(); ++i)
+            {
+                if (*_iterators[i] != ScanIteratorEndTag())
+                {
+                    _heap.push_back(i);
+                }
+            }
+            std::make_heap(_heap.begin(), _heap.end(), _getComparator());
+        }
+
+        ~MergeIterator()
+        {
+        }
+
+        const std::pair<TKey, TValue>& operator*() const noexcept
+        {
+            return **_iterators[_heap.front()];
+        }
+
+        MergeIterator& operator++()
+        {
+            // Copied, as advancing the stream that holds it invalidates the current item.
+            TKey key = (**this).first;
+            auto comparator = _getComparator();
+
+            do
+            {
+                std::pop_heap(_heap.begin(), _heap.end(), comparator);
+
+                TIterator& iterator = *_iterators[_heap.back()];
+                ++iterator;
+                if (iterator != ScanIteratorEndTag())
+                {
+                    std::push_heap(_heap.begin(), _heap.end(), comparator);
+                }
+                else
+                {
+                    _heap.pop_back();
+                }
+            }
+            while (!_heap.empty() && !(key < (**this).first));
+
+            return *this;
+        }
+
+        bool operator!=(const ScanIteratorEndTag& endTag) const noexcept
+        {
+            return !_heap.empty();
+        }
+
+    private:
+        auto _getComparator() const noexcept
+        {
+            // std heaps put the greatest element first, so smaller keys and then later streams compare greater.
+            return [this](size_t left, size_t right)
+            {
+                const TKey& leftKey = (**_iterators[left]).first;
+                const TKey& rightKey = (**_iterators[right]).first;
+                return rightKey < leftKey || (!(leftKey < rightKey) && left < right);
+            };
+        }
+    };
+
+} // namespace jbkvs::detail
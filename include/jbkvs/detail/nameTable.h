@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // String stored once for all of its holders. Equal strings intern to the same object while any of them holds
+    // a reference, so interned names are compared and hashed by address.
+
+    class InternedName
+        : NonCopyableMixin<InternedName>
+    {
+        friend class NameTable;
+
+        const std::string _value;
+        const size_t _hash;
+        mutable std::atomic<size_t> _referenceCount;
+
+        InternedName(const std::string_view& value, size_t hash) : _value(value), _hash(hash), _referenceCount(1) {}
+
+    public:
+        const std::string& getValue() const noexcept { return _value; }
+        size_t getHash() const noexcept { return _hash; }
+    };
+
+    // Global table of interned names, split into shards by hash. Every shard is an open-addressing table published
+    // to readers under an EpochGuard, so lookups and references to names that are already interned never lock;
+    // interning a new name or dropping the last reference to one locks its shard. Unreferenced names are removed
+    // and reclaimed through the epoch.
+
+    class NameTable
+        : NonCopyableMixin<NameTable>
+    {
+        struct Table
+        {
+            const size_t mask;
+            const std::unique_ptr<std::atomic<const InternedName*>[]> slots;
+
+            explicit Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<const InternedName*>[capacity]()) {}
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            // Replaced by writers holding the mutex.
+            std::atomic<const Table*> table;
+            // Slots holding a name or a tombstone, accessed under the mutex.
+            size_t usedCount;
+            std::atomic<size_t> size;
+
+            Shard() : mutex(), table(new Table(_initialCapacity)), usedCount(0), size(0) {}
+        };
+
+        static inline const size_t _shardCount = 16;
+        static inline const size_t _initialCapacity = 16;
+
+        // Marks the slots of removed names, so that probes continue past them.
+        static const InternedName _tombstone;
+
+    public:
+        // Returns the name equal to the string, interning it if needed, and takes a reference to it.
+        static const InternedName* acquire(const std::string_view& value);
+
+        // Drops a reference taken by acquire().
+        static void release(const InternedName* name);
+
+        // Returns the name equal to the string, or null if it isn't interned. Doesn't take a reference, so must be
+        // called under an EpochGuard, which keeps the name alive.
+        static const InternedName* find(const std::string_view& value) noexcept;
+
+        // Number of names currently interned.
+        static size_t getSize() noexcept;
+
+    private:
+        static Shard* _getShards();
+        static Shard& _getShard(size_t hash);
+        static size_t _getHash(const std::string_view& value) noexcept;
+
+        static const InternedName* _find(const Table& table, const std::string_view& value, size_t hash) noexcept;
+        static bool _tryReference(const InternedName& name) noexcept;
+        // Return the replaced table, if any, which the caller retires once the shard is unlocked.
+        static const Table* _insert(Shard& shard, const InternedName* name);
+        static const Table* _rebuild(Shard& shard, size_t capacity);
+        // Removes a name that lost its last reference, returning whether the caller must retire it.
+        static bool _remove(Shard& shard, const InternedName* name);
+    };
+
+} // namespace jbkvs::detail
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Direct-mapped cache from paths to the values they resolved to. Every slot publishes an immutable entry that
+    // readers access under an EpochGuard, so a hit costs one hash, one string comparison and a copy of the value.
+    // Entries are tagged with the generation of the structure they were resolved in and only match that
+    // generation, so bumping it invalidates the whole cache. Colliding paths replace each other.
+
+    template <typename TValue>
+    class PathCache
+        : NonCopyableMixin<PathCache<TValue>>
+    {
+        struct Entry
+        {
+            std::string path;
+            TValue value;
+            uint64_t generation;
+
+            Entry(const std::string_view& path, const TValue& value, uint64_t generation) : path(path), value(value), generation(generation) {}
+        };
+
+        const size_t _mask;
+        const std::unique_ptr<std::atomic<const Entry*>[]> _slots;
+
+    public:
+        // The capacity is rounded up to a power of two.
+        explicit PathCache(size_t capacity)
+            : _mask(_roundUp(capacity) - 1)
+            , _slots(new std::atomic<const Entry*>[_mask + 1]())
+        {
+        }
+
+        ~PathCache()
+        {
+            for (size_t i = 0; i <= _mask; ++i)
+            {
+                delete _slots[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        // Returns the value cached for the path in the generation, or an empty value.
+        TValue find(const std::string_view& path, uint64_t generation) const
+        {
+            EpochGuard guard;
+
+            const Entry* entry = _slots[_getIndex(path)].load(std::memory_order_acquire);
+            return (entry && entry->generation == generation && entry->path == path) ? entry->value : TValue();
+        }
+
+        void store(const std::string_view& path, const TValue& value, uint64_t generation)
+        {
+            const Entry* oldEntry = _slots[_getIndex(path)].exchange(new Entry(path, value, generation), std::memory_order_acq_rel);
+            if (oldEntry)
+            {
+                Epoch::retire(oldEntry);
+            }
+        }
+
+    private:
+        static size_t _roundUp(size_t capacity) noexcept
+        {
+            size_t result = 1;
+            while (result < capacity)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        size_t _getIndex(const std::string_view& path) const noexcept
+        {
+            return std::hash<std::string_view>()(path) & _mask;
+        }
+    };
+
+} // namespace jbkvs::detail
@@ -0,0 +1,904 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/pinnedValue.h>
+
+namespace jbkvs::detail
+{
+
+    // Persistent hash array mapped trie.
+    //
+    // Every branch consumes 5 bits of the key hash and stores only its present children, indexed by a bitmap.
+    // Nodes are immutable once published: an update copies the path from the root to the changed leaf and shares
+    // everything else with the previous version. Nodes are reference counted by their parents and by snapshots,
+    // so taking a snapshot only acquires the root. Lookups follow the current root under an EpochGuard without
+    // taking references; writers are serialized and publish a new root atomically.
+
+    class PersistentMapConstIteratorEndTag
+    {
+    };
+
+    namespace persistentMap
+    {
+
+        struct TrieNode
+        {
+            std::atomic<uint32_t> refCount;
+            const bool isLeaf;
+            // Number of items in the subtree.
+            const size_t size;
+
+            TrieNode(bool isLeaf, size_t size) noexcept : refCount(1), isLeaf(isLeaf), size(size) {}
+        };
+
+        template <typename TKey, typename TValue>
+        struct Leaf : TrieNode
+        {
+            using Item = std::pair<const TKey, TValue>;
+
+            const uint64_t hash;
+            const Item item;
+            // Items whose keys have the same hash, owned by this leaf.
+            const Leaf* const next;
+
+            template <typename TItemValue>
+            Leaf(uint64_t hash, const TKey& key, TItemValue&& value, const Leaf* next)
+                : TrieNode(true, next ? next->size + 1 : 1)
+                , hash(hash)
+                , item(key, std::forward<TItemValue>(value))
+                , next(next)
+            {
+            }
+
+            ~Leaf()
+            {
+                delete next;
+            }
+        };
+
+        struct Branch : TrieNode
+        {
+            const uint32_t bitmap;
+            TrieNode* children[1];
+
+            static Branch* allocate(uint32_t bitmap, size_t size)
+            {
+                size_t childCount = popCount(bitmap);
+                size_t bytes = sizeof(Branch) + (childCount > 0 ? childCount - 1 : 0) * sizeof(TrieNode*);
+                return new (::operator new(bytes)) Branch(bitmap, size);
+            }
+
+            static void free(Branch* branch) noexcept
+            {
+                branch->~Branch();
+                ::operator delete(branch);
+            }
+
+            static size_t popCount(uint32_t bits) noexcept
+            {
+#if defined(_MSC_VER)
+                return __popcnt(bits);
+#else
+                return size_t(__builtin_popcount(bits));
+#endif
+            }
+
+            size_t childCount() const noexcept
+            {
+                return popCount(bitmap);
+            }
+
+            size_t getPosition(uint32_t index) const noexcept
+            {
+                return popCount(bitmap & ((1u << index) - 1));
+            }
+
+        private:
+            Branch(uint32_t bitmap, size_t size) noexcept : TrieNode(false, size), bitmap(bitmap) {}
+        };
+
+        // Operations on tries. Functions returning a node hand over one reference to it.
+        template <typename TKey, typename TValue, typename THash>
+        struct Trie
+        {
+            using Leaf = persistentMap::Leaf<TKey, TValue>;
+            using Item = typename Leaf::Item;
+
+            static inline const uint32_t bitsPerLevel = 5;
+
+            static uint64_t hash(const TKey& key) noexcept
+            {
+                // Finalizer of MurmurHash3: every bit of the result depends on every bit of the input, so all
+                // levels of the trie are evenly populated even for identity hashes.
+                uint64_t hash = uint64_t(THash{}(key));
+                hash ^= hash >> 33;
+                hash *= 0xFF51AFD7ED558CCDull;
+                hash ^= hash >> 33;
+                hash *= 0xC4CEB9FE1A85EC53ull;
+                hash ^= hash >> 33;
+                return hash;
+            }
+
+            static uint32_t chunk(uint64_t hash, uint32_t shift) noexcept
+            {
+                return uint32_t(hash >> shift) & 31;
+            }
+
+            static void acquire(TrieNode* node) noexcept
+            {
+                node->refCount.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Fails for a node whose last reference is already gone, which a reader may still see under an EpochGuard.
+            static bool tryAcquire(TrieNode* node) noexcept
+            {
+                uint32_t refCount = node->refCount.load(std::memory_order_relaxed);
+                while (refCount != 0)
+                {
+                    if (node->refCount.compare_exchange_weak(refCount, refCount + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Lookups may still be traversing a node that loses its last reference, so it is destroyed once they
+            // are finished.
+            static void release(TrieNode* node)
+            {
+                if (node && node->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    Epoch::retire(node, [](void* p)
+                    {
+                        destroy(static_cast<TrieNode*>(p));
+                    });
+                }
+            }
+
+            // Drops a reference to a node that was never published, so no lookup can be traversing it.
+            static void releaseUnpublished(TrieNode* node) noexcept
+            {
+                if (node && node->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    destroy(node);
+                }
+            }
+
+            // Destroys an unreachable node. Children that only it referred to are unreachable as well.
+            static void destroy(TrieNode* node) noexcept
+            {
+                if (node->isLeaf)
+                {
+                    delete static_cast<Leaf*>(node);
+                    return;
+                }
+
+                Branch* branch = static_cast<Branch*>(node);
+                for (size_t i = 0; i < branch->childCount(); ++i)
+                {
+                    if (branch->children[i]->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        destroy(branch->children[i]);
+                    }
+                }
+                Branch::free(branch);
+            }
+
+            static const Item* find(const TrieNode* node, uint64_t hash, const TKey& key) noexcept
+            {
+                for (uint32_t shift = 0; node; shift += bitsPerLevel)
+                {
+                    if (node->isLeaf)
+                    {
+                        const Leaf* leaf = static_cast<const Leaf*>(node);
+                        for (; leaf && leaf->hash == hash; leaf = leaf->next)
+                        {
+                            if (leaf->item.first == key)
+                            {
+                                return &leaf->item;
+                            }
+                        }
+                        return nullptr;
+                    }
+
+                    const Branch* branch = static_cast<const Branch*>(node);
+                    uint32_t index = chunk(hash, shift);
+                    if (!(branch->bitmap & (1u << index)))
+                    {
+                        return nullptr;
+                    }
+                    node = branch->children[branch->getPosition(index)];
+                }
+                return nullptr;
+            }
+
+            template <typename TItemValue>
+            static TrieNode* insert(TrieNode* node, uint32_t shift, uint64_t hash, const TKey& key, TItemValue&& value)
+            {
+                if (!node)
+                {
+                    return new Leaf(hash, key, std::forward<TItemValue>(value), nullptr);
+                }
+
+                if (node->isLeaf)
+                {
+                    Leaf* leaf = static_cast<Leaf*>(node);
+                    if (leaf->hash == hash)
+                    {
+                        return new Leaf(hash, key, std::forward<TItemValue>(value), _copyChainWithout(leaf, key));
+                    }
+
+                    acquire(leaf);
+                    return _split(leaf, new Leaf(hash, key, std::forward<TItemValue>(value), nullptr), shift);
+                }
+
+                Branch* branch = static_cast<Branch*>(node);
+                uint32_t index = chunk(hash, shift);
+                size_t position = branch->getPosition(index);
+                if (!(branch->bitmap & (1u << index)))
+                {
+                    return _copyWithInserted(branch, index, position, new Leaf(hash, key, std::forward<TItemValue>(value), nullptr));
+                }
+
+                TrieNode* child = insert(branch->children[position], shift + bitsPerLevel, hash, key, std::forward<TItemValue>(value));
+                return _copyWithReplaced(branch, position, child);
+            }
+
+            // Returns false if the key is absent. Otherwise stores the new version of the subtree, or null if it
+            // became empty, into result.
+            static bool remove(TrieNode* node, uint32_t shift, uint64_t hash, const TKey& key, TrieNode*& result)
+            {
+                if (!node)
+                {
+                    return false;
+                }
+
+                if (node->isLeaf)
+                {
+                    const Leaf* leaf = static_cast<const Leaf*>(node);
+                    if (leaf->hash != hash || !_findInChain(leaf, key))
+                    {
+                        return false;
+                    }
+                    result = _copyChainWithout(leaf, key);
+                    return true;
+                }
+
+                Branch* branch = static_cast<Branch*>(node);
+                uint32_t index = chunk(hash, shift);
+                if (!(branch->bitmap & (1u << index)))
+                {
+                    return false;
+                }
+
+                size_t position = branch->getPosition(index);
+                TrieNode* child;
+                if (!remove(branch->children[position], shift + bitsPerLevel, hash, key, child))
+                {
+                    return false;
+                }
+
+                // A branch left with a single leaf is replaced by the leaf: lookups compare full hashes at leaves,
+                // so a leaf may sit higher than the length of its unique prefix.
+                size_t childCount = branch->childCount();
+                if (!child)
+                {
+                    if (childCount == 2 && branch->children[1 - position]->isLeaf)
+                    {
+                        result = branch->children[1 - position];
+                        acquire(result);
+                    }
+                    else
+                    {
+                        result = childCount > 1 ? _copyWithRemoved(branch, index, position) : nullptr;
+                    }
+                }
+                else if (childCount == 1 && child->isLeaf)
+                {
+                    result = child;
+                }
+                else
+                {
+                    result = _copyWithReplaced(branch, position, child);
+                }
+                return true;
+            }
+
+            // Builds a trie from leaves with pairwise different hashes. Reorders the range.
+            static TrieNode* build(Leaf** first, Leaf** last, uint32_t shift)
+            {
+                if (first == last)
+                {
+                    return nullptr;
+                }
+                if (last - first == 1)
+                {
+                    return *first;
+                }
+
+                std::sort(first, last, [shift](const Leaf* left, const Leaf* right)
+                {
+                    return chunk(left->hash, shift) < chunk(right->hash, shift);
+                });
+
+                uint32_t bitmap = 0;
+                size_t size = 0;
+                for (Leaf** it = first; it != last; ++it)
+                {
+                    bitmap |= 1u << chunk((*it)->hash, shift);
+                    size += (*it)->size;
+                }
+
+                Branch* branch = Branch::allocate(bitmap, size);
+                size_t position = 0;
+                for (Leaf** begin = first; begin != last; ++position)
+                {
+                    uint32_t index = chunk((*begin)->hash, shift);
+                    Leaf** end = begin;
+                    while (end != last && chunk((*end)->hash, shift) == index)
+                    {
+                        ++end;
+                    }
+                    branch->children[position] = build(begin, end, shift + bitsPerLevel);
+                    begin = end;
+                }
+                return branch;
+            }
+
+        private:
+            static bool _findInChain(const Leaf* leaf, const TKey& key) noexcept
+            {
+                for (; leaf; leaf = leaf->next)
+                {
+                    if (leaf->item.first == key)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            static Leaf* _copyChainWithout(const Leaf* leaf, const TKey& key)
+            {
+                Leaf* chain = nullptr;
+                for (; leaf; leaf = leaf->next)
+                {
+                    if (!(leaf->item.first == key))
+                    {
+                        chain = new Leaf(leaf->hash, leaf->item.first, leaf->item.second, chain);
+                    }
+                }
+                return chain;
+            }
+
+            // Places two leaves with different hashes that share the prefix below shift under new branches.
+            static TrieNode* _split(Leaf* first, Leaf* second, uint32_t shift)
+            {
+                uint32_t firstIndex = chunk(first->hash, shift);
+                uint32_t secondIndex = chunk(second->hash, shift);
+                size_t size = first->size + second->size;
+
+                if (firstIndex == secondIndex)
+                {
+                    Branch* branch = Branch::allocate(1u << firstIndex, size);
+                    branch->children[0] = _split(first, second, shift + bitsPerLevel);
+                    return branch;
+                }
+
+                Branch* branch = Branch::allocate((1u << firstIndex) | (1u << secondIndex), size);
+                branch->children[firstIndex < secondIndex ? 0 : 1] = first;
+                branch->children[firstIndex < secondIndex ? 1 : 0] = second;
+                return branch;
+            }
+
+            static Branch* _copyWithInserted(const Branch* branch, uint32_t index, size_t position, TrieNode* child)
+            {
+                Branch* result = Branch::allocate(branch->bitmap | (1u << index), branch->size + child->size);
+                size_t childCount = branch->childCount();
+                for (size_t i = 0, j = 0; i <= childCount; ++i)
+                {
+                    if (i == position)
+                    {
+                        result->children[i] = child;
+                        continue;
+                    }
+                    result->children[i] = branch->children[j++];
+                    acquire(result->children[i]);
+                }
+                return result;
+            }
+
+            static Branch* _copyWithReplaced(const Branch* branch, size_t position, TrieNode* child)
+            {
+                Branch* result = Branch::allocate(branch->bitmap, branch->size - branch->children[position]->size + child->size);
+                for (size_t i = 0; i < branch->childCount(); ++i)
+                {
+                    if (i == position)
+                    {
+                        result->children[i] = child;
+                        continue;
+                    }
+                    result->children[i] = branch->children[i];
+                    acquire(result->children[i]);
+                }
+                return result;
+            }
+
+            static Branch* _copyWithRemoved(const Branch* branch, uint32_t index, size_t position)
+            {
+                Branch* result = Branch::allocate(branch->bitmap & ~(1u << index), branch->size - branch->children[position]->size);
+                for (size_t i = 0, j = 0; i < branch->childCount(); ++i)
+                {
+                    if (i != position)
+                    {
+                        result->children[j] = branch->children[i];
+                        acquire(result->children[j++]);
+                    }
+                }
+                return result;
+            }
+        };
+
+    } // namespace persistentMap
+
+    // Immutable version of a persistent map. Copying only acquires the root, and reading needs no guard, so a
+    // snapshot can be kept and read for as long as needed, from any thread.
+    template <typename TKey, typename TValue, typename THash>
+    class PersistentMapConstIterator;
+
+    template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+    class PersistentMapSnapshot
+    {
+        using TrieNode = persistentMap::TrieNode;
+        using Trie = persistentMap::Trie<TKey, TValue, THash>;
+        using Item = typename Trie::Item;
+
+        TrieNode* _root;
+
+    public:
+        PersistentMapSnapshot() noexcept
+            : _root(nullptr)
+        {
+        }
+
+        // Adopts a reference to the root.
+        explicit PersistentMapSnapshot(TrieNode* root) noexcept
+            : _root(root)
+        {
+        }
+
+        PersistentMapSnapshot(const PersistentMapSnapshot& other) noexcept
+            : _root(other._root)
+        {
+            if (_root)
+            {
+                Trie::acquire(_root);
+            }
+        }
+
+        PersistentMapSnapshot(PersistentMapSnapshot&& other) noexcept
+            : _root(std::exchange(other._root, nullptr))
+        {
+        }
+
+        ~PersistentMapSnapshot()
+        {
+            Trie::release(_root);
+        }
+
+        PersistentMapSnapshot& operator=(PersistentMapSnapshot other) noexcept
+        {
+            std::swap(_root, other._root);
+            return *this;
+        }
+
+        std::optional<TValue> get(const TKey& key) const
+        {
+            const Item* item = Trie::find(_root, Trie::hash(key), key);
+            return item ? item->second : std::optional<TValue>();
+        }
+
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            const Item* item = Trie::find(_root, Trie::hash(key), key);
+            if (item)
+            {
+                visitor(item->second);
+            }
+            return item != nullptr;
+        }
+
+        size_t size() const noexcept
+        {
+            return _root ? _root->size : 0;
+        }
+
+        PersistentMapConstIterator<TKey, TValue, THash> begin() const;
+
+        PersistentMapConstIteratorEndTag end() const
+        {
+            return {};
+        }
+
+        const TrieNode* getRoot() const noexcept
+        {
+            return _root;
+        }
+    };
+
+    template <typename TKey, typename TValue, typename THash>
+    class PersistentMapConstIterator
+        : NonCopyableMixin<PersistentMapConstIterator<TKey, TValue, THash>>
+    {
+        using TrieNode = persistentMap::TrieNode;
+        using Branch = persistentMap::Branch;
+        using Trie = persistentMap::Trie<TKey, TValue, THash>;
+        using Leaf = typename Trie::Leaf;
+        using Item = typename Trie::Item;
+
+        static inline const size_t _maxDepth = 64 / Trie::bitsPerLevel + 1;
+
+        PersistentMapSnapshot<TKey, TValue, THash> _snapshot;
+        std::array<std::pair<const Branch*, size_t>, _maxDepth> _stack;
+        size_t _depth;
+        const Leaf* _leaf;
+
+    public:
+        explicit PersistentMapConstIterator(PersistentMapSnapshot<TKey, TValue, THash>&& snapshot) noexcept
+            : _snapshot(std::move(snapshot))
+            , _stack()
+            , _depth(0)
+            , _leaf(nullptr)
+        {
+            _descend(_snapshot.getRoot());
+        }
+
+        ~PersistentMapConstIterator()
+        {
+        }
+
+        const Item& operator*() const noexcept
+        {
+            return _leaf->item;
+        }
+
+        PersistentMapConstIterator& operator++() noexcept
+        {
+            _leaf = _leaf->next;
+            while (!_leaf && _depth > 0)
+            {
+                auto& [branch, position] = _stack[_depth - 1];
+                if (++position < branch->childCount())
+                {
+                    _descend(branch->children[position]);
+                }
+                else
+                {
+                    --_depth;
+                }
+            }
+            return *this;
+        }
+
+        bool operator!=(const PersistentMapConstIteratorEndTag& endTag) const noexcept
+        {
+            return _leaf != nullptr;
+        }
+
+    private:
+        void _descend(const TrieNode* node) noexcept
+        {
+            while (node && !node->isLeaf)
+            {
+                const Branch* branch = static_cast<const Branch*>(node);
+                _stack[_depth++] = { branch, 0 };
+                node = branch->children[0];
+            }
+            _leaf = static_cast<const Leaf*>(node);
+        }
+    };
+
+    template <typename TKey, typename TValue, typename THash>
+    PersistentMapConstIterator<TKey, TValue, THash> PersistentMapSnapshot<TKey, TValue, THash>::begin() const
+    {
+        return PersistentMapConstIterator<TKey, TValue, THash>(PersistentMapSnapshot(*this));
+    }
+
+    // Builds a snapshot from items with unique keys, without the path copying of PersistentMap::put(). Lets maps
+    // that are not persistent provide snapshots at the cost of a copy.
+    template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+    class PersistentMapBuilder
+        : NonCopyableMixin<PersistentMapBuilder<TKey, TValue, THash>>
+    {
+        using Trie = persistentMap::Trie<TKey, TValue, THash>;
+        using Leaf = typename Trie::Leaf;
+
+        std::vector<Leaf*> _leaves;
+
+    public:
+        PersistentMapBuilder()
+            : _leaves()
+        {
+        }
+
+        ~PersistentMapBuilder()
+        {
+            for (Leaf* leaf : _leaves)
+            {
+                delete leaf;
+            }
+        }
+
+        void reserve(size_t size)
+        {
+            _leaves.reserve(size);
+        }
+
+        template <typename TItemValue>
+        void add(const TKey& key, TItemValue&& value)
+        {
+            std::unique_ptr<Leaf> leaf = std::make_unique<Leaf>(Trie::hash(key), key, std::forward<TItemValue>(value), nullptr);
+            _leaves.push_back(leaf.get());
+            leaf.release();
+        }
+
+        PersistentMapSnapshot<TKey, TValue, THash> build()
+        {
+            std::sort(_leaves.begin(), _leaves.end(), [](const Leaf* left, const Leaf* right)
+            {
+                return left->hash < right->hash;
+            });
+
+            // Keys with equal hashes share a leaf.
+            size_t count = 0;
+            for (size_t i = 0; i < _leaves.size(); ++count)
+            {
+                Leaf* chain = _leaves[i];
+                _leaves[i++] = nullptr;
+                for (; i < _leaves.size() && _leaves[i]->hash == chain->hash; ++i)
+                {
+                    Leaf* leaf = _leaves[i];
+                    _leaves[i] = nullptr;
+                    chain = new Leaf(chain->hash, leaf->item.first, leaf->item.second, chain);
+                    delete leaf;
+                }
+                _leaves[count] = chain;
+            }
+            _leaves.resize(count);
+
+            persistentMap::TrieNode* root = Trie::build(_leaves.data(), _leaves.data() + _leaves.size(), 0);
+            _leaves.clear();
+            return PersistentMapSnapshot<TKey, TValue, THash>(root);
+        }
+    };
+
+    template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
+    class PersistentMap
+        : public NonCopyableMixin<PersistentMap<TKey, TValue, THash>>
+    {
+        using TrieNode = persistentMap::TrieNode;
+        using Trie = persistentMap::Trie<TKey, TValue, THash>;
+        using Item = typename Trie::Item;
+
+        std::atomic<TrieNode*> _root;
+        std::mutex _writeMutex;
+
+    public:
+        // Holds the thread pinned, so the item stays alive even if the key is overwritten or removed meanwhile.
+        using PinnedValue = detail::PinnedValue<TValue, EpochGuard>;
+        using Snapshot = PersistentMapSnapshot<TKey, TValue, THash>;
+
+        PersistentMap()
+            : _root(nullptr)
+            , _writeMutex()
+        {
+        }
+
+        ~PersistentMap()
+        {
+            Trie::release(_root.load(std::memory_order_relaxed));
+        }
+
+        std::optional<TValue> get(const TKey& key) const
+        {
+            EpochGuard guard;
+
+            const Item* item = Trie::find(_root.load(std::memory_order_acquire), Trie::hash(key), key);
+            return item ? item->second : std::optional<TValue>();
+        }
+
+        // Calls visitor(value) in place under an EpochGuard. Returns false if the key is absent.
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            EpochGuard guard;
+
+            const Item* item = Trie::find(_root.load(std::memory_order_acquire), Trie::hash(key), key);
+            if (item)
+            {
+                visitor(item->second);
+            }
+            return item != nullptr;
+        }
+
+        // Calls visitor(index, value) for every key present. All keys are resolved against the same version.
+        template <typename TVisitor>
+        void visitMany(const std::vector<TKey>& keys, TVisitor&& visitor) const
+        {
+            EpochGuard guard;
+
+            const TrieNode* root = _root.load(std::memory_order_acquire);
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                const Item* item = Trie::find(root, Trie::hash(keys[i]), keys[i]);
+                if (item)
+                {
+                    visitor(i, item->second);
+                }
+            }
+        }
+
+        PinnedValue pin(const TKey& key) const
+        {
+            EpochGuard guard;
+
+            const Item* item = Trie::find(_root.load(std::memory_order_acquire), Trie::hash(key), key);
+            return item ? PinnedValue(std::move(guard), &item->second) : PinnedValue();
+        }
+
+        void put(const TKey& key, const TValue& value)
+        {
+            std::lock_guard lock(_writeMutex);
+
+            TrieNode* root = _root.load(std::memory_order_relaxed);
+            _publish(Trie::insert(root, 0, Trie::hash(key), key, value));
+        }
+
+        void put(const TKey& key, TValue&& value)
+        {
+            std::lock_guard lock(_writeMutex);
+
+            TrieNode* root = _root.load(std::memory_order_relaxed);
+            _publish(Trie::insert(root, 0, Trie::hash(key), key, std::move(value)));
+        }
+
+        // Calls updater(std::optional<TValue>&) under the write lock with a copy of the current value, or nothing
+        // if the key is absent; the value it leaves is published, or the key is removed if it leaves nothing.
+        template <typename TUpdater>
+        void update(const TKey& key, TUpdater&& updater)
+        {
+            std::lock_guard lock(_writeMutex);
+
+            TrieNode* root = _root.load(std::memory_order_relaxed);
+            uint64_t hash = Trie::hash(key);
+            const Item* item = Trie::find(root, hash, key);
+
+            std::optional<TValue> value;
+            if (item)
+            {
+                value = item->second;
+            }
+            updater(value);
+
+            if (value)
+            {
+                _publish(Trie::insert(root, 0, hash, key, std::move(*value)));
+            }
+            else if (item)
+            {
+                TrieNode* newRoot;
+                Trie::remove(root, 0, hash, key, newRoot);
+                _publish(newRoot);
+            }
+        }
+
+        // Publishes all items as a single new version.
+        template <typename T>
+        void putMany(const std::vector<std::pair<TKey, T>>& items)
+        {
+            std::lock_guard lock(_writeMutex);
+
+            TrieNode* root = _root.load(std::memory_order_relaxed);
+            TrieNode* newRoot = nullptr;
+            for (const auto& [key, value] : items)
+            {
+                TrieNode* nextRoot = Trie::insert(newRoot ? newRoot : root, 0, Trie::hash(key), key, TValue(value));
+                Trie::releaseUnpublished(newRoot);
+                newRoot = nextRoot;
+            }
+            if (newRoot)
+            {
+                _publish(newRoot);
+            }
+        }
+
+        bool remove(const TKey& key)
+        {
+            std::lock_guard lock(_writeMutex);
+
+            TrieNode* root = _root.load(std::memory_order_relaxed);
+            TrieNode* newRoot;
+            if (!Trie::remove(root, 0, Trie::hash(key), key, newRoot))
+            {
+                return false;
+            }
+
+            _publish(newRoot);
+            return true;
+        }
+
+        void clear()
+        {
+            std::lock_guard lock(_writeMutex);
+
+            _publish(nullptr);
+        }
+
+        size_t size() const
+        {
+            EpochGuard guard;
+
+            const TrieNode* root = _root.load(std::memory_order_acquire);
+            return root ? root->size : 0;
+        }
+
+        // Returns the current version in constant time.
+        Snapshot snapshot() const
+        {
+            EpochGuard guard;
+
+            while (true)
+            {
+                TrieNode* root = _root.load(std::memory_order_acquire);
+                if (!root)
+                {
+                    return Snapshot();
+                }
+                // The root may lose its last reference to a concurrent writer, which has then published a new one.
+                if (Trie::tryAcquire(root))
+                {
+                    return Snapshot(root);
+                }
+            }
+        }
+
+        // Iterates over a snapshot, so the iteration is consistent and never blocks writers.
+        PersistentMapConstIterator<TKey, TValue, THash> begin() const
+        {
+            return PersistentMapConstIterator<TKey, TValue, THash>(snapshot());
+        }
+
+        PersistentMapConstIteratorEndTag end() const
+        {
+            return {};
+        }
+
+    private:
+        // Must be called under _writeMutex.
+        void _publish(TrieNode* newRoot)
+        {
+            Trie::release(_root.exchange(newRoot, std::memory_order_acq_rel));
+        }
+    };
+
+} // namespace jbkvs::detail
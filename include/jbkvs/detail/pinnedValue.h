@@ -0,0 +1,61 @@
+#pragma once
+
+#include <optional>
+#include <utility>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Reference to a value stored in a concurrent map, kept valid by TGuard (a lock or an epoch guard) for as long
+    // as the object lives. Values that the map does not store addressably are held by copy instead.
+    // An absent value holds no guard, so a miss pins nothing. Must be destroyed on the thread that created it.
+    template <typename TValue, typename TGuard>
+    class PinnedValue
+        : NonCopyableMixin<PinnedValue<TValue, TGuard>>
+    {
+        std::optional<TGuard> _guard;
+        std::optional<TValue> _copy;
+        const TValue* _value;
+
+    public:
+        PinnedValue()
+            : _guard()
+            , _copy()
+            , _value(nullptr)
+        {
+        }
+
+        PinnedValue(TGuard&& guard, const TValue* value) noexcept
+            : _guard(std::in_place, std::move(guard))
+            , _copy()
+            , _value(value)
+        {
+        }
+
+        PinnedValue(TGuard&& guard, TValue&& copy)
+            : _guard(std::in_place, std::move(guard))
+            , _copy(std::move(copy))
+            , _value(&*_copy)
+        {
+        }
+
+        PinnedValue(PinnedValue&& other)
+            : _guard(std::move(other._guard))
+            , _copy(std::move(other._copy))
+            , _value(_copy ? &*_copy : other._value)
+        {
+        }
+
+        ~PinnedValue()
+        {
+        }
+
+        explicit operator bool() const noexcept { return _value != nullptr; }
+
+        const TValue& operator*() const noexcept { return *_value; }
+        const TValue* operator->() const noexcept { return _value; }
+    };
+
+} // namespace jbkvs::detail
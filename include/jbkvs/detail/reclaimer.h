@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Destroys objects whose destruction may cascade through large structures, such as the children of a node
+    // that lost its last reference. Objects retired while another retired object is being destroyed on the same
+    // thread are queued and destroyed after it, so cascades run iteratively instead of recursing. Objects retired
+    // to the background are destroyed in batches by a thread started by the first of them, so that the call that
+    // dropped a large structure doesn't pay for destroying it.
+
+    class Reclaimer
+        : NonCopyableMixin<Reclaimer>
+    {
+        struct Retired
+        {
+            void* pointer;
+            void (*deleter)(void*);
+        };
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        // Notified whenever the thread finishes a batch.
+        std::condition_variable _idleCondition;
+        std::vector<Retired> _queue;
+        bool _isBusy;
+
+        // Objects retired by the destructors that run on this thread, or null if no retired object is being destroyed.
+        static inline thread_local std::vector<Retired>* _localQueue = nullptr;
+
+    public:
+        // Destroys the object on the background thread.
+        template <typename T>
+        static void retire(std::unique_ptr<T>&& object)
+        {
+            _retire(_makeRetired(std::move(object)), true);
+        }
+
+        // Destroys the object on the calling thread, once the destructor that retires it, if any, returns.
+        template <typename T>
+        static void destroy(std::unique_ptr<T>&& object)
+        {
+            _retire(_makeRetired(std::move(object)), false);
+        }
+
+        // Waits until the objects retired to the background so far are destroyed.
+        static void drain();
+
+    private:
+        Reclaimer();
+
+        static Reclaimer& _getInstance();
+
+        template <typename T>
+        static Retired _makeRetired(std::unique_ptr<T>&& object) noexcept
+        {
+            return { object.release(), [](void* p)
+            {
+                delete static_cast<T*>(p);
+            } };
+        }
+
+        static void _retire(const Retired& retired, bool background);
+        static void _destroy(std::vector<Retired>& queue) noexcept;
+
+        void _run();
+    };
+
+} // namespace jbkvs::detail
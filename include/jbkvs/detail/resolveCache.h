@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/spinLock.h>
+
+namespace jbkvs::detail
+{
+
+    // Direct-mapped cache of the layer that resolves a key in a stack of layers. An entry remembers the index of
+    // the winning layer within one published layer list, together with a stamp of the layers above it; the owner
+    // recomputes the stamp to validate the entry, so entries are never invalidated explicitly. Colliding keys
+    // simply replace each other.
+
+    template <typename TKey, typename THash = std::hash<TKey>>
+    class ResolveCache
+        : NonCopyableMixin<ResolveCache<TKey, THash>>
+    {
+    public:
+        // Layer of the entries that record that no layer resolves the key.
+        static inline const uint32_t noLayer = ~uint32_t(0);
+
+        struct Entry
+        {
+            uint32_t layer;
+            // Generation of the layer list the entry was resolved in; zero is never used by a list.
+            uint64_t listGeneration;
+            uint64_t stamp;
+        };
+
+    private:
+        struct alignas(32) Slot
+        {
+            SeqLock lock;
+            std::atomic<TKey> key;
+            std::atomic<uint32_t> selector;
+            std::atomic<uint32_t> layer;
+            std::atomic<uint64_t> listGeneration;
+            std::atomic<uint64_t> stamp;
+        };
+
+        const size_t _mask;
+        const std::unique_ptr<Slot[]> _slots;
+
+    public:
+        // The capacity is rounded up to a power of two.
+        explicit ResolveCache(size_t capacity)
+            : _mask(_roundUp(capacity) - 1)
+            , _slots(new Slot[_mask + 1]())
+        {
+        }
+
+        // Looks up the entry of the key resolved for the selector in the list of the generation.
+        bool find(const TKey& key, uint32_t selector, uint64_t listGeneration, Entry& entry) const noexcept
+        {
+            const Slot& slot = _slots[_getIndex(key, selector)];
+
+            while (true)
+            {
+                uint32_t sequence = slot.lock.readBegin();
+
+                bool found = slot.listGeneration.load(std::memory_order_relaxed) == listGeneration
+                    && slot.key.load(std::memory_order_relaxed) == key
+                    && slot.selector.load(std::memory_order_relaxed) == selector;
+                entry.layer = slot.layer.load(std::memory_order_relaxed);
+                entry.listGeneration = listGeneration;
+                entry.stamp = slot.stamp.load(std::memory_order_relaxed);
+
+                if (!slot.lock.readRetry(sequence))
+                {
+                    return found;
+                }
+            }
+        }
+
+        void store(const TKey& key, uint32_t selector, const Entry& entry) noexcept
+        {
+            Slot& slot = _slots[_getIndex(key, selector)];
+            std::lock_guard lock(slot.lock);
+
+            slot.key.store(key, std::memory_order_relaxed);
+            slot.selector.store(selector, std::memory_order_relaxed);
+            slot.layer.store(entry.layer, std::memory_order_relaxed);
+            slot.listGeneration.store(entry.listGeneration, std::memory_order_relaxed);
+            slot.stamp.store(entry.stamp, std::memory_order_relaxed);
+        }
+
+    private:
+        static size_t _roundUp(size_t capacity) noexcept
+        {
+            size_t result = 1;
+            while (result < capacity)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+
+        size_t _getIndex(const TKey& key, uint32_t selector) const noexcept
+        {
+            // Fibonacci hashing spreads sequential keys, which std::hash leaves as they are.
+            uint64_t hash = (uint64_t(THash()(key)) ^ (uint64_t(selector) << 56)) * 0x9E3779B97F4A7C15ull;
+            return size_t(hash >> 32) & _mask;
+        }
+    };
+
+} // namespace jbkvs::detail
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Streams the items of a concurrent map whose keys lie in [from, to], in key order.
+    //
+    // The matching keys are collected up front; values are then fetched in chunks with a single visitMany() call
+    // per chunk, so no lock is held while the caller processes items. Items removed after the keys were collected
+    // are skipped, and items added meanwhile are not visited.
+
+    class ScanIteratorEndTag
+    {
+    };
+
+    template <typename TKey, typename TValue, typename TMap>
+    class ScanIterator
+        : NonCopyableMixin<ScanIterator<TKey, TValue, TMap>>
+    {
+        static inline const size_t _chunkSize = 256;
+
+        const TMap& _map;
+        std::vector<TKey> _keys;
+        size_t _keyIndex;
+        std::vector<TKey> _chunkKeys;
+        std::vector<std::pair<TKey, TValue>> _chunk;
+        size_t _chunkIndex;
+
+    public:
+        ScanIterator(const TMap& map, const TKey& from, const TKey& to)
+            : _map(map)
+            , _keys()
+            , _keyIndex(0)
+            , _chunkKeys()
+            , _chunk()
+            , _chunkIndex(0)
+        {
+            for (const auto& [key, value] : _map)
+            {
+                if (!(key < from) && !(to < key))
+                {
+                    _keys.push_back(key);
+                }
+            }
+            std::sort(_keys.begin(), _keys.end());
+
+            _fetch();
+        }
+
+        ~ScanIterator()
+        {
+        }
+
+        const std::pair<TKey, TValue>& operator*() const noexcept
+        {
+            return _chunk[_chunkIndex];
+        }
+
+        ScanIterator& operator++()
+        {
+            if (++_chunkIndex == _chunk.size())
+            {
+                _fetch();
+            }
+            return *this;
+        }
+
+        bool operator!=(const ScanIteratorEndTag& endTag) const noexcept
+        {
+            return _chunkIndex < _chunk.size();
+        }
+
+    private:
+        void _fetch()
+        {
+            _chunk.clear();
+            _chunkIndex = 0;
+
+            while (_chunk.empty() && _keyIndex < _keys.size())
+            {
+                size_t count = std::min(_chunkSize, _keys.size() - _keyIndex);
+                _chunkKeys.assign(_keys.begin() + _keyIndex, _keys.begin() + _keyIndex + count);
+                _keyIndex += count;
+
+                _map.visitMany(_chunkKeys, [this](size_t index, const TValue& value)
+                {
+                    _chunk.emplace_back(_chunkKeys[index], value);
+                });
+
+                // Some maps visit keys grouped by their internal layout rather than in request order.
+                std::sort(_chunk.begin(), _chunk.end(), [](const auto& left, const auto& right)
+                {
+                    return left.first < right.first;
+                });
+            }
+        }
+    };
+
+} // namespace jbkvs::detail
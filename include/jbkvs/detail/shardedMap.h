@@ -0,0 +1,351 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include <jbkvs/detail/flatHashMap.h>
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/persistentMap.h>
+#include <jbkvs/detail/pinnedValue.h>
+#include <jbkvs/detail/spinLock.h>
+
+namespace jbkvs::detail
+{
+
+    // Map that splits its key space across TShardCount independently locked shards, so that writers to different
+    // keys only contend when the keys hash to the same shard. Each shard occupies its own cache line.
+
+    class ShardedMapConstIteratorEndTag
+    {
+    };
+
+    namespace shardedMap
+    {
+
+        template <typename TKey, typename TValue>
+        struct alignas(64) Shard
+        {
+            using Container = LockingMapContainer<TKey, TValue>;
+
+            mutable SharedSpinLock lock;
+            Container map;
+        };
+
+    } // namespace shardedMap
+
+    template <typename TKey, typename TValue, size_t TShardCount>
+    class ShardedMapConstIterator
+        : NonCopyableMixin<ShardedMapConstIterator<TKey, TValue, TShardCount>>
+    {
+        using Shard = shardedMap::Shard<TKey, TValue>;
+
+        const std::array<Shard, TShardCount>& _shards;
+        size_t _shardIndex;
+        std::shared_lock<SharedSpinLock> _lock;
+        typename Shard::Container::const_iterator _it;
+
+    public:
+        explicit ShardedMapConstIterator(const std::array<Shard, TShardCount>& shards)
+            : _shards(shards)
+            , _shardIndex(0)
+            , _lock(shards[0].lock)
+            , _it(shards[0].map.begin())
+        {
+            _skipEmptyShards();
+        }
+
+        ~ShardedMapConstIterator()
+        {
+        }
+
+        const std::pair<const TKey, TValue>& operator*() const noexcept
+        {
+            return *_it;
+        }
+
+        ShardedMapConstIterator& operator++() noexcept
+        {
+            ++_it;
+            _skipEmptyShards();
+            return *this;
+        }
+
+        bool operator!=(const ShardedMapConstIteratorEndTag& endTag) const noexcept
+        {
+            return _shardIndex < TShardCount;
+        }
+
+    private:
+        void _skipEmptyShards() noexcept
+        {
+            // Only one shard is locked at a time, so writers to other shards are never blocked by iteration.
+            while (_it == _shards[_shardIndex].map.end())
+            {
+                _lock.unlock();
+                if (++_shardIndex == TShardCount)
+                {
+                    return;
+                }
+                _lock = std::shared_lock<SharedSpinLock>(_shards[_shardIndex].lock);
+                _it = _shards[_shardIndex].map.begin();
+            }
+        }
+    };
+
+    template <typename TKey, typename TValue, size_t TShardCount = 16>
+    class ShardedMap
+        : public NonCopyableMixin<ShardedMap<TKey, TValue, TShardCount>>
+    {
+        static_assert(TShardCount > 0 && (TShardCount & (TShardCount - 1)) == 0, "Shard count must be a power of two");
+
+        using Shard = shardedMap::Shard<TKey, TValue>;
+
+        std::array<Shard, TShardCount> _shards;
+
+    public:
+        // Holds the shard of the key locked for reading.
+        using PinnedValue = detail::PinnedValue<TValue, std::shared_lock<SharedSpinLock>>;
+        using Snapshot = PersistentMapSnapshot<TKey, TValue>;
+
+        ShardedMap()
+            : _shards()
+        {
+        }
+
+        ~ShardedMap()
+        {
+        }
+
+        std::optional<TValue> get(const TKey& key) const
+        {
+            const Shard& shard = _getShard(key);
+            std::shared_lock lock(shard.lock);
+
+            auto it = shard.map.find(key);
+            return it != shard.map.end() ? it->second : std::optional<TValue>();
+        }
+
+        // Calls visitor(value) in place under the read lock of the shard. Returns false if the key is absent.
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            const Shard& shard = _getShard(key);
+            std::shared_lock lock(shard.lock);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.end())
+            {
+                return false;
+            }
+            visitor(it->second);
+            return true;
+        }
+
+        PinnedValue pin(const TKey& key) const
+        {
+            const Shard& shard = _getShard(key);
+            std::shared_lock lock(shard.lock);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.end())
+            {
+                return PinnedValue();
+            }
+            return PinnedValue(std::move(lock), &it->second);
+        }
+
+        // Calls visitor(index, value) for every key present. Keys are grouped by shard, so every shard involved
+        // is locked once.
+        template <typename TVisitor>
+        void visitMany(const std::vector<TKey>& keys, TVisitor&& visitor) const
+        {
+            std::vector<std::pair<size_t, size_t>> order = _groupByShard(keys.size(), [&keys](size_t i) -> const TKey& { return keys[i]; });
+
+            for (size_t begin = 0, end = 0; begin < order.size(); begin = end)
+            {
+                const Shard& shard = _shards[order[begin].first];
+                std::shared_lock lock(shard.lock);
+
+                for (end = begin; end < order.size() && order[end].first == order[begin].first; ++end)
+                {
+                    size_t index = order[end].second;
+                    auto it = shard.map.find(keys[index]);
+                    if (it != shard.map.end())
+                    {
+                        visitor(index, it->second);
+                    }
+                }
+            }
+        }
+
+        void put(const TKey& key, const TValue& value)
+        {
+            Shard& shard = _getShard(key);
+            std::unique_lock lock(shard.lock);
+
+            shard.map[key] = value;
+        }
+
+        void put(const TKey& key, TValue&& value)
+        {
+            Shard& shard = _getShard(key);
+            std::unique_lock lock(shard.lock);
+
+            shard.map[key] = std::move(value);
+        }
+
+        // Calls updater(std::optional<TValue>&) under the write lock of the shard with the current value, or nothing
+        // if the key is absent; the value it leaves is stored, or the key is removed if it leaves nothing.
+        template <typename TUpdater>
+        void update(const TKey& key, TUpdater&& updater)
+        {
+            Shard& shard = _getShard(key);
+            std::unique_lock lock(shard.lock);
+
+            auto it = shard.map.find(key);
+            std::optional<TValue> value;
+            if (it != shard.map.end())
+            {
+                value = std::move(it->second);
+            }
+            updater(value);
+
+            if (value)
+            {
+                if (it != shard.map.end())
+                {
+                    it->second = std::move(*value);
+                }
+                else
+                {
+                    shard.map[key] = std::move(*value);
+                }
+            }
+            else if (it != shard.map.end())
+            {
+                shard.map.erase(key);
+            }
+        }
+
+        template <typename T>
+        void putMany(const std::vector<std::pair<TKey, T>>& items)
+        {
+            std::vector<std::pair<size_t, size_t>> order = _groupByShard(items.size(), [&items](size_t i) -> const TKey& { return items[i].first; });
+
+            for (size_t begin = 0, end = 0; begin < order.size(); begin = end)
+            {
+                Shard& shard = _shards[order[begin].first];
+                std::unique_lock lock(shard.lock);
+
+                // Stable grouping keeps the last of duplicate keys winning, as with consecutive put() calls.
+                for (end = begin; end < order.size() && order[end].first == order[begin].first; ++end)
+                {
+                    const auto& [key, value] = items[order[end].second];
+                    shard.map[key] = value;
+                }
+            }
+        }
+
+        bool remove(const TKey& key)
+        {
+            Shard& shard = _getShard(key);
+            std::unique_lock lock(shard.lock);
+
+            bool result = !!shard.map.erase(key);
+            return result;
+        }
+
+        void clear()
+        {
+            for (Shard& shard : _shards)
+            {
+                std::unique_lock lock(shard.lock);
+
+                shard.map.clear();
+            }
+        }
+
+        size_t size() const
+        {
+            size_t result = 0;
+            for (const Shard& shard : _shards)
+            {
+                std::shared_lock lock(shard.lock);
+
+                result += shard.map.size();
+            }
+            return result;
+        }
+
+        // Copies the items with all shards locked for reading at once, so the snapshot is consistent across shards.
+        Snapshot snapshot() const
+        {
+            PersistentMapBuilder<TKey, TValue> builder;
+            {
+                std::array<std::shared_lock<SharedSpinLock>, TShardCount> locks;
+                for (size_t i = 0; i < TShardCount; ++i)
+                {
+                    locks[i] = std::shared_lock<SharedSpinLock>(_shards[i].lock);
+                }
+
+                for (const Shard& shard : _shards)
+                {
+                    for (const auto& [key, value] : shard.map)
+                    {
+                        builder.add(key, value);
+                    }
+                }
+            }
+            return builder.build();
+        }
+
+        ShardedMapConstIterator<TKey, TValue, TShardCount> begin() const
+        {
+            return ShardedMapConstIterator<TKey, TValue, TShardCount>(_shards);
+        }
+
+        ShardedMapConstIteratorEndTag end() const
+        {
+            return {};
+        }
+
+    private:
+        static size_t _getShardIndex(const TKey& key) noexcept
+        {
+            // Fibonacci hashing spreads sequential keys across shards.
+            uint64_t hash = uint64_t(std::hash<TKey>{}(key)) * 0x9E3779B97F4A7C15ull;
+            return size_t(hash >> 32) & (TShardCount - 1);
+        }
+
+        // Returns (shard index, item index) pairs ordered by shard.
+        template <typename TGetKey>
+        static std::vector<std::pair<size_t, size_t>> _groupByShard(size_t count, TGetKey&& getKey)
+        {
+            std::vector<std::pair<size_t, size_t>> order(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                order[i] = { _getShardIndex(getKey(i)), i };
+            }
+            std::sort(order.begin(), order.end());
+            return order;
+        }
+
+        Shard& _getShard(const TKey& key) noexcept
+        {
+            return _shards[_getShardIndex(key)];
+        }
+
+        const Shard& _getShard(const TKey& key) const noexcept
+        {
+            return _shards[_getShardIndex(key)];
+        }
+    };
+
+} // namespace jbkvs::detail
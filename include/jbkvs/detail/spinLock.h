@@ -1,6 +1,10 @@
 #pragma once
 
+#include <stdint.h>
 #include <atomic>
+#include <thread>
+
+#include <immintrin.h>
 
 namespace jbkvs::detail
 {
@@ -35,4 +39,151 @@ namespace jbkvs::detail
         }
     };
 
+    // Reader-writer spin lock for short critical sections. Waiting writers block new readers to avoid starvation.
+    // Waiters yield after a bounded number of spins, since the owner may have been preempted.
+    class SharedSpinLock
+    {
+        static inline const uint32_t _writer = 1;
+        static inline const uint32_t _writerPending = 2;
+        static inline const uint32_t _reader = 4;
+        static inline const uint32_t _spinsBeforeYield = 64;
+
+        std::atomic<uint32_t> _state = 0;
+    public:
+        void lock() noexcept
+        {
+            for (uint32_t spins = 0; ; ++spins)
+            {
+                uint32_t state = _state.load(std::memory_order_relaxed);
+                if ((state & ~_writerPending) == 0)
+                {
+                    if (_state.compare_exchange_weak(state, _writer, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                    continue;
+                }
+                if (!(state & _writerPending))
+                {
+                    _state.fetch_or(_writerPending, std::memory_order_relaxed);
+                }
+                _backOff(spins);
+            }
+        }
+
+        bool try_lock() noexcept
+        {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            return (state & ~_writerPending) == 0 && _state.compare_exchange_strong(state, _writer, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock() noexcept
+        {
+            _state.fetch_and(~_writer, std::memory_order_release);
+        }
+
+        void lock_shared() noexcept
+        {
+            for (uint32_t spins = 0; ; ++spins)
+            {
+                uint32_t state = _state.load(std::memory_order_relaxed);
+                if (!(state & (_writer | _writerPending)))
+                {
+                    if (_state.compare_exchange_weak(state, state + _reader, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                    continue;
+                }
+                _backOff(spins);
+            }
+        }
+
+        bool try_lock_shared() noexcept
+        {
+            uint32_t state = _state.load(std::memory_order_relaxed);
+            return !(state & (_writer | _writerPending)) && _state.compare_exchange_strong(state, state + _reader, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        void unlock_shared() noexcept
+        {
+            _state.fetch_sub(_reader, std::memory_order_release);
+        }
+
+    private:
+        static void _backOff(uint32_t spins) noexcept
+        {
+            if (spins < _spinsBeforeYield)
+            {
+                _mm_pause();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    // Sequence lock for small values read far more often than written. Writers are serialized and keep the sequence
+    // odd while writing; readers copy the value without writing shared memory and retry if the sequence changed.
+    // Data guarded by the lock must itself be accessed through relaxed atomics.
+    class SeqLock
+    {
+        static inline const uint32_t _spinsBeforeYield = 64;
+
+        std::atomic<uint32_t> _sequence = 0;
+    public:
+        uint32_t readBegin() const noexcept
+        {
+            for (uint32_t spins = 0; ; ++spins)
+            {
+                uint32_t sequence = _sequence.load(std::memory_order_acquire);
+                if (!(sequence & 1))
+                {
+                    return sequence;
+                }
+                _backOff(spins);
+            }
+        }
+
+        bool readRetry(uint32_t sequence) const noexcept
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return _sequence.load(std::memory_order_relaxed) != sequence;
+        }
+
+        void lock() noexcept
+        {
+            for (uint32_t spins = 0; ; ++spins)
+            {
+                uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+                if (!(sequence & 1) && _sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    // Keeps the data stores after the odd sequence becomes visible.
+                    std::atomic_thread_fence(std::memory_order_release);
+                    return;
+                }
+                _backOff(spins);
+            }
+        }
+
+        void unlock() noexcept
+        {
+            _sequence.fetch_add(1, std::memory_order_release);
+        }
+
+    private:
+        static void _backOff(uint32_t spins) noexcept
+        {
+            if (spins < _spinsBeforeYield)
+            {
+                _mm_pause();
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    };
+
 } // namespace jbkvs::detail
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+
+namespace jbkvs::detail
+{
+
+    // Hierarchical timer wheel.
+    //
+    // Level l has _slotCount slots, each covering _slotCount^l ticks. A timer is put into the level that matches
+    // the distance to its deadline, and timers of a higher level slot are moved one level down when the wheel
+    // reaches that slot, so scheduling and expiring a timer cost O(1) amortized regardless of the number of
+    // timers. Timers are not cancelled: the owner validates a timer when it expires. Not thread-safe.
+
+    template <typename TTimer>
+    class TimerWheel
+        : NonCopyableMixin<TimerWheel<TTimer>>
+    {
+        struct Entry
+        {
+            uint64_t deadline;
+            TTimer timer;
+        };
+
+        using Slot = std::vector<Entry>;
+
+        static inline const uint32_t _slotBits = 6;
+        static inline const uint64_t _slotCount = uint64_t(1) << _slotBits;
+        static inline const uint64_t _slotMask = _slotCount - 1;
+        static inline const size_t _levelCount = 6;
+        // Farther deadlines are kept in the top level and rescheduled when it reaches them.
+        static inline const uint64_t _range = uint64_t(1) << (_slotBits * _levelCount);
+
+        std::array<std::array<Slot, _slotCount>, _levelCount> _levels;
+        std::array<size_t, _levelCount> _levelSizes;
+        // Holds the slot being processed; swapping keeps the capacity of the slots.
+        Slot _scratch;
+        uint64_t _now;
+        size_t _size;
+
+    public:
+        explicit TimerWheel(uint64_t now) noexcept
+            : _levels()
+            , _levelSizes()
+            , _scratch()
+            , _now(now)
+            , _size(0)
+        {
+        }
+
+        ~TimerWheel()
+        {
+        }
+
+        uint64_t now() const noexcept { return _now; }
+        size_t size() const noexcept { return _size; }
+
+        // A deadline that has already passed expires at the next tick.
+        void schedule(uint64_t deadline, TTimer timer)
+        {
+            _insert({ deadline, std::move(timer) }, _now + 1);
+            ++_size;
+        }
+
+        // Advances the wheel to now, calling expire(timer) for every timer whose deadline is reached.
+        template <typename TExpire>
+        void advance(uint64_t now, TExpire&& expire)
+        {
+            if (_size == 0)
+            {
+                _now = std::max(_now, now);
+                return;
+            }
+
+            while (_now < now)
+            {
+                // Ticks before the next move of the lowest non-empty level would find nothing and are skipped.
+                size_t emptyLevelCount = 0;
+                while (_levelSizes[emptyLevelCount] == 0)
+                {
+                    ++emptyLevelCount;
+                }
+                _now = std::min(now, _now | ((uint64_t(1) << (_slotBits * emptyLevelCount)) - 1));
+                if (_now == now)
+                {
+                    break;
+                }
+
+                ++_now;
+
+                // Moves the timers of every level whose slot boundary has just been crossed one level down.
+                for (size_t level = 1; level < _levelCount && ((_now >> (_slotBits * (level - 1))) & _slotMask) == 0; ++level)
+                {
+                    _scratch.swap(_levels[level][(_now >> (_slotBits * level)) & _slotMask]);
+                    _levelSizes[level] -= _scratch.size();
+                    for (Entry& entry : _scratch)
+                    {
+                        _insert(std::move(entry), _now);
+                    }
+                    _scratch.clear();
+                }
+
+                _scratch.swap(_levels[0][_now & _slotMask]);
+                _levelSizes[0] -= _scratch.size();
+                for (Entry& entry : _scratch)
+                {
+                    if (entry.deadline <= _now)
+                    {
+                        --_size;
+                        expire(entry.timer);
+                    }
+                    else
+                    {
+                        _insert(std::move(entry), _now + 1);
+                    }
+                }
+                _scratch.clear();
+
+                if (_size == 0)
+                {
+                    _now = now;
+                }
+            }
+        }
+
+    private:
+        // A timer in level l is at least _slotCount^l ticks away, so the wheel reaches its slot before the deadline.
+        // Timers moved down at the tick of their deadline go to the slot of the current tick, which is processed
+        // after the moves.
+        void _insert(Entry&& entry, uint64_t earliest)
+        {
+            uint64_t deadline = std::min(std::max(entry.deadline, earliest), _now + _range - 1);
+            uint64_t distance = deadline - _now;
+
+            size_t level = 0;
+            while (level + 1 < _levelCount && (distance >> (_slotBits * (level + 1))) != 0)
+            {
+                ++level;
+            }
+            _levels[level][(deadline >> (_slotBits * level)) & _slotMask].push_back(std::move(entry));
+            ++_levelSizes[level];
+        }
+    };
+
+} // namespace jbkvs::detail
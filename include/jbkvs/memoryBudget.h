@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <jbkvs/detail/mixins.h>
+#include <jbkvs/detail/spinLock.h>
+
+namespace jbkvs
+{
+
+    using MemoryBudgetPtr = std::shared_ptr<class MemoryBudget>;
+
+    class Node;
+
+    // Caps the memory consumed by the nodes charged to it: their keys and values, including string and blob
+    // payloads, and the nodes themselves with their names. A node is charged to the budget of its parent, or to the
+    // one it was created with if it is a root, so a budget given to a volume root covers the whole volume. Budgets
+    // can be nested: a budget that is the parent of the budgets of all volumes mounted into a Storage caps the
+    // whole Storage.
+    //
+    // Usage is counted in per-thread stripes that are folded into the total once they reach a fraction of the
+    // limit, so writers don't contend on a shared counter and the limit is enforced approximately. Over the limit,
+    // the Evict policy removes keys in CLOCK order, giving keys read since the hand last passed them a second
+    // chance, and the Reject policy makes the writes that would grow the usage fail.
+
+    class MemoryBudget
+        : public detail::NonCopyableMixin<MemoryBudget>
+    {
+        friend class Node;
+
+    public:
+        enum class Policy
+        {
+            Evict,
+            Reject,
+        };
+
+    private:
+        struct ClockEntry
+        {
+            std::weak_ptr<const Node> node;
+            uint32_t key;
+            // Level of the budget among the evicting budgets in the chain of the node, see Node::_clockKeys.
+            size_t level;
+        };
+
+        struct alignas(64) Stripe
+        {
+            std::atomic<int64_t> usage;
+            mutable detail::SpinLock lock;
+            // Keys inserted since they were last added to the clock by the evicting thread.
+            std::vector<ClockEntry> newKeys;
+        };
+
+        static inline const size_t _stripeCount = 16;
+        // A stripe holding this many new keys adds them to the clock without waiting for an eviction.
+        static inline const size_t _newKeysThreshold = 1024;
+
+        const size_t _limit;
+        const Policy _policy;
+        const MemoryBudgetPtr _parent;
+        const int64_t _foldThreshold;
+        std::atomic<int64_t> _foldedUsage;
+        std::array<Stripe, _stripeCount> _stripes;
+        std::atomic<bool> _evicting;
+        // Accessed by the evicting thread only.
+        std::deque<ClockEntry> _clock;
+        // Size of the clock, for readers other than the evicting thread.
+        std::atomic<size_t> _clockSize;
+
+    public:
+        static MemoryBudgetPtr create(size_t limit, Policy policy = Policy::Evict, const MemoryBudgetPtr& parent = {});
+
+        size_t getLimit() const noexcept { return _limit; }
+        Policy getPolicy() const noexcept { return _policy; }
+        const MemoryBudgetPtr& getParent() const noexcept { return _parent; }
+
+        // Sums the stripes, so it is exact when no writes are in progress.
+        size_t getUsage() const noexcept;
+
+        // Number of entries that keys of the nodes charged to the budget have in the eviction clock, including
+        // the ones not yet added to it. Zero unless the policy is Evict.
+        size_t getTrackedKeyCount() const;
+
+    private:
+        MemoryBudget(size_t limit, Policy policy, const MemoryBudgetPtr& parent);
+        ~MemoryBudget();
+
+        static size_t _getStripeIndex() noexcept;
+
+        // Returns false if a budget with the Reject policy in the chain would exceed its limit.
+        bool _canCharge(size_t bytes) const noexcept;
+        // Charges every budget in the chain and evicts from the ones that exceed their limit.
+        void _charge(int64_t bytes);
+        // Registers a key for eviction in the budgets with the Evict policy in the chain whose level bits, as given
+        // by Node::_getClockLevelBit(), are set.
+        void _track(const std::weak_ptr<const Node>& node, uint32_t key, uint64_t levelBits);
+        // Number of budgets with the Evict policy in the chain.
+        size_t _getEvictLevelCount() const noexcept;
+        // Returns true if a budget in the chain has the policy.
+        bool _hasPolicy(Policy policy) const noexcept;
+
+        void _add(int64_t bytes) noexcept;
+        void _evict();
+        // Adds the new keys of the stripes to the clock. Called by the evicting thread.
+        void _collectNewKeys();
+    };
+
+} // namespace jbkvs
@@ -1,12 +1,24 @@
 #pragma once
 
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <string_view>
 #include <memory>
 #include <vector>
 
+#include <jbkvs/detail/childrenMap.h>
 #include <jbkvs/detail/concurrentMap.h>
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/expiryReaper.h>
+#include <jbkvs/detail/keyFilter.h>
+#include <jbkvs/detail/scanIterator.h>
+#include <jbkvs/memoryBudget.h>
 #include <jbkvs/types/blob.h>
 
 namespace jbkvs
@@ -21,44 +33,144 @@ namespace jbkvs
     namespace detail
     {
 
-        class SubTreeLock
+        // Locks a node and the nodes of its subtree that StorageNodes were materialized for by the given mounts,
+        // each named by a StorageNode of its Storage and its priority. The rest of the subtree is left unlocked, as
+        // no StorageNode of the mounts refers to it: the parts that other mounts or no mount reach, and the
+        // children of nodes that a lazy mount hasn't expanded. Nodes are locked top down, each after its parent.
+        class MountedSubTreeLock
         {
-            NodePtr _node;
+            std::vector<NodePtr> _nodes;
         public:
-            explicit SubTreeLock(const NodePtr& node);
-            ~SubTreeLock();
+            using Mount = std::pair<const StorageNode*, uint64_t>;
+
+            MountedSubTreeLock(const NodePtr& node, const std::vector<Mount>& mounts);
+            ~MountedSubTreeLock();
         };
 
     } // namespace detail
 
     class Node
         : public detail::NonCopyableMixin<Node>
+        , public std::enable_shared_from_this<Node>
     {
+        friend class Storage;
         friend class StorageNode;
-        friend class detail::SubTreeLock;
+        friend class detail::MountedSubTreeLock;
+        friend class detail::ExpiryReaper;
+        friend class MemoryBudget;
 
         using TValue = std::variant<uint32_t, uint64_t, float, double, std::string, types::BlobPtr>;
 
+        struct Expirations
+        {
+            // Deadlines of the keys put with a TTL, in ExpiryReaper ticks.
+            detail::ConcurrentMap<TKey, uint64_t> deadlines;
+            // Deadline of the timer scheduled for each key. A key gets a new timer only if its deadline is earlier
+            // than the scheduled one, and a timer that finds a later deadline reschedules itself, so the timers
+            // scale with the keys rather than with the writes.
+            detail::ConcurrentMap<TKey, uint64_t> timers;
+        };
+
         struct MountPoint
         {
             StorageNode* storageNode;
             size_t depth;
-            uint32_t priority;
+            uint64_t priority;
 
-            MountPoint(StorageNode* storageNode, size_t depth, uint32_t priority) : storageNode(storageNode), depth(depth), priority(priority) {}
+            MountPoint(StorageNode* storageNode, size_t depth, uint64_t priority) : storageNode(storageNode), depth(depth), priority(priority) {}
         };
 
+        // A list, so that the StorageNodes hold iterators to their entries and unmount in constant time however many
+        // mounts the node is part of.
+        using MountPoints = std::list<MountPoint>;
+
         NodeWeakPtr _parent;
         const std::string _name;
         mutable std::shared_mutex _mutex;
-        std::vector<MountPoint> _mountPoints;
-        std::map<std::string, NodePtr, std::less<>> _children;
-        detail::ConcurrentMap<TKey, TValue> _data;
+        MountPoints _mountPoints;
+        detail::ChildrenMap<NodePtr> _children;
+        // Mutable as expired keys are reclaimed on access.
+        mutable detail::ConcurrentMap<TKey, TValue> _data;
+        // Created by the first put with a TTL, so that other nodes only pay a null check per access.
+        std::atomic<Expirations*> _expirations;
+        // Inherited from the parent; null if the node is not limited.
+        const MemoryBudgetPtr _budget;
+        // Keys that have an entry in the CLOCK of an evicting budget in the chain, mapped to _referencedBit, set if
+        // the key was read since an eviction hand last passed it, and to one bit per evicting budget whose CLOCK
+        // has an entry for the key (see _getClockLevelBit()). A key keeps its entries while it is removed and put
+        // again, so the entries scale with the keys rather than with the writes. Present only under a budget that
+        // evicts.
+        const std::unique_ptr<detail::ConcurrentMap<TKey, uint64_t>> _clockKeys;
+        // Bumped after every write of the data, so that the StorageNodes caching resolved keys can tell that the
+        // node changed.
+        mutable std::atomic<uint64_t> _generation;
+        // Lets StorageNodes skip the node when looking up keys it doesn't hold. Mutable like _data.
+        mutable detail::KeyFilter<TKey> _keyFilter;
 
     public:
+        using KeyFilterStatistics = detail::KeyFilter<TKey>::Statistics;
+
+        // Zero-copy access to a value of type T. The stored value stays valid and unchanged while the view lives:
+        // the map holding it is pinned, so views should be short-lived and released on the thread that created
+        // them. A view into a lock-based backend must not be held across a put() to the same node.
+        template <typename T>
+        class ValueView
+            : public detail::NonCopyableMixin<ValueView<T>>
+        {
+            friend class Node;
+            friend class StorageNode;
+
+            using PinnedValue = typename detail::ConcurrentMap<TKey, TValue>::PinnedValue;
+
+            PinnedValue _value;
+            // Keeps the layers of a StorageNode alive for views obtained through it.
+            std::optional<detail::EpochGuard> _epochGuard;
+
+        public:
+            ValueView()
+                : _value()
+                , _epochGuard()
+            {
+            }
+
+            ValueView(ValueView&& other)
+                : _value(std::move(other._value))
+                , _epochGuard(std::move(other._epochGuard))
+            {
+            }
+
+            ~ValueView()
+            {
+            }
+
+            explicit operator bool() const noexcept { return _value && std::holds_alternative<T>(*_value); }
+
+            const T& operator*() const noexcept { return *std::get_if<T>(&*_value); }
+            const T* operator->() const noexcept { return std::get_if<T>(&*_value); }
+
+        private:
+            explicit ValueView(PinnedValue&& value)
+                : _value(std::move(value))
+                , _epochGuard()
+            {
+            }
+        };
+
         static NodePtr create();
+        // Creates a root whose subtree is charged to the budget.
+        static NodePtr create(const MemoryBudgetPtr& budget);
         static NodePtr create(const NodePtr& parent, const std::string_view& name);
 
+        const MemoryBudgetPtr& getMemoryBudget() const noexcept { return _budget; }
+
+        // Describes the filter that lets StorageNodes skip the node for keys it doesn't hold. Takes time linear in
+        // the number of keys.
+        KeyFilterStatistics getKeyFilterStatistics() const { return _keyFilter.getStatistics(); }
+
+        // Takes time linear in the size of the subtree where it is mounted, which is locked and detached from the
+        // StorageNodes under the lock of the parent. The subtree is destroyed once its last reference is dropped,
+        // which for a mounted subtree may be the one held by layer lists reclaimed later: in the background, or on
+        // the thread dropping it if the node is charged to a budget, which is then credited at once.
         bool detach();
 
         const std::string& getName() const noexcept { return _name; }
@@ -69,25 +181,294 @@ namespace jbkvs
         template <typename T>
         std::optional<T> get(const TKey& key) const
         {
-            std::optional<TValue> value = _data.get(key);
-            if (!value)
+            std::optional<T> result;
+            if (_expireIfDue(key))
+            {
+                return result;
+            }
+
+            if (_data.visit(key, [&result](const TValue& value)
+                {
+                    const T* data = std::get_if<T>(&value);
+                    if (data)
+                    {
+                        result = *data;
+                    }
+                }))
+            {
+                _touch(key);
+            }
+            return result;
+        }
+
+        // Calls visitor with the stored alternative in place, under the read guard of the node's data. The visitor
+        // must not modify the node. Returns false if the key is absent.
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            if (_expireIfDue(key))
+            {
+                return false;
+            }
+
+            bool result = _data.visit(key, [&visitor](const TValue& value)
+            {
+                std::visit(visitor, value);
+            });
+            if (result)
+            {
+                _touch(key);
+            }
+            return result;
+        }
+
+        template <typename T>
+        bool contains(const TKey& key) const
+        {
+            bool result = false;
+            if (_expireIfDue(key))
             {
+                return result;
+            }
+
+            _data.visit(key, [&result](const TValue& value)
+            {
+                result = std::holds_alternative<T>(value);
+            });
+            return result;
+        }
+
+        template <typename T>
+        ValueView<T> view(const TKey& key) const
+        {
+            if (_expireIfDue(key))
+            {
+                return {};
+            }
+
+            ValueView<T> result(_data.pin(key));
+            if (!result)
+            {
+                // Don't keep a value of another type pinned.
                 return {};
             }
+            _touch(key);
+            return result;
+        }
 
-            T* data = std::get_if<T>(&*value);
-            return data ? std::optional<T>(std::move(*data)) : std::optional<T>();
+        // Resolves a batch of keys at once; results[i] corresponds to keys[i].
+        template <typename T>
+        void getMany(const std::vector<TKey>& keys, std::vector<std::optional<T>>& results) const
+        {
+            results.assign(keys.size(), std::optional<T>());
+            _data.visitMany(keys, [&results](size_t index, const TValue& value)
+            {
+                const T* data = std::get_if<T>(&value);
+                if (data)
+                {
+                    results[index] = *data;
+                }
+            });
+
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                if (results[i] && _expireIfDue(keys[i]))
+                {
+                    results[i].reset();
+                }
+                if (results[i])
+                {
+                    _touch(keys[i]);
+                }
+            }
         }
 
+        // Returns false if the memory budget of the node rejected the value.
         template <typename T>
-        void put(const TKey& key, T&& value)
+        bool put(const TKey& key, T&& value)
         {
-            _data.put(key, std::forward<T>(value));
+            if (!_budget && !_expirations.load(std::memory_order_acquire))
+            {
+                bool growKeyFilter = _keyFilter.add(key);
+                _data.put(key, std::forward<T>(value));
+                _bumpGeneration();
+                if (growKeyFilter)
+                {
+                    _growKeyFilter();
+                }
+
+                // A concurrent first put with a TTL may have given the key a deadline that the write above kept.
+                // The deadline is cleared then, while the key holds the value put: the argument if it wasn't moved
+                // into the map, or otherwise the value read back.
+                if (!_expirations.load(std::memory_order_acquire))
+                {
+                    return true;
+                }
+
+                std::optional<TValue> written;
+                if constexpr (std::is_lvalue_reference_v<T>)
+                {
+                    written.emplace(value);
+                }
+                else
+                {
+                    written = _data.get(key);
+                }
+                return _update(key, [&written](std::optional<TValue>& stored, std::optional<uint64_t>& deadline)
+                {
+                    if (stored == written)
+                    {
+                        deadline.reset();
+                    }
+                });
+            }
+
+            TValue newValue(std::forward<T>(value));
+            return _update(key, [&newValue](std::optional<TValue>& stored, std::optional<uint64_t>& deadline)
+            {
+                stored = newValue;
+                deadline.reset();
+            });
+        }
+
+        // Puts a value that expires after ttl. Expired keys read as absent and are removed on access, or by a
+        // background reaper within a few milliseconds; scan(), snapshot() and iteration may still show them until
+        // then. A later put() without a TTL makes the key persistent again.
+        template <typename T>
+        bool put(const TKey& key, T&& value, std::chrono::milliseconds ttl)
+        {
+            uint64_t newDeadline = detail::ExpiryReaper::now() + uint64_t(std::max<int64_t>(ttl.count(), 0));
+
+            _getExpirations();
+            TValue newValue(std::forward<T>(value));
+            return _update(key, [&newValue, newDeadline](std::optional<TValue>& stored, std::optional<uint64_t>& deadline)
+            {
+                stored = newValue;
+                deadline = newDeadline;
+            });
+        }
+
+        // Returns false if the memory budget of the node rejected some of the items.
+        template <typename T>
+        bool putMany(const std::vector<std::pair<TKey, T>>& items)
+        {
+            if (!_budget && !_expirations.load(std::memory_order_acquire))
+            {
+                bool growKeyFilter = false;
+                for (const auto& [key, value] : items)
+                {
+                    growKeyFilter |= _keyFilter.add(key);
+                }
+                _data.putMany(items);
+                _bumpGeneration();
+                if (growKeyFilter)
+                {
+                    _growKeyFilter();
+                }
+
+                // Redone below if a concurrent put with a TTL may have given the keys deadlines, as in put().
+                if (!_expirations.load(std::memory_order_acquire))
+                {
+                    return true;
+                }
+            }
+
+            bool result = true;
+            for (const auto& [key, value] : items)
+            {
+                result &= put(key, value);
+            }
+            return result;
         }
 
         bool remove(const TKey& key)
         {
-            return _data.remove(key);
+            if (!_budget && !_expirations.load(std::memory_order_acquire))
+            {
+                bool result = _data.remove(key);
+                _bumpGeneration();
+                return result;
+            }
+
+            // An expired key counts as absent.
+            bool result = false;
+            _update(key, [&result](std::optional<TValue>& value, std::optional<uint64_t>& deadline)
+            {
+                result = !!value;
+                value.reset();
+            });
+            return result;
+        }
+
+        // Atomically adds delta to the value of type T and returns the previous value; an absent key starts from
+        // zero. Returns nothing and leaves the value unchanged if the key holds another type, or if the memory
+        // budget rejected the new key.
+        template <typename T>
+        std::optional<T> fetchAdd(const TKey& key, const T& delta)
+        {
+            static_assert(std::is_arithmetic_v<T>, "fetchAdd requires an arithmetic type");
+
+            std::optional<T> result;
+            bool stored = _update(key, [&result, &delta](std::optional<TValue>& value, std::optional<uint64_t>& deadline)
+            {
+                // The updater may run more than once.
+                result.reset();
+                if (!value)
+                {
+                    result = T();
+                    value.emplace(std::in_place_type<T>, delta);
+                    return;
+                }
+
+                T* data = std::get_if<T>(&*value);
+                if (data)
+                {
+                    result = *data;
+                    *data += delta;
+                }
+            });
+            return stored ? result : std::optional<T>();
+        }
+
+        // Atomically replaces the value of type T with desired if it equals expected. Otherwise stores the current
+        // value in expected, if the key holds a T, and fails.
+        template <typename T>
+        bool compareExchange(const TKey& key, T& expected, const T& desired)
+        {
+            bool result = false;
+            _update(key, [&result, &expected, &desired](std::optional<TValue>& value, std::optional<uint64_t>& deadline)
+            {
+                result = false;
+                T* data = value ? std::get_if<T>(&*value) : nullptr;
+                if (!data)
+                {
+                    return;
+                }
+
+                if (*data == expected)
+                {
+                    *data = desired;
+                    result = true;
+                }
+                else
+                {
+                    expected = *data;
+                }
+            });
+            return result;
+        }
+
+        // Atomically replaces the stored value: updater(std::optional<TValue>&) receives the current value, or
+        // nothing if the key is absent, and the key is removed if it leaves nothing. Writers of the key wait for it,
+        // so it must be short and must not access the node; it may be called more than once. A TTL of the key is
+        // kept while the key stays present. Returns false if the memory budget of the node rejected the new value.
+        template <typename TUpdater>
+        bool update(const TKey& key, TUpdater&& updater)
+        {
+            return _update(key, [&updater](std::optional<TValue>& value, std::optional<uint64_t>& deadline)
+            {
+                updater(value);
+            });
         }
 
         class ChildrenMapWrapper
@@ -95,10 +476,10 @@ namespace jbkvs
             // TODO: think if it is better to hold NodePtr here (requires shared_from_this, decreases performance).
             // Currently the object can only be operated while someone holds a NodePtr towards target node.
             std::shared_mutex& _mutex;
-            const std::map<std::string, NodePtr, std::less<>>& _children;
+            const detail::ChildrenMap<NodePtr>& _children;
 
         public:
-            ChildrenMapWrapper(std::shared_mutex& mutex, const std::map<std::string, NodePtr, std::less<>>& children) noexcept
+            ChildrenMapWrapper(std::shared_mutex& mutex, const detail::ChildrenMap<NodePtr>& children) noexcept
                 : _mutex(mutex)
                 , _children(children)
             {
@@ -108,8 +489,8 @@ namespace jbkvs
             {
                 std::shared_lock lock(_mutex);
 
-                auto it = _children.find(name);
-                return (it != _children.end()) ? it->second : NodePtr();
+                const NodePtr* child = _children.find(name);
+                return child ? *child : NodePtr();
             }
 
             size_t size() const
@@ -119,9 +500,9 @@ namespace jbkvs
                 return _children.size();
             }
 
-            detail::SharedMutexMapConstIterator<std::string, NodePtr> begin() const
+            detail::SharedMutexMapConstIterator<std::string, NodePtr, detail::ChildrenMap<NodePtr>> begin() const
             {
-                return detail::SharedMutexMapConstIterator<std::string, NodePtr>(_mutex, _children);
+                return detail::SharedMutexMapConstIterator<std::string, NodePtr, detail::ChildrenMap<NodePtr>>(_mutex, _children);
             }
 
             detail::SharedMutexMapConstIteratorEndTag end() const
@@ -135,18 +516,326 @@ namespace jbkvs
             return ChildrenMapWrapper(_mutex, _children);
         }
 
+        class ScanWrapper
+        {
+            // Same lifetime rules as ChildrenMapWrapper: someone must hold a NodePtr towards the node.
+            using Data = detail::ConcurrentMap<TKey, TValue>;
+
+            const Data& _data;
+            const TKey _from;
+            const TKey _to;
+
+        public:
+            ScanWrapper(const Data& data, const TKey& from, const TKey& to) noexcept
+                : _data(data)
+                , _from(from)
+                , _to(to)
+            {
+            }
+
+            detail::ScanIterator<TKey, TValue, Data> begin() const
+            {
+                return detail::ScanIterator<TKey, TValue, Data>(_data, _from, _to);
+            }
+
+            detail::ScanIteratorEndTag end() const
+            {
+                return {};
+            }
+        };
+
+        // Immutable point-in-time copy of the node's data that can be kept and read from any thread while writers
+        // continue. Copying a snapshot is cheap.
+        class Snapshot
+        {
+            friend class Node;
+
+            using Data = typename detail::ConcurrentMap<TKey, TValue>::Snapshot;
+
+            Data _data;
+
+        public:
+            Snapshot() noexcept
+                : _data()
+            {
+            }
+
+            template <typename T>
+            std::optional<T> get(const TKey& key) const
+            {
+                std::optional<T> result;
+                _data.visit(key, [&result](const TValue& value)
+                {
+                    const T* data = std::get_if<T>(&value);
+                    if (data)
+                    {
+                        result = *data;
+                    }
+                });
+                return result;
+            }
+
+            template <typename TVisitor>
+            bool visit(const TKey& key, TVisitor&& visitor) const
+            {
+                return _data.visit(key, [&visitor](const TValue& value)
+                {
+                    std::visit(visitor, value);
+                });
+            }
+
+            template <typename T>
+            bool contains(const TKey& key) const
+            {
+                bool result = false;
+                _data.visit(key, [&result](const TValue& value)
+                {
+                    result = std::holds_alternative<T>(value);
+                });
+                return result;
+            }
+
+            size_t size() const noexcept
+            {
+                return _data.size();
+            }
+
+            detail::PersistentMapConstIterator<TKey, TValue, std::hash<TKey>> begin() const
+            {
+                return _data.begin();
+            }
+
+            detail::PersistentMapConstIteratorEndTag end() const
+            {
+                return {};
+            }
+
+        private:
+            explicit Snapshot(Data&& data) noexcept
+                : _data(std::move(data))
+            {
+            }
+        };
+
+        // Takes constant time with the persistent ConcurrentMap backend and copies the data with the others.
+        Snapshot snapshot() const
+        {
+            return Snapshot(_data.snapshot());
+        }
+
+        // Iterates over the items with keys in [from, to] in key order, without blocking writers while the
+        // caller processes them. See detail::ScanIterator for the consistency guarantees.
+        ScanWrapper scan(const TKey& from, const TKey& to) const noexcept
+        {
+            return ScanWrapper(_data, from, to);
+        }
+
     private:
-        Node(const NodePtr& parent, const std::string_view& name);
+        Node(const NodePtr& parent, const std::string_view& name, const MemoryBudgetPtr& budget);
         ~Node();
 
-        void _lockSubTree();
-        void _unlockSubTree();
+        static NodePtr _create(const NodePtr& parent, const std::string_view& name, const MemoryBudgetPtr& budget);
 
         bool _attachChild(const std::string& name, const NodePtr& child);
         bool _detachChild(const std::string& name);
 
-        void _onMounting(StorageNode* storageNode, size_t depth, uint32_t priority);
-        void _onUnmounted(StorageNode* storageNode, size_t depth);
+        // Returns the handle that the StorageNode passes to _onUnmounted().
+        MountPoints::iterator _onMounting(StorageNode* storageNode, size_t depth, uint64_t priority);
+        void _onUnmounted(const MountPoints::iterator& mountPoint);
+        // Returns true if the mount with the priority in the Storage of storageNode has a StorageNode for the node.
+        bool _isMountedBy(const StorageNode* storageNode, uint64_t priority) const noexcept;
+        // Returns true if the mount also has StorageNodes for the children of the node. Locks the StorageNode of the
+        // node.
+        bool _isExpandedBy(const StorageNode* storageNode, uint64_t priority) const;
+
+        Expirations& _getExpirations();
+
+        // Returns true, and reclaims the key, if it was put with a TTL that has passed.
+        bool _expireIfDue(const TKey& key) const
+        {
+            const Expirations* expirations = _expirations.load(std::memory_order_acquire);
+            return expirations && _expireIfDue(*expirations, key);
+        }
+
+        bool _expireIfDue(const Expirations& expirations, const TKey& key) const;
+
+        // Removes the key if its TTL has passed. firedTimer is the deadline of the timer that fired, if any.
+        void _expire(const TKey& key, std::optional<uint64_t> firedTimer = std::nullopt) const;
+
+        void _bumpGeneration() const noexcept
+        {
+            _generation.fetch_add(1, std::memory_order_release);
+        }
+
+        // Called outside of the data map, as its size may take the lock that writers hold.
+        void _growKeyFilter() const;
+
+        static inline const uint64_t _referencedBit = 1;
+
+        // Bit of _clockKeys for the evicting budget at the level, counting the evicting budgets in the chain from
+        // the one of the node. Levels past the last bit share it.
+        static uint64_t _getClockLevelBit(size_t level) noexcept
+        {
+            return _referencedBit << std::min<size_t>(level + 1, 63);
+        }
+
+        // Marks a key that was read, so that eviction gives it a second chance.
+        void _touch(const TKey& key) const
+        {
+            std::optional<uint64_t> state = _clockKeys ? _clockKeys->get(key) : std::nullopt;
+            if (state && !(*state & _referencedBit))
+            {
+                _clockKeys->update(key, [](std::optional<uint64_t>& state)
+                {
+                    if (state)
+                    {
+                        *state |= _referencedBit;
+                    }
+                });
+            }
+        }
+
+        // Gives a newly inserted key an entry in the CLOCK of every evicting budget in the chain, unless it still
+        // has one there from before it was removed.
+        void _trackKey(const TKey& key) const;
+        // Drops the entry of the key in the CLOCK of the evicting budget at the level if the key is absent. Returns
+        // true if the entry was kept.
+        bool _untrackKeyIfAbsent(const TKey& key, size_t level) const;
+        // Removes the key unless it was read since an eviction hand last passed it. Returns true if the key and its
+        // entry in the CLOCK at the level were kept.
+        bool _evict(const TKey& key, size_t level) const;
+
+        static size_t _getItemUsage(const TValue& value) noexcept;
+        static size_t _getNodeUsage(const std::string_view& name) noexcept;
+
+        // Applies updater(std::optional<TValue>& value, std::optional<uint64_t>& deadline) to the key, where the
+        // deadline is the one of its TTL. Expired keys are seen as absent, and the change is charged to the memory
+        // budget. Returns false if the budget rejected the change, which is then undone. firedTimer is the deadline
+        // of the reaper timer that triggered the call, if any.
+        template <typename TUpdater>
+        bool _update(const TKey& key, TUpdater&& updater, std::optional<uint64_t> firedTimer = std::nullopt) const
+        {
+            // Keys are added to the filter before the map publishes them.
+            bool growKeyFilter = false;
+
+            Expirations* expirations = _expirations.load(std::memory_order_acquire);
+            if (!_budget && !expirations)
+            {
+                _data.update(key, [this, &key, &updater, &growKeyFilter](std::optional<TValue>& value)
+                {
+                    std::optional<uint64_t> deadline;
+                    updater(value, deadline);
+                    if (value)
+                    {
+                        growKeyFilter = _keyFilter.add(key);
+                    }
+                });
+                _bumpGeneration();
+                if (growKeyFilter)
+                {
+                    _growKeyFilter();
+                }
+                return true;
+            }
+
+            uint64_t now = expirations ? detail::ExpiryReaper::now() : 0;
+            bool rejectable = _budget && _budget->_hasPolicy(MemoryBudget::Policy::Reject);
+            int64_t usageDelta = 0;
+            bool inserted = false;
+            bool removed = false;
+            bool rejected = false;
+            // Kept across the calls of the map updater, so that a retry recognizes the timer it recorded.
+            std::optional<uint64_t> newTimer;
+            _data.update(key, [&](std::optional<TValue>& value)
+            {
+                std::optional<uint64_t> oldDeadline = expirations ? expirations->deadlines.get(key) : std::nullopt;
+                size_t oldUsage = value ? _getItemUsage(*value) : 0;
+                bool existed = value.has_value();
+
+                if (oldDeadline && *oldDeadline <= now)
+                {
+                    value.reset();
+                }
+                std::optional<uint64_t> deadline = value ? oldDeadline : std::nullopt;
+
+                std::optional<TValue> original;
+                if (rejectable)
+                {
+                    original = value;
+                }
+
+                updater(value, deadline);
+
+                size_t newUsage = value ? _getItemUsage(*value) : 0;
+                rejected = rejectable && newUsage > oldUsage && !_budget->_canCharge(newUsage - oldUsage);
+                if (rejected)
+                {
+                    value = std::move(original);
+                    deadline = value ? oldDeadline : std::nullopt;
+                    newUsage = value ? _getItemUsage(*value) : 0;
+                }
+
+                if (!value)
+                {
+                    deadline.reset();
+                }
+                if (deadline != oldDeadline)
+                {
+                    if (deadline)
+                    {
+                        expirations->deadlines.put(key, *deadline);
+                    }
+                    else
+                    {
+                        expirations->deadlines.remove(key);
+                    }
+                }
+
+                if (expirations)
+                {
+                    std::optional<uint64_t> timer = expirations->timers.get(key);
+                    if (timer && (timer == firedTimer || timer == newTimer))
+                    {
+                        expirations->timers.remove(key);
+                        timer.reset();
+                    }
+                    newTimer.reset();
+                    if (deadline && (!timer || *deadline < *timer))
+                    {
+                        expirations->timers.put(key, *deadline);
+                        newTimer = deadline;
+                    }
+                }
+
+                usageDelta = int64_t(newUsage) - int64_t(oldUsage);
+                inserted = !existed && value;
+                removed = existed && !value;
+                if (inserted)
+                {
+                    growKeyFilter = _keyFilter.add(key);
+                }
+            });
+            _bumpGeneration();
+            if (growKeyFilter)
+            {
+                _growKeyFilter();
+            }
+
+            if (newTimer)
+            {
+                detail::ExpiryReaper::schedule(weak_from_this(), key, *newTimer);
+            }
+
+            if (_budget)
+            {
+                if (inserted && _clockKeys)
+                {
+                    _trackKey(key);
+                }
+                _budget->_charge(usageDelta);
+            }
+            return !rejected;
+        }
     };
 
 } // namespace jbkvs
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/storageNode.h>
+
+namespace jbkvs
+{
+
+    typedef std::shared_ptr<class PathHandle> PathHandlePtr;
+
+    // A path of a Storage resolved once, obtained with Storage::resolve(). Operations go straight to the
+    // StorageNode the path resolves to, without parsing the path or walking the tree. The handle remembers the
+    // generation of the tree it was bound in, and rebinds on first use after a mount, unmount, attach or detach
+    // has changed what the path may resolve to. Until the path resolves, operations behave as on an empty node.
+    // Handles may be shared between threads and may outlive the Storage, after which the path never resolves.
+
+    class PathHandle
+        : public detail::NonCopyableMixin<PathHandle>
+    {
+        friend class Storage;
+
+        struct Binding
+        {
+            StorageNodePtr node;
+            // Removal generation if the path resolved, addition generation otherwise.
+            uint64_t generation;
+
+            Binding(const StorageNodePtr& node, uint64_t generation) : node(node), generation(generation) {}
+        };
+
+        const StorageNodePtr _root;
+        const std::string _path;
+        // Immutable binding replaced by rebinding readers and read under an EpochGuard.
+        mutable std::atomic<const Binding*> _binding;
+
+    public:
+        const std::string& getPath() const noexcept { return _path; }
+
+        // Returns the StorageNode the path currently resolves to, or null.
+        StorageNodePtr getNode() const;
+
+        template <typename T>
+        std::optional<T> get(const TKey& key) const
+        {
+            return _apply([&key](StorageNode& node) { return node.get<T>(key); });
+        }
+
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            return _apply([&key, &visitor](StorageNode& node) { return node.visit(key, std::forward<TVisitor>(visitor)); });
+        }
+
+        template <typename T>
+        bool contains(const TKey& key) const
+        {
+            return _apply([&key](StorageNode& node) { return node.contains<T>(key); });
+        }
+
+        template <typename T>
+        void getMany(const std::vector<TKey>& keys, std::vector<std::optional<T>>& results) const
+        {
+            results.assign(keys.size(), std::optional<T>());
+            _apply([&keys, &results](StorageNode& node) { node.getMany<T>(keys, results); return true; });
+        }
+
+        template <typename T>
+        Node::ValueView<T> view(const TKey& key) const
+        {
+            return _apply([&key](StorageNode& node) { return node.view<T>(key); });
+        }
+
+        template <typename T>
+        std::optional<T> fetchAdd(const TKey& key, const T& delta) const
+        {
+            return _apply([&key, &delta](StorageNode& node) { return node.fetchAdd<T>(key, delta); });
+        }
+
+        template <typename T>
+        bool compareExchange(const TKey& key, T& expected, const T& desired) const
+        {
+            return _apply([&key, &expected, &desired](StorageNode& node) { return node.compareExchange<T>(key, expected, desired); });
+        }
+
+        template <typename TUpdater>
+        bool update(const TKey& key, TUpdater&& updater) const
+        {
+            return _apply([&key, &updater](StorageNode& node) { return node.update(key, std::forward<TUpdater>(updater)); });
+        }
+
+    private:
+        static PathHandlePtr _create(const StorageNodePtr& root, const std::string_view& path);
+
+        PathHandle(const StorageNodePtr& root, const std::string_view& path);
+        ~PathHandle();
+
+        // Calls function(StorageNode&) on the node the path resolves to, or returns a default result if it doesn't
+        // resolve.
+        template <typename TFunction>
+        auto _apply(TFunction&& function) const -> decltype(function(std::declval<StorageNode&>()))
+        {
+            detail::EpochGuard guard;
+
+            const Binding* binding = _getBinding();
+            if (!binding->node)
+            {
+                return {};
+            }
+            return function(*binding->node);
+        }
+
+        // Returns the current binding, rebinding it first if the tree changed. Must be called under an EpochGuard,
+        // which keeps the binding alive.
+        const Binding* _getBinding() const
+        {
+            const Binding* binding = _binding.load(std::memory_order_acquire);
+            return _isCurrent(*binding) ? binding : _rebind(binding);
+        }
+
+        bool _isCurrent(const Binding& binding) const noexcept
+        {
+            const StorageNode::Context& context = *_root->_context;
+            const std::atomic<uint64_t>& generation = binding.node ? context.removalGeneration : context.additionGeneration;
+            return generation.load(std::memory_order_acquire) == binding.generation;
+        }
+
+        const Binding* _rebind(const Binding* binding) const;
+    };
+
+} // namespace jbkvs
@@ -1,7 +1,15 @@
 #pragma once
 
+#include <functional>
 #include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include <jbkvs/detail/pathCache.h>
+#include <jbkvs/pathHandle.h>
 #include <jbkvs/storageNode.h>
 
 namespace jbkvs
@@ -11,33 +19,85 @@ namespace jbkvs
         : detail::NonCopyableMixin<Storage>
     {
     public:
+        enum class MountMode
+        {
+            // Creates the StorageNodes of the whole mounted tree up front.
+            Eager,
+            // Creates the StorageNode of the mount path only; the others are created when paths are first resolved
+            // through them, so mounting takes time linear in the depth of the path rather than the size of the tree.
+            Lazy,
+        };
+
+        enum class Propagation
+        {
+            // Nodes attached to mounted nodes are visible through the Storage once attached.
+            Synchronous,
+            // Nodes attached to mounted nodes are mounted by a thread of the Storage in batches, so that attaching a
+            // node to a node mounted by many Storages doesn't wait for all of them. See sync().
+            Asynchronous,
+        };
+
         struct MountPoint
         {
             std::string path;
             NodePtr node;
+            // Later mounts have higher priorities and take precedence.
+            uint64_t priority;
 
-            MountPoint(const std::string_view& path, const NodePtr& node) : path(path), node(node) {}
+            MountPoint(const std::string_view& path, const NodePtr& node, uint64_t priority) : path(path), node(node), priority(priority) {}
         };
 
     private:
+        using MountPoints = std::list<MountPoint>;
+        using MountKey = std::pair<std::string, const Node*>;
+
+        struct MountKeyHash
+        {
+            size_t operator()(const MountKey& key) const noexcept
+            {
+                return std::hash<std::string>()(key.first) ^ std::hash<const Node*>()(key.second) * 0x9E3779B97F4A7C15ull;
+            }
+        };
+
+        static inline const size_t _pathCacheCapacity = 1024;
+
         mutable std::shared_mutex _mutex;
-        uint32_t _mountPriorityCounter;
-        std::list<MountPoint> _mountPoints;
+        uint64_t _mountPriorityCounter;
+        // In mount order.
+        MountPoints _mountPoints;
+        // Mounts of every node at every path, in mount order, so that unmounting doesn't search _mountPoints.
+        std::unordered_map<MountKey, std::vector<MountPoints::iterator>, MountKeyHash> _mountIndex;
+        // Null for synchronous propagation. Declared before _root, whose StorageNodes refer to it.
+        std::unique_ptr<StorageNode::ChangeQueue> _changeQueue;
         StorageNodePtr _root;
+        // Paths recently resolved by getNode(), valid until a StorageNode is removed from the tree.
+        mutable detail::PathCache<StorageNodePtr> _pathCache;
 
     public:
         Storage();
+        // Every StorageNode caches the layers resolving up to resolveCacheCapacity recently read keys, so that reads
+        // through deep stacks of mounted nodes don't visit every layer.
+        explicit Storage(size_t resolveCacheCapacity, Propagation propagation = Propagation::Synchronous);
         ~Storage();
 
-        bool mount(const std::string_view& path, const NodePtr& node);
+        bool mount(const std::string_view& path, const NodePtr& node, MountMode mode = MountMode::Eager);
+        // Takes time linear in the number of StorageNodes that the mount materialized, which are walked and
+        // detached under the lock of the Storage; only the Nodes it releases are destroyed in the background.
         bool unmount(const std::string_view& path, const NodePtr& node);
 
         StorageNodePtr getNode(const std::string_view& path) const;
+        // Resolves a path once for repeated access; the path need not resolve yet. Returns null for invalid paths.
+        PathHandlePtr resolve(const std::string_view& path) const;
         std::vector<MountPoint> getMountPoints() const;
 
+        // Waits until the nodes attached to mounted nodes before the call are visible through the Storage.
+        void sync() const;
+
     private:
-        void _mount(const std::string_view& path, const NodePtr& node, uint32_t priority);
-        void _unmount(const decltype(_mountPoints)::reverse_iterator& it);
+        void _mount(const std::string_view& path, const NodePtr& node, uint64_t priority, MountMode mode);
+        // Takes the iterator by value, as it may refer to an entry of _mountIndex, which it removes. Returns the
+        // unmounted node, for the caller to release once it unlocks.
+        NodePtr _unmount(MountPoints::iterator it);
     };
 
 } // namespace jbkvs
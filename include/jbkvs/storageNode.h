@@ -1,7 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <string>
 #include <vector>
 
+#include <jbkvs/detail/batchQueue.h>
+#include <jbkvs/detail/childrenMap.h>
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/mergeIterator.h>
+#include <jbkvs/detail/resolveCache.h>
 #include <jbkvs/node.h>
 
 namespace jbkvs
@@ -11,9 +20,11 @@ namespace jbkvs
 
     class StorageNode
         : public detail::NonCopyableMixin<StorageNode>
+        , public std::enable_shared_from_this<StorageNode>
     {
         friend class Storage;
         friend class Node;
+        friend class PathHandle;
 
         static inline const char _pathSeparator = '/';
 
@@ -21,53 +32,447 @@ namespace jbkvs
         {
             NodePtr node;
             size_t depth;
-            uint32_t priority;
+            uint64_t priority;
+            // Entry of the node's mount list for this layer.
+            Node::MountPoints::iterator mountPoint;
 
-            MountedNode(const NodePtr& node, size_t depth, uint32_t priority) : node(node), depth(depth), priority(priority) {}
+            MountedNode(const NodePtr& node, size_t depth, uint64_t priority, const Node::MountPoints::iterator& mountPoint)
+                : node(node), depth(depth), priority(priority), mountPoint(mountPoint) {}
         };
 
-        // TODO: try lock-free approach.
+        struct MountedNodes : std::vector<MountedNode>
+        {
+            // Incremented by every publication, so that resolve cache entries apply to one list only.
+            uint64_t generation = 0;
+        };
+
+        using ResolveCache = detail::ResolveCache<TKey>;
+
+        // Child attached to the node of a layer, queued for the StorageNode of the layer when structure changes are
+        // propagated asynchronously.
+        struct Attachment
+        {
+            StorageNodePtr storageNode;
+            size_t depth;
+            uint64_t priority;
+            NodePtr parent;
+            std::string childName;
+            NodePtr child;
+        };
+
+        using ChangeQueue = detail::BatchQueue<Attachment>;
+
+        // Shared by the StorageNodes of one Storage.
+        struct Context
+        {
+            // Zero disables the resolve cache.
+            const size_t resolveCacheCapacity;
+            // Bumped whenever a StorageNode is removed from its parent, which is the only change that makes a path
+            // stop resolving to a StorageNode, and whenever a lazy mount adds a layer above children that were
+            // resolved without it.
+            std::atomic<uint64_t> removalGeneration;
+            // Bumped whenever a StorageNode is added to its parent, which makes a path that didn't resolve resolve.
+            std::atomic<uint64_t> additionGeneration;
+            // Owned by the Storage, which outlives its mounts; null if structure changes are propagated synchronously.
+            ChangeQueue* const changeQueue;
+
+            Context(size_t resolveCacheCapacity, ChangeQueue* changeQueue)
+                : resolveCacheCapacity(resolveCacheCapacity), removalGeneration(0), additionGeneration(0), changeQueue(changeQueue) {}
+        };
+
+        using ContextPtr = std::shared_ptr<Context>;
+
+        // Selects the layers that resolve a key: those holding the alternative of Node::TValue with this index, or
+        // any value.
+        static inline const uint32_t _anyAlternative = uint32_t(std::variant_size_v<Node::TValue>);
+
+        // Guards the structure; data reads don't take it.
         mutable std::shared_mutex _mutex;
 
         size_t _virtualMountCounter;
-        std::vector<MountedNode> _mountedNodes;
-        std::map<std::string, StorageNodePtr, std::less<>> _children;
+        // Immutable list published by writers holding _mutex and read under an EpochGuard.
+        std::atomic<const MountedNodes*> _mountedNodes;
+        // Mutable, as children are materialized when first looked up.
+        mutable detail::ChildrenMap<StorageNodePtr> _children;
+        // Layers mounted lazily whose children don't have StorageNodes yet.
+        mutable std::vector<MountedNode> _pendingLayers;
+        const ContextPtr _context;
+        // Winning layers of recently read keys, validated against the generations of the layers above them.
+        const std::unique_ptr<ResolveCache> _resolveCache;
 
     public:
         template <typename T>
         std::optional<T> get(const TKey& key) const
         {
-            std::shared_lock lock(_mutex);
-
             std::optional<T> result;
-            for (size_t i = _mountedNodes.size() - 1; ~i; --i)
+            _visitLayers(key, _getAlternative<T>(), [&result](const Node::TValue& value)
+            {
+                result = *std::get_if<T>(&value);
+            });
+            return result;
+        }
+
+        // Calls visitor with the alternative stored in the highest priority layer that has the key. Returns false
+        // if no layer has it.
+        template <typename TVisitor>
+        bool visit(const TKey& key, TVisitor&& visitor) const
+        {
+            return _visitLayers(key, _anyAlternative, [&visitor](const Node::TValue& value)
+            {
+                std::visit(visitor, value);
+            });
+        }
+
+        template <typename T>
+        bool contains(const TKey& key) const
+        {
+            return _visitLayers(key, _getAlternative<T>(), [](const Node::TValue& value) {});
+        }
+
+        // Resolves a batch of keys at once; results[i] corresponds to keys[i]. Each layer is visited once, with the
+        // keys that no higher layer resolved and that its key filter may hold, so the resolve cache is not consulted.
+        template <typename T>
+        void getMany(const std::vector<TKey>& keys, std::vector<std::optional<T>>& results) const
+        {
+            detail::EpochGuard guard;
+
+            const MountedNodes& mountedNodes = *_mountedNodes.load(std::memory_order_acquire);
+
+            results.assign(keys.size(), std::optional<T>());
+
+            std::vector<TKey> pendingKeys(keys);
+            std::vector<size_t> pendingIndices(keys.size());
+            std::iota(pendingIndices.begin(), pendingIndices.end(), size_t(0));
+
+            std::vector<TKey> layerKeys;
+            std::vector<size_t> layerIndices;
+
+            for (size_t i = mountedNodes.size() - 1; ~i && !pendingKeys.empty(); --i)
             {
-                result = _mountedNodes[i].node->get<T>(key);
-                if (result)
+                const Node& node = *mountedNodes[i].node;
+
+                layerKeys.clear();
+                layerIndices.clear();
+                for (size_t j = 0; j < pendingKeys.size(); ++j)
                 {
-                    return result;
+                    if (node._keyFilter.mayContain(pendingKeys[j]))
+                    {
+                        layerKeys.push_back(pendingKeys[j]);
+                        layerIndices.push_back(pendingIndices[j]);
+                    }
                 }
+
+                node._data.visitMany(layerKeys, [&results, &layerIndices](size_t index, const Node::TValue& value)
+                {
+                    const T* data = std::get_if<T>(&value);
+                    if (data)
+                    {
+                        results[layerIndices[index]] = *data;
+                    }
+                });
+
+                size_t pendingCount = 0;
+                for (size_t j = 0; j < pendingKeys.size(); ++j)
+                {
+                    std::optional<T>& result = results[pendingIndices[j]];
+                    if (result && node._expireIfDue(pendingKeys[j]))
+                    {
+                        result.reset();
+                    }
+                    if (result)
+                    {
+                        node._touch(pendingKeys[j]);
+                    }
+
+                    if (!result)
+                    {
+                        pendingKeys[pendingCount] = pendingKeys[j];
+                        pendingIndices[pendingCount] = pendingIndices[j];
+                        ++pendingCount;
+                    }
+                }
+                pendingKeys.resize(pendingCount);
+                pendingIndices.resize(pendingCount);
+            }
+        }
+
+        template <typename T>
+        Node::ValueView<T> view(const TKey& key) const
+        {
+            detail::EpochGuard guard;
+
+            Node* node = _findLayer(key, _getAlternative<T>());
+            if (!node)
+            {
+                return {};
+            }
+
+            Node::ValueView<T> result = node->view<T>(key);
+            if (result)
+            {
+                // The layer list, and so the node, must outlive the view.
+                result._epochGuard.emplace(std::move(guard));
             }
             return result;
         }
 
+        // Adds delta in the layer that get<T>() reads from. Returns nothing, without writing, if no layer holds a T.
+        template <typename T>
+        std::optional<T> fetchAdd(const TKey& key, const T& delta)
+        {
+            detail::EpochGuard guard;
+
+            Node* node = _findLayer(key, _getAlternative<T>());
+            return node ? node->fetchAdd<T>(key, delta) : std::optional<T>();
+        }
+
+        // Exchanges in the layer that get<T>() reads from. Fails if no layer holds a T.
+        template <typename T>
+        bool compareExchange(const TKey& key, T& expected, const T& desired)
+        {
+            detail::EpochGuard guard;
+
+            Node* node = _findLayer(key, _getAlternative<T>());
+            return node && node->compareExchange<T>(key, expected, desired);
+        }
+
+        // Updates in the highest priority layer that has the key. Returns false if no layer has it, or if the memory
+        // budget of the layer rejected the new value.
+        template <typename TUpdater>
+        bool update(const TKey& key, TUpdater&& updater)
+        {
+            detail::EpochGuard guard;
+
+            Node* node = _findLayer(key, _anyAlternative);
+            return node && node->update(key, std::forward<TUpdater>(updater));
+        }
+
+        class ScanWrapper
+        {
+            using Data = detail::ConcurrentMap<TKey, Node::TValue>;
+            using LayerIterator = detail::ScanIterator<TKey, Node::TValue, Data>;
+
+            // Layers mounted when the scan started, lowest priority first, kept alive while the caller holds the
+            // wrapper.
+            const std::vector<NodePtr> _layers;
+            const TKey _from;
+            const TKey _to;
+
+        public:
+            ScanWrapper(std::vector<NodePtr>&& layers, const TKey& from, const TKey& to) noexcept
+                : _layers(std::move(layers))
+                , _from(from)
+                , _to(to)
+            {
+            }
+
+            detail::MergeIterator<TKey, Node::TValue, LayerIterator> begin() const
+            {
+                std::vector<std::unique_ptr<LayerIterator>> iterators;
+                iterators.reserve(_layers.size());
+                for (const NodePtr& layer : _layers)
+                {
+                    iterators.push_back(std::make_unique<LayerIterator>(layer->_data, _from, _to));
+                }
+                return detail::MergeIterator<TKey, Node::TValue, LayerIterator>(std::move(iterators));
+            }
+
+            detail::ScanIteratorEndTag end() const
+            {
+                return {};
+            }
+        };
+
+        // Iterates over the keys in [from, to] in key order with the value of the highest priority layer that holds
+        // each, as visit() resolves them. Every layer is scanned as Node::scan() does and the layers are merged as
+        // they stream, so neither values nor whole maps are copied up front. Layers mounted or unmounted after the
+        // call are not reflected.
+        ScanWrapper scan(const TKey& from, const TKey& to) const
+        {
+            detail::EpochGuard guard;
+
+            const MountedNodes& mountedNodes = *_mountedNodes.load(std::memory_order_acquire);
+
+            std::vector<NodePtr> layers;
+            layers.reserve(mountedNodes.size());
+            for (const MountedNode& mountedNode : mountedNodes)
+            {
+                layers.push_back(mountedNode.node);
+            }
+            return ScanWrapper(std::move(layers), from, to);
+        }
+
+        // Materializes the children of the layers mounted lazily first.
         StorageNodePtr getChild(const std::string_view& name) const;
 
     private:
-        static StorageNodePtr _create();
+        static StorageNodePtr _create(const ContextPtr& context);
 
-        StorageNode();
+        explicit StorageNode(const ContextPtr& context);
         ~StorageNode();
 
-        void _mountVirtual(const std::string_view& path, const NodePtr& node, uint32_t priority);
-        bool _unmountVirtual(const std::string_view& path, const NodePtr& node);
-        void _mount(const NodePtr& node, size_t depth, uint32_t priority);
-        bool _unmount(const NodePtr& node, size_t depth);
+        // Mounts the node lazily at the path and returns the StorageNode it was mounted in.
+        StorageNode* _mountVirtual(const std::string_view& path, const NodePtr& node, uint64_t priority);
+        bool _unmountVirtual(const std::string_view& path, const NodePtr& node, uint64_t priority);
+        // A lazy mount only adds the layer, leaving its children to _expand().
+        void _mount(const NodePtr& node, size_t depth, uint64_t priority, bool lazy);
+        bool _unmount(const NodePtr& node, size_t depth, uint64_t priority);
+
+        // Mounts the child, or queues it for the worker of the change queue, which the parent must be locked for.
+        void _attachMountedNodeChild(size_t depth, uint64_t priority, Node& parent, const std::string& childName, const NodePtr& childNode);
+        void _detachMountedNodeChild(size_t depth, uint64_t priority, const std::string& childName, const NodePtr& childNode);
+        // Applies a batch of queued attachments, locking each parent node once for all of its children in the batch.
+        // Attachments of children detached meanwhile, or of layers unmounted or expanded meanwhile, are dropped.
+        static void _applyAttachments(std::vector<Attachment>& attachments);
+        // Returns the child holding the layer of the mount with the priority, or null if the layer wasn't mounted yet
+        // because its attachment is still queued.
+        const StorageNodePtr* _findChildLayer(const std::string_view& childName, uint64_t priority) const noexcept;
+
+        // Mounts the children of the pending layers lazily in the children of this node.
+        void _expand() const;
+        void _expandLayer(const MountedNode& layer) const;
+        // Expands the layers of the mount with the priority in this node and its descendants, locking the nodes
+        // of one layer at a time.
+        void _materialize(uint64_t priority) const;
+        bool _isPending(size_t depth, uint64_t priority) const noexcept;
+        // Like !_isPending(), but locks the node.
+        bool _isExpanded(size_t depth, uint64_t priority) const;
+
+        template <typename T, size_t index = 0>
+        static constexpr uint32_t _getAlternative() noexcept
+        {
+            if constexpr (std::is_same_v<T, std::variant_alternative_t<index, Node::TValue>>)
+            {
+                return uint32_t(index);
+            }
+            else
+            {
+                return _getAlternative<T, index + 1>();
+            }
+        }
+
+        // Calls visitor(value) in place on the value of the key in the highest priority layer that the alternative
+        // selects. Returns false if no layer has such a value.
+        template <typename TVisitor>
+        bool _visitLayers(const TKey& key, uint32_t alternative, TVisitor&& visitor) const
+        {
+            detail::EpochGuard guard;
+
+            Node* node = _resolve(key, alternative, visitor);
+            if (node)
+            {
+                node->_touch(key);
+            }
+            return !!node;
+        }
+
+        // Returns the highest priority layer whose value for the key the alternative selects, or null. Must be called
+        // under an EpochGuard, which keeps the layer alive.
+        Node* _findLayer(const TKey& key, uint32_t alternative) const
+        {
+            return _resolve(key, alternative, [](const Node::TValue& value) {});
+        }
+
+        // Resolves the key to a layer as _findLayer() does, calling visitor(value) on the value it holds. With the
+        // resolve cache, a cached layer is read directly once the generations of the layers above it show that none
+        // of them was written since it was resolved; if the key left the layer, it is resolved again.
+        template <typename TVisitor>
+        Node* _resolve(const TKey& key, uint32_t alternative, TVisitor&& visitor) const
+        {
+            const MountedNodes& mountedNodes = *_mountedNodes.load(std::memory_order_acquire);
+
+            // A single layer is resolved by one lookup anyway.
+            bool cached = _resolveCache && mountedNodes.size() > 1;
+            if (cached)
+            {
+                typename ResolveCache::Entry entry;
+                if (_resolveCache->find(key, alternative, mountedNodes.generation, entry) && entry.stamp == _getStamp(mountedNodes, entry.layer))
+                {
+                    if (entry.layer == ResolveCache::noLayer)
+                    {
+                        return nullptr;
+                    }
+
+                    Node* node = mountedNodes[entry.layer].node.get();
+                    if (_visitLayer(*node, key, alternative, visitor))
+                    {
+                        return node;
+                    }
+                }
+            }
+
+            uint64_t stamp = 0;
+            for (size_t i = mountedNodes.size() - 1; ~i; --i)
+            {
+                Node* node = mountedNodes[i].node.get();
+                // Loaded before the layer is read, so that a write the read misses changes the stamp.
+                uint64_t generation = node->_generation.load(std::memory_order_acquire);
 
-        void _attachMountedNodeChild(size_t depth, uint32_t priority, const std::string& childName, const NodePtr& childNode);
-        void _detachMountedNodeChild(size_t depth, const std::string& childName, const NodePtr& childNode);
+                if (_visitLayer(*node, key, alternative, visitor))
+                {
+                    if (cached)
+                    {
+                        _resolveCache->store(key, alternative, { uint32_t(i), mountedNodes.generation, stamp });
+                    }
+                    return node;
+                }
+                stamp += generation;
+            }
+
+            if (cached)
+            {
+                _resolveCache->store(key, alternative, { ResolveCache::noLayer, mountedNodes.generation, stamp });
+            }
+            return nullptr;
+        }
+
+        template <typename TVisitor>
+        static bool _visitLayer(const Node& node, const TKey& key, uint32_t alternative, TVisitor& visitor)
+        {
+            if (!node._keyFilter.mayContain(key) || node._expireIfDue(key))
+            {
+                return false;
+            }
+
+            bool found = false;
+            bool present = node._data.visit(key, [alternative, &visitor, &found](const Node::TValue& value)
+            {
+                found = alternative == _anyAlternative || value.index() == alternative;
+                if (found)
+                {
+                    visitor(value);
+                }
+            });
+            if (!present)
+            {
+                node._keyFilter.reportFalsePositive();
+            }
+            return found;
+        }
+
+        // Sums the generations of the layers above the layer, or of all layers for ResolveCache::noLayer. As the
+        // generations only grow, the sum changes whenever one of the layers is written.
+        static uint64_t _getStamp(const MountedNodes& mountedNodes, uint32_t layer) noexcept
+        {
+            uint64_t stamp = 0;
+            for (size_t i = (layer == ResolveCache::noLayer) ? 0 : size_t(layer) + 1; i < mountedNodes.size(); ++i)
+            {
+                stamp += mountedNodes[i].node->_generation.load(std::memory_order_acquire);
+            }
+            return stamp;
+        }
+
+        // Returns the layer of the mount with the priority, or where to insert it.
+        static MountedNodes::iterator _findMountedNode(MountedNodes& mountedNodes, uint64_t priority) noexcept;
+        const MountedNodes& _getMountedNodes() const noexcept;
+        void _publishMountedNodes(MountedNodes&& mountedNodes);
 
         bool _isReadyForDetach() const noexcept;
+        const StorageNodePtr& _getOrCreateChild(const std::string_view& name) const;
+        void _eraseChild(const std::string_view& name);
+
+        // Walks a path starting with a separator down from the root. Returns null if it doesn't resolve.
+        static StorageNodePtr _resolvePath(const StorageNodePtr& root, const std::string_view& path);
     };
 
 } // namespace jbkvs
@@ -0,0 +1,165 @@
+#include <jbkvs/detail/epoch.h>
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+namespace jbkvs::detail
+{
+
+    namespace
+    {
+
+        const size_t _collectThreshold = 64;
+
+    } // namespace
+
+    struct Epoch::OrphanedObjects
+    {
+        std::mutex mutex;
+        std::vector<Retired> retired;
+    };
+
+    void Epoch::retire(void* pointer, void (*deleter)(void*))
+    {
+        ThreadRecord& record = _getThreadRecord();
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t epoch = _globalEpoch.load(std::memory_order_relaxed);
+
+        record.retired.push_back({ pointer, deleter, epoch });
+
+        if (++record.retiredSinceCollect >= _collectThreshold)
+        {
+            collect();
+        }
+    }
+
+    void Epoch::collect()
+    {
+        ThreadRecord& record = _getThreadRecord();
+        record.retiredSinceCollect = 0;
+
+        uint64_t epoch;
+        _tryAdvance(epoch);
+
+        _destroyReclaimable(record.retired, epoch);
+
+        OrphanedObjects& orphanedObjects = _getOrphanedObjects();
+        std::unique_lock lock(orphanedObjects.mutex, std::try_to_lock);
+        if (lock.owns_lock() && !orphanedObjects.retired.empty())
+        {
+            std::vector<Retired> orphans = std::move(orphanedObjects.retired);
+            orphanedObjects.retired.clear();
+            lock.unlock();
+
+            _destroyReclaimable(orphans, epoch);
+
+            lock.lock();
+            std::move(orphans.begin(), orphans.end(), std::back_inserter(orphanedObjects.retired));
+        }
+    }
+
+    Epoch::ThreadRecord& Epoch::_registerThread()
+    {
+        struct ThreadExitHandler
+        {
+            ~ThreadExitHandler()
+            {
+                if (_threadRecord)
+                {
+                    _releaseThread(*_threadRecord);
+                }
+            }
+        };
+
+        static thread_local ThreadExitHandler threadExitHandler;
+        (void)threadExitHandler;
+
+        for (ThreadRecord* record = _threadRecords.load(std::memory_order_acquire); record; record = record->next)
+        {
+            bool inUse = false;
+            if (!record->inUse.load(std::memory_order_relaxed) && record->inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+            {
+                _threadRecord = record;
+                return *record;
+            }
+        }
+
+        // Records are never freed, so the list can only grow at its head.
+        ThreadRecord* record = new ThreadRecord();
+        ThreadRecord* head = _threadRecords.load(std::memory_order_relaxed);
+        do
+        {
+            record->next = head;
+        } while (!_threadRecords.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+
+        _threadRecord = record;
+        return *record;
+    }
+
+    void Epoch::_destroyReclaimable(std::vector<Retired>& retired, uint64_t epoch)
+    {
+        auto it = std::partition(retired.begin(), retired.end(), [epoch](const Retired& object)
+        {
+            return object.epoch + 2 > epoch;
+        });
+
+        // Deleters are allowed to retire further objects, so detach the reclaimable ones before calling them.
+        std::vector<Retired> reclaimable(std::make_move_iterator(it), std::make_move_iterator(retired.end()));
+        retired.erase(it, retired.end());
+
+        for (const Retired& object : reclaimable)
+        {
+            object.deleter(object.pointer);
+        }
+    }
+
+    Epoch::OrphanedObjects& Epoch::_getOrphanedObjects()
+    {
+        // Intentionally leaked: threads may outlive static destructors.
+        static OrphanedObjects* orphanedObjects = new OrphanedObjects();
+        return *orphanedObjects;
+    }
+
+    bool Epoch::_tryAdvance(uint64_t& epoch) noexcept
+    {
+        epoch = _globalEpoch.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for (ThreadRecord* record = _threadRecords.load(std::memory_order_acquire); record; record = record->next)
+        {
+            uint64_t pinnedEpoch = record->pinnedEpoch.load(std::memory_order_relaxed);
+            if ((pinnedEpoch & 1) && (pinnedEpoch >> 1) != epoch)
+            {
+                return false;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (_globalEpoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_release, std::memory_order_relaxed))
+        {
+            ++epoch;
+        }
+        return true;
+    }
+
+    void Epoch::_releaseThread(ThreadRecord& record)
+    {
+        collect();
+
+        if (!record.retired.empty())
+        {
+            OrphanedObjects& orphanedObjects = _getOrphanedObjects();
+            std::lock_guard lock(orphanedObjects.mutex);
+
+            std::move(record.retired.begin(), record.retired.end(), std::back_inserter(orphanedObjects.retired));
+            record.retired.clear();
+        }
+
+        _threadRecord = nullptr;
+        record.inUse.store(false, std::memory_order_release);
+    }
+
+} // namespace jbkvs::detail
@@ -0,0 +1,132 @@
+#include <jbkvs/detail/expiryReaper.h>
+#include <jbkvs/node.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace jbkvs::detail
+{
+
+    namespace
+    {
+
+        // Expired keys that are not read again are reclaimed at most this late.
+        const std::chrono::milliseconds _reapInterval(10);
+
+        std::atomic<size_t> _nextStripeIndex(0);
+
+    } // namespace
+
+    void ExpiryReaper::schedule(const std::weak_ptr<const Node>& node, uint32_t key, uint64_t deadline)
+    {
+        ExpiryReaper& instance = _getInstance();
+        Stripe& stripe = instance._stripes[_getStripeIndex()];
+
+        bool wasEmpty;
+        {
+            std::lock_guard lock(stripe.mutex);
+
+            wasEmpty = stripe.wheel.size() == 0;
+            if (wasEmpty)
+            {
+                // Moves the idle wheel to the current time, so that it doesn't tick through the idle period.
+                stripe.wheel.advance(now(), [](Timer& timer) {});
+            }
+
+            stripe.wheel.schedule(deadline, { node, key, deadline });
+        }
+
+        if (wasEmpty)
+        {
+            std::lock_guard lock(instance._mutex);
+            instance._wakeUp = true;
+            instance._condition.notify_one();
+        }
+    }
+
+    size_t ExpiryReaper::getTimerCount()
+    {
+        ExpiryReaper& instance = _getInstance();
+
+        size_t count = 0;
+        for (Stripe& stripe : instance._stripes)
+        {
+            std::lock_guard lock(stripe.mutex);
+            count += stripe.wheel.size();
+        }
+        return count;
+    }
+
+    ExpiryReaper::ExpiryReaper()
+        : _stripes()
+        , _mutex()
+        , _condition()
+        , _wakeUp(false)
+    {
+        std::thread([this]() { _run(); }).detach();
+    }
+
+    ExpiryReaper& ExpiryReaper::_getInstance()
+    {
+        // Never destroyed: the thread may still be reaping while the static objects it relies on, such as the ones
+        // of Epoch, are destroyed at exit.
+        static ExpiryReaper& instance = *new ExpiryReaper();
+        return instance;
+    }
+
+    size_t ExpiryReaper::_getStripeIndex() noexcept
+    {
+        static thread_local size_t stripeIndex = _nextStripeIndex.fetch_add(1, std::memory_order_relaxed) % _stripeCount;
+        return stripeIndex;
+    }
+
+    void ExpiryReaper::_run()
+    {
+        std::vector<Timer> expired;
+
+        while (true)
+        {
+            {
+                // Cleared before the stripes are checked, so a timer scheduled after the check wakes the thread.
+                std::lock_guard lock(_mutex);
+                _wakeUp = false;
+            }
+
+            bool idle = true;
+            uint64_t currentTime = now();
+            for (Stripe& stripe : _stripes)
+            {
+                std::lock_guard lock(stripe.mutex);
+
+                stripe.wheel.advance(currentTime, [&expired](Timer& timer)
+                {
+                    expired.push_back(std::move(timer));
+                });
+                idle &= stripe.wheel.size() == 0;
+            }
+
+            // Writers scheduling new keys are not blocked by the removals.
+            for (const Timer& timer : expired)
+            {
+                std::shared_ptr<const Node> node = timer.node.lock();
+                if (node)
+                {
+                    node->_expire(timer.key, timer.deadline);
+                }
+            }
+            expired.clear();
+
+            std::unique_lock lock(_mutex);
+            if (idle)
+            {
+                _condition.wait(lock, [this]() { return _wakeUp; });
+            }
+            else
+            {
+                _condition.wait_for(lock, _reapInterval);
+            }
+        }
+    }
+
+} // namespace jbkvs::detail
@@ -0,0 +1,216 @@
+#include <jbkvs/detail/nameTable.h>
+#include <jbkvs/detail/epoch.h>
+
+#include <functional>
+
+namespace jbkvs::detail
+{
+
+    const InternedName NameTable::_tombstone(std::string_view(), 0);
+
+    const InternedName* NameTable::acquire(const std::string_view& value)
+    {
+        size_t hash = _getHash(value);
+        Shard& shard = _getShard(hash);
+
+        {
+            EpochGuard guard;
+
+            const InternedName* name = _find(*shard.table.load(std::memory_order_acquire), value, hash);
+            if (name && _tryReference(*name))
+            {
+                return name;
+            }
+        }
+
+        std::unique_ptr<InternedName> newName;
+        const Table* oldTable;
+
+        {
+            std::lock_guard lock(shard.mutex);
+
+            const InternedName* name = _find(*shard.table.load(std::memory_order_relaxed), value, hash);
+            if (name)
+            {
+                // The name may have lost its last reference, in which case its pending removal sees this one and keeps it.
+                name->_referenceCount.fetch_add(1, std::memory_order_relaxed);
+                return name;
+            }
+
+            newName.reset(new InternedName(value, hash));
+            oldTable = _insert(shard, newName.get());
+        }
+
+        // Retired outside of the lock, as retiring may destroy objects that release names of the same shard.
+        if (oldTable)
+        {
+            Epoch::retire(oldTable);
+        }
+        return newName.release();
+    }
+
+    void NameTable::release(const InternedName* name)
+    {
+        // Keeps the name alive if it gets revived and removed by other threads before the shard is locked below.
+        EpochGuard guard;
+
+        if (name->_referenceCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+
+        if (_remove(_getShard(name->_hash), name))
+        {
+            // Retired outside of the lock, as retiring may destroy objects that release names of the same shard.
+            Epoch::retire(name);
+        }
+    }
+
+    const InternedName* NameTable::find(const std::string_view& value) noexcept
+    {
+        size_t hash = _getHash(value);
+        return _find(*_getShard(hash).table.load(std::memory_order_acquire), value, hash);
+    }
+
+    size_t NameTable::getSize() noexcept
+    {
+        size_t size = 0;
+        Shard* shards = _getShards();
+        for (size_t i = 0; i < _shardCount; ++i)
+        {
+            size += shards[i].size.load(std::memory_order_relaxed);
+        }
+        return size;
+    }
+
+    NameTable::Shard* NameTable::_getShards()
+    {
+        // Never destroyed, as nodes destroyed during static destruction still release their names.
+        static Shard* shards = new Shard[_shardCount];
+        return shards;
+    }
+
+    NameTable::Shard& NameTable::_getShard(size_t hash)
+    {
+        // The top bits select the shard, the bottom ones the slot.
+        return _getShards()[(hash >> (sizeof(size_t) * 8 - 4)) % _shardCount];
+    }
+
+    size_t NameTable::_getHash(const std::string_view& value) noexcept
+    {
+        return std::hash<std::string_view>()(value);
+    }
+
+    const InternedName* NameTable::_find(const Table& table, const std::string_view& value, size_t hash) noexcept
+    {
+        for (size_t index = hash & table.mask;; index = (index + 1) & table.mask)
+        {
+            const InternedName* name = table.slots[index].load(std::memory_order_acquire);
+            if (!name)
+            {
+                return nullptr;
+            }
+            if (name != &_tombstone && name->_hash == hash && name->_value == value)
+            {
+                return name;
+            }
+        }
+    }
+
+    bool NameTable::_tryReference(const InternedName& name) noexcept
+    {
+        // A name without references is being removed, and only the shard owner may revive it.
+        size_t referenceCount = name._referenceCount.load(std::memory_order_relaxed);
+        while (referenceCount != 0)
+        {
+            if (name._referenceCount.compare_exchange_weak(referenceCount, referenceCount + 1, std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const NameTable::Table* NameTable::_insert(Shard& shard, const InternedName* name)
+    {
+        const Table* oldTable = nullptr;
+        const Table* table = shard.table.load(std::memory_order_relaxed);
+        // Tables are kept at most half used, so that probes stay short and always reach an empty slot.
+        if (2 * (shard.usedCount + 1) > table->mask + 1)
+        {
+            size_t capacity = _initialCapacity;
+            while (capacity < 4 * (shard.size.load(std::memory_order_relaxed) + 1))
+            {
+                capacity <<= 1;
+            }
+            oldTable = _rebuild(shard, capacity);
+            table = shard.table.load(std::memory_order_relaxed);
+        }
+
+        for (size_t index = name->_hash & table->mask;; index = (index + 1) & table->mask)
+        {
+            const InternedName* slotName = table->slots[index].load(std::memory_order_relaxed);
+            if (!slotName || slotName == &_tombstone)
+            {
+                shard.usedCount += !slotName;
+                table->slots[index].store(name, std::memory_order_release);
+                shard.size.fetch_add(1, std::memory_order_relaxed);
+                return oldTable;
+            }
+        }
+    }
+
+    bool NameTable::_remove(Shard& shard, const InternedName* name)
+    {
+        std::lock_guard lock(shard.mutex);
+
+        if (name->_referenceCount.load(std::memory_order_relaxed) != 0)
+        {
+            return false;
+        }
+
+        const Table& table = *shard.table.load(std::memory_order_relaxed);
+        for (size_t index = name->_hash & table.mask;; index = (index + 1) & table.mask)
+        {
+            const InternedName* slotName = table.slots[index].load(std::memory_order_relaxed);
+            if (!slotName)
+            {
+                // Already removed by the thread that revived it.
+                return false;
+            }
+            if (slotName == name)
+            {
+                table.slots[index].store(&_tombstone, std::memory_order_release);
+                shard.size.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    const NameTable::Table* NameTable::_rebuild(Shard& shard, size_t capacity)
+    {
+        const Table* oldTable = shard.table.load(std::memory_order_relaxed);
+        Table* table = new Table(capacity);
+
+        size_t usedCount = 0;
+        for (size_t i = 0; i <= oldTable->mask; ++i)
+        {
+            const InternedName* name = oldTable->slots[i].load(std::memory_order_relaxed);
+            if (name && name != &_tombstone)
+            {
+                size_t index = name->_hash & table->mask;
+                while (table->slots[index].load(std::memory_order_relaxed))
+                {
+                    index = (index + 1) & table->mask;
+                }
+                table->slots[index].store(name, std::memory_order_relaxed);
+                ++usedCount;
+            }
+        }
+
+        shard.usedCount = usedCount;
+        shard.table.store(table, std::memory_order_release);
+        return oldTable;
+    }
+
+} // namespace jbkvs::detail
@@ -0,0 +1,104 @@
+#include <jbkvs/detail/reclaimer.h>
+#include <jbkvs/detail/epoch.h>
+
+#include <thread>
+
+namespace jbkvs::detail
+{
+
+    void Reclaimer::drain()
+    {
+        Reclaimer& instance = _getInstance();
+        std::unique_lock lock(instance._mutex);
+
+        instance._idleCondition.wait(lock, [&instance]()
+        {
+            return instance._queue.empty() && !instance._isBusy;
+        });
+    }
+
+    Reclaimer::Reclaimer()
+        : _mutex()
+        , _condition()
+        , _idleCondition()
+        , _queue()
+        , _isBusy(false)
+    {
+        std::thread([this]() { _run(); }).detach();
+    }
+
+    Reclaimer& Reclaimer::_getInstance()
+    {
+        // Never destroyed, like ExpiryReaper: the thread may still be destroying objects at exit.
+        static Reclaimer& instance = *new Reclaimer();
+        return instance;
+    }
+
+    void Reclaimer::_retire(const Retired& retired, bool background)
+    {
+        if (_localQueue)
+        {
+            _localQueue->push_back(retired);
+            return;
+        }
+
+        if (background)
+        {
+            Reclaimer& instance = _getInstance();
+            std::lock_guard lock(instance._mutex);
+
+            bool wasEmpty = instance._queue.empty();
+            instance._queue.push_back(retired);
+            if (wasEmpty)
+            {
+                instance._condition.notify_one();
+            }
+            return;
+        }
+
+        std::vector<Retired> queue;
+        queue.push_back(retired);
+        _destroy(queue);
+    }
+
+    void Reclaimer::_destroy(std::vector<Retired>& queue) noexcept
+    {
+        _localQueue = &queue;
+        while (!queue.empty())
+        {
+            Retired retired = queue.back();
+            queue.pop_back();
+            retired.deleter(retired.pointer);
+        }
+        _localQueue = nullptr;
+    }
+
+    void Reclaimer::_run()
+    {
+        std::vector<Retired> batch;
+
+        std::unique_lock lock(_mutex);
+        while (true)
+        {
+            if (_queue.empty())
+            {
+                _condition.wait(lock);
+                continue;
+            }
+
+            // Threads retiring objects meanwhile are not blocked by the destruction.
+            batch.swap(_queue);
+            _isBusy = true;
+            lock.unlock();
+
+            _destroy(batch);
+            // Destroys what the destructors retired to the epoch on this thread, rather than at the next batch.
+            Epoch::collect();
+
+            lock.lock();
+            _isBusy = false;
+            _idleCondition.notify_all();
+        }
+    }
+
+} // namespace jbkvs::detail
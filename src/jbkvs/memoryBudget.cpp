@@ -0,0 +1,236 @@
+#include <jbkvs/memoryBudget.h>
+#include <jbkvs/node.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace jbkvs
+{
+
+    namespace
+    {
+
+        // Stripes are folded once they hold this fraction of the limit, within the bounds below.
+        const size_t _foldFraction = 256;
+        const int64_t _minFoldThreshold = 256;
+        const int64_t _maxFoldThreshold = 64 * 1024;
+
+        std::atomic<size_t> _nextStripeIndex(0);
+
+    } // namespace
+
+    MemoryBudgetPtr MemoryBudget::create(size_t limit, Policy policy, const MemoryBudgetPtr& parent)
+    {
+        struct MakeSharedEnabledMemoryBudget : public MemoryBudget
+        {
+            MakeSharedEnabledMemoryBudget(size_t limit, Policy policy, const MemoryBudgetPtr& parent)
+                : MemoryBudget(limit, policy, parent)
+            {
+            }
+        };
+
+        MemoryBudgetPtr budget = std::make_shared<MakeSharedEnabledMemoryBudget>(limit, policy, parent);
+        return budget;
+    }
+
+    MemoryBudget::MemoryBudget(size_t limit, Policy policy, const MemoryBudgetPtr& parent)
+        : _limit(limit)
+        , _policy(policy)
+        , _parent(parent)
+        , _foldThreshold(std::clamp(int64_t(limit / _foldFraction), _minFoldThreshold, _maxFoldThreshold))
+        , _foldedUsage(0)
+        , _stripes()
+        , _evicting(false)
+        , _clock()
+        , _clockSize(0)
+    {
+    }
+
+    MemoryBudget::~MemoryBudget()
+    {
+    }
+
+    size_t MemoryBudget::getUsage() const noexcept
+    {
+        int64_t usage = _foldedUsage.load(std::memory_order_relaxed);
+        for (const Stripe& stripe : _stripes)
+        {
+            usage += stripe.usage.load(std::memory_order_relaxed);
+        }
+        return size_t(std::max<int64_t>(usage, 0));
+    }
+
+    size_t MemoryBudget::getTrackedKeyCount() const
+    {
+        size_t count = _clockSize.load(std::memory_order_relaxed);
+        for (const Stripe& stripe : _stripes)
+        {
+            std::lock_guard lock(stripe.lock);
+            count += stripe.newKeys.size();
+        }
+        return count;
+    }
+
+    size_t MemoryBudget::_getStripeIndex() noexcept
+    {
+        static thread_local size_t stripeIndex = _nextStripeIndex.fetch_add(1, std::memory_order_relaxed) % _stripeCount;
+        return stripeIndex;
+    }
+
+    bool MemoryBudget::_canCharge(size_t bytes) const noexcept
+    {
+        for (const MemoryBudget* budget = this; budget; budget = budget->_parent.get())
+        {
+            if (budget->_policy == Policy::Reject && budget->_foldedUsage.load(std::memory_order_relaxed) + int64_t(bytes) > int64_t(budget->_limit))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void MemoryBudget::_charge(int64_t bytes)
+    {
+        for (MemoryBudget* budget = this; budget; budget = budget->_parent.get())
+        {
+            budget->_add(bytes);
+            if (bytes > 0 && budget->_policy == Policy::Evict && budget->_foldedUsage.load(std::memory_order_relaxed) > int64_t(budget->_limit))
+            {
+                budget->_evict();
+            }
+        }
+    }
+
+    void MemoryBudget::_track(const std::weak_ptr<const Node>& node, uint32_t key, uint64_t levelBits)
+    {
+        size_t level = 0;
+        for (MemoryBudget* budget = this; budget; budget = budget->_parent.get())
+        {
+            if (budget->_policy != Policy::Evict)
+            {
+                continue;
+            }
+
+            if (levelBits & Node::_getClockLevelBit(level))
+            {
+                Stripe& stripe = budget->_stripes[_getStripeIndex()];
+
+                bool collect;
+                {
+                    std::lock_guard lock(stripe.lock);
+
+                    stripe.newKeys.push_back({ node, key, level });
+                    collect = stripe.newKeys.size() >= _newKeysThreshold;
+                }
+
+                // Keys churning under the limit would otherwise pile up until the next eviction.
+                if (collect && !budget->_evicting.exchange(true, std::memory_order_acquire))
+                {
+                    budget->_collectNewKeys();
+                    budget->_evicting.store(false, std::memory_order_release);
+                }
+            }
+            ++level;
+        }
+    }
+
+    size_t MemoryBudget::_getEvictLevelCount() const noexcept
+    {
+        size_t count = 0;
+        for (const MemoryBudget* budget = this; budget; budget = budget->_parent.get())
+        {
+            count += budget->_policy == Policy::Evict ? 1 : 0;
+        }
+        return count;
+    }
+
+    bool MemoryBudget::_hasPolicy(Policy policy) const noexcept
+    {
+        for (const MemoryBudget* budget = this; budget; budget = budget->_parent.get())
+        {
+            if (budget->_policy == policy)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void MemoryBudget::_add(int64_t bytes) noexcept
+    {
+        Stripe& stripe = _stripes[_getStripeIndex()];
+
+        int64_t usage = stripe.usage.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        if (usage >= _foldThreshold || usage <= -_foldThreshold)
+        {
+            _foldedUsage.fetch_add(stripe.usage.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+
+    void MemoryBudget::_evict()
+    {
+        // One thread evicts at a time while the others keep writing, so the limit may be exceeded briefly.
+        if (_evicting.exchange(true, std::memory_order_acquire))
+        {
+            return;
+        }
+
+        _collectNewKeys();
+
+        // The hand passes every entry at most twice: once to clear its reference and once to evict it.
+        for (size_t steps = 2 * _clock.size(); steps > 0 && !_clock.empty() && getUsage() > _limit; --steps)
+        {
+            ClockEntry entry = std::move(_clock.front());
+            _clock.pop_front();
+
+            std::shared_ptr<const Node> node = entry.node.lock();
+            if (node && node->_evict(entry.key, entry.level))
+            {
+                _clock.push_back(std::move(entry));
+            }
+        }
+        _clockSize.store(_clock.size(), std::memory_order_relaxed);
+
+        _evicting.store(false, std::memory_order_release);
+    }
+
+    void MemoryBudget::_collectNewKeys()
+    {
+        size_t collectedCount = 0;
+        std::vector<ClockEntry> newKeys;
+        for (Stripe& stripe : _stripes)
+        {
+            {
+                std::lock_guard lock(stripe.lock);
+                newKeys.swap(stripe.newKeys);
+            }
+
+            collectedCount += newKeys.size();
+            for (ClockEntry& entry : newKeys)
+            {
+                std::shared_ptr<const Node> node = entry.node.lock();
+                if (node && node->_untrackKeyIfAbsent(entry.key, entry.level))
+                {
+                    _clock.push_back(std::move(entry));
+                }
+            }
+            newKeys.clear();
+        }
+
+        // Advances the hand, without evicting, twice as fast as entries arrive, so that the entries of keys removed
+        // after they were collected are dropped and the clock stays proportional to the live keys.
+        for (size_t steps = std::min(2 * collectedCount, _clock.size()); steps > 0; --steps)
+        {
+            ClockEntry entry = std::move(_clock.front());
+            _clock.pop_front();
+
+            std::shared_ptr<const Node> node = entry.node.lock();
+            if (node && node->_untrackKeyIfAbsent(entry.key, entry.level))
+            {
+                _clock.push_back(std::move(entry));
+            }
+        }
+        _clockSize.store(_clock.size(), std::memory_order_relaxed);
+    }
+
+} // namespace jbkvs
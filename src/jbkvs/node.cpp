@@ -1,7 +1,7 @@
 #include <jbkvs/node.h>
 #include <jbkvs/storageNode.h>
+#include <jbkvs/detail/reclaimer.h>
 
-#include <assert.h>
 #include <algorithm>
 
 namespace jbkvs
@@ -10,30 +10,77 @@ namespace jbkvs
     namespace detail
     {
 
-        SubTreeLock::SubTreeLock(const NodePtr& node)
-            : _node(node)
+        MountedSubTreeLock::MountedSubTreeLock(const NodePtr& node, const std::vector<Mount>& mounts)
+            : _nodes()
         {
-            _node->_lockSubTree();
+            node->_mutex.lock();
+            _nodes.push_back(node);
+
+            // Walked while it grows, so every node is locked after its parent. A child left unlocked can't be
+            // mounted meanwhile, as mounting it requires its parent, which stays locked.
+            for (size_t i = 0; i < _nodes.size(); ++i)
+            {
+                const Node& current = *_nodes[i];
+                bool isExpanded = std::any_of(mounts.begin(), mounts.end(), [&current](const Mount& mount)
+                {
+                    return current._isExpandedBy(mount.first, mount.second);
+                });
+                if (!isExpanded)
+                {
+                    // No StorageNode of the mounts was created for its children.
+                    continue;
+                }
+
+                for (const auto& [name, child] : current._children)
+                {
+                    child->_mutex.lock();
+                    bool isMounted = std::any_of(mounts.begin(), mounts.end(), [&childNode = *child](const Mount& mount)
+                    {
+                        return childNode._isMountedBy(mount.first, mount.second);
+                    });
+                    if (isMounted)
+                    {
+                        _nodes.push_back(child);
+                    }
+                    else
+                    {
+                        child->_mutex.unlock();
+                    }
+                }
+            }
         }
 
-        SubTreeLock::~SubTreeLock()
+        MountedSubTreeLock::~MountedSubTreeLock()
         {
-            _node->_unlockSubTree();
+            for (auto it = _nodes.rbegin(); it != _nodes.rend(); ++it)
+            {
+                (*it)->_mutex.unlock();
+            }
         }
 
     } // namespace detail
 
     NodePtr Node::create()
     {
-        return create({}, {});
+        return _create({}, {}, {});
+    }
+
+    NodePtr Node::create(const MemoryBudgetPtr& budget)
+    {
+        return _create({}, {}, budget);
     }
 
     NodePtr Node::create(const NodePtr& parent, const std::string_view& name)
+    {
+        return _create(parent, name, parent ? parent->_budget : MemoryBudgetPtr());
+    }
+
+    NodePtr Node::_create(const NodePtr& parent, const std::string_view& name, const MemoryBudgetPtr& budget)
     {
         struct MakeSharedEnabledNode : public Node
         {
-            MakeSharedEnabledNode(const NodePtr& parent, const std::string_view& name)
-                : Node(parent, name)
+            MakeSharedEnabledNode(const NodePtr& parent, const std::string_view& name, const MemoryBudgetPtr& budget)
+                : Node(parent, name, budget)
             {
             }
         };
@@ -48,7 +95,12 @@ namespace jbkvs
             return NodePtr();
         }
 
-        NodePtr newNode = std::make_shared<MakeSharedEnabledNode>(parent, name);
+        if (budget && !budget->_canCharge(_getNodeUsage(name)))
+        {
+            return NodePtr();
+        }
+
+        NodePtr newNode = std::make_shared<MakeSharedEnabledNode>(parent, name, budget);
         if (parent)
         {
             bool attached = parent->_attachChild(newNode->_name, newNode);
@@ -61,39 +113,53 @@ namespace jbkvs
         return newNode;
     }
 
-    Node::Node(const NodePtr& parent, const std::string_view& name)
+    Node::Node(const NodePtr& parent, const std::string_view& name, const MemoryBudgetPtr& budget)
         : _parent(parent)
         , _name(name)
         , _mutex()
         , _mountPoints()
         , _children()
         , _data()
+        , _expirations(nullptr)
+        , _budget(budget)
+        , _clockKeys(budget && budget->_hasPolicy(MemoryBudget::Policy::Evict) ? std::make_unique<detail::ConcurrentMap<TKey, uint64_t>>() : nullptr)
+        , _generation(0)
+        , _keyFilter()
     {
+        if (_budget)
+        {
+            _budget->_charge(int64_t(_getNodeUsage(_name)));
+        }
     }
 
     Node::~Node()
     {
-        _children.clear();
-    }
-
-    void Node::_lockSubTree()
-    {
-        _mutex.lock();
-
-        for (auto it = _children.begin(); it != _children.end(); ++it)
+        if (!_children.empty())
         {
-            it->second->_lockSubTree();
+            // Dropping the children may cascade through a whole subtree, which is destroyed iteratively instead, and
+            // in the background unless the budget has to be credited by the time the last reference is dropped.
+            auto children = std::make_unique<detail::ChildrenMap<NodePtr>>();
+            children->swap(_children);
+            if (_budget)
+            {
+                detail::Reclaimer::destroy(std::move(children));
+            }
+            else
+            {
+                detail::Reclaimer::retire(std::move(children));
+            }
         }
-    }
+        delete _expirations.load(std::memory_order_relaxed);
 
-    void Node::_unlockSubTree()
-    {
-        for (auto it = _children.rbegin(); it != _children.rend(); ++it)
+        if (_budget)
         {
-            it->second->_unlockSubTree();
+            size_t usage = _getNodeUsage(_name);
+            for (const auto& [key, value] : _data)
+            {
+                usage += _getItemUsage(value);
+            }
+            _budget->_charge(-int64_t(usage));
         }
-
-        _mutex.unlock();
     }
 
     bool Node::detach()
@@ -129,8 +195,8 @@ namespace jbkvs
     {
         std::shared_lock lock(_mutex);
 
-        auto it = _children.find(name);
-        return (it != _children.end()) ? it->second : NodePtr();
+        const NodePtr* child = _children.find(name);
+        return child ? *child : NodePtr();
     }
 
     bool Node::_attachChild(const std::string& name, const NodePtr& child)
@@ -149,7 +215,7 @@ namespace jbkvs
 
         for (const MountPoint& mountPoint : _mountPoints)
         {
-            mountPoint.storageNode->_attachMountedNodeChild(mountPoint.depth, mountPoint.priority, name, child);
+            mountPoint.storageNode->_attachMountedNodeChild(mountPoint.depth, mountPoint.priority, *this, name, child);
         }
 
         return true;
@@ -157,48 +223,214 @@ namespace jbkvs
 
     bool Node::_detachChild(const std::string& name)
     {
+        // Dropped after the locks are released, in case it holds the last reference to a subtree that is destroyed
+        // on this thread.
+        NodePtr detachedChild;
+
         std::unique_lock lock(_mutex);
 
         // TODO: think if it is better to use shared_from_this().
-        auto childIt = _children.find(name);
-        if (childIt == _children.end())
+        const NodePtr* childPtr = _children.find(name);
+        if (!childPtr)
         {
             // This might happen if we call detach() too fast from different threads.
             return false;
         }
-        const NodePtr& child = childIt->second;
+        const NodePtr& child = *childPtr;
 
-        detail::SubTreeLock subTreeLock(child);
+        std::vector<detail::MountedSubTreeLock::Mount> mounts;
+        mounts.reserve(_mountPoints.size());
+        for (const MountPoint& mountPoint : _mountPoints)
+        {
+            mounts.emplace_back(mountPoint.storageNode, mountPoint.priority);
+        }
+        detail::MountedSubTreeLock subTreeLock(child, mounts);
 
         for (auto it = _mountPoints.rbegin(); it != _mountPoints.rend(); ++it)
         {
-            it->storageNode->_detachMountedNodeChild(it->depth, name, child);
+            it->storageNode->_detachMountedNodeChild(it->depth, it->priority, name, child);
         }
 
-        _children.erase(childIt);
+        detachedChild = child;
+        _children.erase(name);
 
         return true;
     }
 
-    void Node::_onMounting(StorageNode* storageNode, size_t depth, uint32_t priority)
+    Node::MountPoints::iterator Node::_onMounting(StorageNode* storageNode, size_t depth, uint64_t priority)
+    {
+        return _mountPoints.emplace(_mountPoints.end(), storageNode, depth, priority);
+    }
+
+    void Node::_onUnmounted(const MountPoints::iterator& mountPoint)
     {
-        _mountPoints.emplace_back(storageNode, depth, priority);
+        _mountPoints.erase(mountPoint);
     }
 
-    void Node::_onUnmounted(StorageNode* storageNode, size_t depth)
+    bool Node::_isMountedBy(const StorageNode* storageNode, uint64_t priority) const noexcept
     {
-        auto it = std::find_if(_mountPoints.rbegin(), _mountPoints.rend(), [&](const MountPoint& mountPoint)
+        return std::any_of(_mountPoints.begin(), _mountPoints.end(), [&](const MountPoint& mountPoint)
         {
-            return mountPoint.storageNode == storageNode && mountPoint.depth == depth;
+            return mountPoint.priority == priority && mountPoint.storageNode->_context == storageNode->_context;
         });
+    }
 
-        if (it == _mountPoints.rend())
+    bool Node::_isExpandedBy(const StorageNode* storageNode, uint64_t priority) const
+    {
+        return std::any_of(_mountPoints.begin(), _mountPoints.end(), [&](const MountPoint& mountPoint)
+        {
+            return mountPoint.priority == priority && mountPoint.storageNode->_context == storageNode->_context &&
+                mountPoint.storageNode->_isExpanded(mountPoint.depth, priority);
+        });
+    }
+
+    Node::Expirations& Node::_getExpirations()
+    {
+        Expirations* expirations = _expirations.load(std::memory_order_acquire);
+        if (expirations)
+        {
+            return *expirations;
+        }
+
+        std::unique_ptr<Expirations> newExpirations = std::make_unique<Expirations>();
+        if (_expirations.compare_exchange_strong(expirations, newExpirations.get(), std::memory_order_acq_rel))
+        {
+            return *newExpirations.release();
+        }
+        return *expirations;
+    }
+
+    bool Node::_expireIfDue(const Expirations& expirations, const TKey& key) const
+    {
+        std::optional<uint64_t> deadline = expirations.deadlines.get(key);
+        if (!deadline || *deadline > detail::ExpiryReaper::now())
+        {
+            return false;
+        }
+
+        _expire(key);
+        return true;
+    }
+
+    void Node::_expire(const TKey& key, std::optional<uint64_t> firedTimer) const
+    {
+        // The key is removed by _update() if its current deadline has passed, serialized with the writers that
+        // may have given it a new one, in which case the timer is rescheduled for it.
+        _update(key, [](std::optional<TValue>& value, std::optional<uint64_t>& deadline) {}, firedTimer);
+    }
+
+    void Node::_trackKey(const TKey& key) const
+    {
+        uint64_t levelBits = 0;
+        for (size_t level = 0; level < _budget->_getEvictLevelCount(); ++level)
+        {
+            levelBits |= _getClockLevelBit(level);
+        }
+
+        // Pairs with the fence in _untrackKeyIfAbsent(): either the key is seen as tracked here, or its insertion is
+        // seen there and the entry is kept.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::optional<uint64_t> state = _clockKeys->get(key);
+        if (state && (*state & levelBits) == levelBits)
         {
-            assert(false);
             return;
         }
 
-        _mountPoints.erase(std::next(it).base());
+        uint64_t untrackedBits = 0;
+        _clockKeys->update(key, [&untrackedBits, levelBits](std::optional<uint64_t>& state)
+        {
+            untrackedBits = levelBits & ~state.value_or(0);
+            state = state.value_or(0) | levelBits;
+        });
+        if (untrackedBits)
+        {
+            _budget->_track(weak_from_this(), key, untrackedBits);
+        }
+    }
+
+    bool Node::_untrackKeyIfAbsent(const TKey& key, size_t level) const
+    {
+        if (_data.visit(key, [](const TValue& value) {}))
+        {
+            return true;
+        }
+
+        uint64_t levelBit = _getClockLevelBit(level);
+        _clockKeys->update(key, [levelBit](std::optional<uint64_t>& state)
+        {
+            if (state && !(*state & ~(levelBit | _referencedBit)))
+            {
+                state.reset();
+            }
+            else if (state)
+            {
+                *state &= ~levelBit;
+            }
+        });
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!_data.visit(key, [](const TValue& value) {}))
+        {
+            return false;
+        }
+
+        // Put again meanwhile by a writer that may have seen the key as still tracked at the level.
+        _clockKeys->update(key, [levelBit](std::optional<uint64_t>& state)
+        {
+            state = state.value_or(0) | levelBit;
+        });
+        return true;
+    }
+
+    bool Node::_evict(const TKey& key, size_t level) const
+    {
+        bool referenced = false;
+        _clockKeys->update(key, [&referenced](std::optional<uint64_t>& state)
+        {
+            referenced = state && (*state & _referencedBit);
+            if (referenced)
+            {
+                *state &= ~_referencedBit;
+            }
+        });
+
+        if (!referenced)
+        {
+            _update(key, [](std::optional<TValue>& value, std::optional<uint64_t>& deadline)
+            {
+                value.reset();
+            });
+        }
+        return _untrackKeyIfAbsent(key, level);
+    }
+
+    size_t Node::_getItemUsage(const TValue& value) noexcept
+    {
+        // Fixed part of an item, including an estimate of the overhead of the map.
+        size_t usage = sizeof(TKey) + sizeof(TValue) + 16;
+        if (const std::string* string = std::get_if<std::string>(&value))
+        {
+            usage += string->size();
+        }
+        else if (const types::BlobPtr* blob = std::get_if<types::BlobPtr>(&value); blob && *blob)
+        {
+            usage += sizeof(types::Blob) + (*blob)->size();
+        }
+        return usage;
+    }
+
+    void Node::_growKeyFilter() const
+    {
+        // Overwrites and removals may have filled the filter without adding keys.
+        if (_data.size() > _keyFilter.getCapacity())
+        {
+            _keyFilter.grow();
+        }
+    }
+
+    size_t Node::_getNodeUsage(const std::string_view& name) noexcept
+    {
+        // A node with its name and its item in the children map of the parent.
+        return sizeof(Node) + name.size() + 64;
     }
 
 } // namespace jbkvs
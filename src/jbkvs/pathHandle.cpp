@@ -0,0 +1,65 @@
+#include <jbkvs/pathHandle.h>
+
+namespace jbkvs
+{
+
+    PathHandlePtr PathHandle::_create(const StorageNodePtr& root, const std::string_view& path)
+    {
+        struct MakeSharedEnabledPathHandle : public PathHandle
+        {
+            MakeSharedEnabledPathHandle(const StorageNodePtr& root, const std::string_view& path)
+                : PathHandle(root, path)
+            {
+            }
+        };
+
+        return std::make_shared<MakeSharedEnabledPathHandle>(root, path);
+    }
+
+    PathHandle::PathHandle(const StorageNodePtr& root, const std::string_view& path)
+        : _root(root)
+        , _path(path)
+        , _binding(nullptr)
+    {
+        detail::EpochGuard guard;
+
+        _rebind(nullptr);
+    }
+
+    PathHandle::~PathHandle()
+    {
+        delete _binding.load(std::memory_order_relaxed);
+    }
+
+    StorageNodePtr PathHandle::getNode() const
+    {
+        detail::EpochGuard guard;
+
+        return _getBinding()->node;
+    }
+
+    const PathHandle::Binding* PathHandle::_rebind(const Binding* binding) const
+    {
+        // Loaded before the walk, so that a change the walk misses leaves the new binding outdated.
+        const StorageNode::Context& context = *_root->_context;
+        uint64_t removalGeneration = context.removalGeneration.load(std::memory_order_acquire);
+        uint64_t additionGeneration = context.additionGeneration.load(std::memory_order_acquire);
+
+        StorageNodePtr node = StorageNode::_resolvePath(_root, _path);
+        const Binding* newBinding = new Binding(node, node ? removalGeneration : additionGeneration);
+
+        if (!_binding.compare_exchange_strong(binding, newBinding, std::memory_order_acq_rel))
+        {
+            // Another thread has rebound the handle; its binding is as recent.
+            delete newBinding;
+            return binding;
+        }
+
+        if (binding)
+        {
+            detail::Epoch::retire(binding);
+        }
+        return newBinding;
+    }
+
+} // namespace jbkvs
@@ -1,5 +1,6 @@
 #include <jbkvs/storage.h>
 
+#include <assert.h>
 #include <algorithm>
 #include <iterator>
 
@@ -7,24 +8,36 @@ namespace jbkvs
 {
 
     Storage::Storage()
+        : Storage(0)
+    {
+    }
+
+    Storage::Storage(size_t resolveCacheCapacity, Propagation propagation)
         : _mutex()
         , _mountPriorityCounter()
         , _mountPoints()
-        , _root(StorageNode::_create())
+        , _mountIndex()
+        , _changeQueue(propagation == Propagation::Asynchronous ? std::make_unique<StorageNode::ChangeQueue>(&StorageNode::_applyAttachments) : nullptr)
+        , _root(StorageNode::_create(std::make_shared<StorageNode::Context>(resolveCacheCapacity, _changeQueue.get())))
+        , _pathCache(_pathCacheCapacity)
     {
     }
 
     Storage::~Storage()
     {
+        // Dropped after the lock is released, as they may hold the last references to their subtrees.
+        std::vector<NodePtr> unmountedNodes;
+
         std::unique_lock lock(_mutex);
 
+        unmountedNodes.reserve(_mountPoints.size());
         while (!_mountPoints.empty())
         {
-            _unmount(_mountPoints.rbegin());
+            unmountedNodes.push_back(_unmount(std::prev(_mountPoints.end())));
         }
     }
 
-    bool Storage::mount(const std::string_view& path, const NodePtr& node)
+    bool Storage::mount(const std::string_view& path, const NodePtr& node, MountMode mode)
     {
         if (path.empty() || path[0] != StorageNode::_pathSeparator)
         {
@@ -44,19 +57,30 @@ namespace jbkvs
 
         std::unique_lock lock(_mutex);
 
-        uint32_t priority = ++_mountPriorityCounter;
-        _mount(path, node, priority);
+        uint64_t priority = ++_mountPriorityCounter;
+        _mount(path, node, priority, mode);
 
         return true;
     }
 
-    void Storage::_mount(const std::string_view& path, const NodePtr& node, uint32_t priority)
+    void Storage::_mount(const std::string_view& path, const NodePtr& node, uint64_t priority, MountMode mode)
     {
-        detail::SubTreeLock subTreeLock(node);
+        StorageNode* storageNode;
+        {
+            // Only the root registers with a StorageNode; the other nodes are locked a layer at a time when they are
+            // materialized, so the rest of the tree keeps changing meanwhile.
+            std::unique_lock nodeLock(node->_mutex);
+
+            storageNode = _root->_mountVirtual(path.substr(1), node, priority);
+        }
 
-        _root->_mountVirtual(path.substr(1), node, priority);
+        if (mode == MountMode::Eager)
+        {
+            storageNode->_materialize(priority);
+        }
 
-        _mountPoints.emplace_back(path, node);
+        _mountPoints.emplace_back(path, node, priority);
+        _mountIndex[MountKey(path, node.get())].push_back(std::prev(_mountPoints.end()));
     }
 
     bool Storage::unmount(const std::string_view& path, const NodePtr& node)
@@ -73,29 +97,35 @@ namespace jbkvs
 
         std::unique_lock lock(_mutex);
 
-        auto it = std::find_if(_mountPoints.rbegin(), _mountPoints.rend(), [&path, &node](const MountPoint& mountPoint)
-        {
-            return mountPoint.path == path && mountPoint.node == node;
-        });
-
-        if (it == _mountPoints.rend())
+        auto indexIt = _mountIndex.find(MountKey(path, node.get()));
+        if (indexIt == _mountIndex.end())
         {
             return false;
         }
 
-        _unmount(it);
+        // The latest mount of the node at the path goes first.
+        _unmount(indexIt->second.back());
         return true;
     }
 
-    void Storage::_unmount(const decltype(_mountPoints)::reverse_iterator& it)
+    NodePtr Storage::_unmount(MountPoints::iterator it)
     {
+        auto indexIt = _mountIndex.find(MountKey(it->path, it->node.get()));
+        assert(indexIt != _mountIndex.end() && indexIt->second.back() == it);
+        indexIt->second.pop_back();
+        if (indexIt->second.empty())
+        {
+            _mountIndex.erase(indexIt);
+        }
+
         MountPoint mountPoint = std::move(*it);
 
-        _mountPoints.erase(std::next(it).base());
+        _mountPoints.erase(it);
 
-        detail::SubTreeLock subTreeLock(mountPoint.node);
+        detail::MountedSubTreeLock subTreeLock(mountPoint.node, { { _root.get(), mountPoint.priority } });
 
-        _root->_unmountVirtual(std::string_view(mountPoint.path).substr(1), mountPoint.node);
+        _root->_unmountVirtual(std::string_view(mountPoint.path).substr(1), mountPoint.node, mountPoint.priority);
+        return std::move(mountPoint.node);
     }
 
     StorageNodePtr Storage::getNode(const std::string_view& path) const
@@ -112,25 +142,31 @@ namespace jbkvs
             return _root;
         }
 
-        StorageNodePtr current = _root;
+        // Loaded before the walk, so that the entry stored for a StorageNode removed during the walk never matches.
+        uint64_t generation = _root->_context->removalGeneration.load(std::memory_order_acquire);
 
-        for (size_t start = 1, end; start < length; start = end + 1)
+        StorageNodePtr current = _pathCache.find(path, generation);
+        if (current)
         {
-            end = path.find(StorageNode::_pathSeparator, start);
+            return current;
+        }
 
-            if (end == std::string_view::npos)
-            {
-                end = length;
-            }
+        current = StorageNode::_resolvePath(_root, path);
+        if (current)
+        {
+            _pathCache.store(path, current, generation);
+        }
+        return current;
+    }
 
-            current = current->getChild(path.substr(start, end - start));
-            if (!current)
-            {
-                return StorageNodePtr();
-            }
+    PathHandlePtr Storage::resolve(const std::string_view& path) const
+    {
+        if (path.empty() || path[0] != StorageNode::_pathSeparator)
+        {
+            return PathHandlePtr();
         }
 
-        return current;
+        return PathHandle::_create(_root, path);
     }
 
     std::vector<Storage::MountPoint> Storage::getMountPoints() const
@@ -143,4 +179,12 @@ namespace jbkvs
         return result;
     }
 
+    void Storage::sync() const
+    {
+        if (_changeQueue)
+        {
+            _changeQueue->flush();
+        }
+    }
+
 } // namespace jbkvs
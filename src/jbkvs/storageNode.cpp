@@ -2,44 +2,64 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <optional>
+#include <tuple>
 
 namespace jbkvs
 {
 
-    StorageNodePtr StorageNode::_create()
+    StorageNodePtr StorageNode::_create(const ContextPtr& context)
     {
-        struct MakeSharedEnabledStorageNode : public StorageNode {};
+        struct MakeSharedEnabledStorageNode : public StorageNode
+        {
+            explicit MakeSharedEnabledStorageNode(const ContextPtr& context)
+                : StorageNode(context)
+            {
+            }
+        };
 
-        return std::make_shared<MakeSharedEnabledStorageNode>();
+        return std::make_shared<MakeSharedEnabledStorageNode>(context);
     }
 
-    StorageNode::StorageNode()
+    StorageNode::StorageNode(const ContextPtr& context)
         : _mutex()
         , _virtualMountCounter()
-        , _mountedNodes()
+        , _mountedNodes(new MountedNodes())
         , _children()
+        , _pendingLayers()
+        , _context(context)
+        , _resolveCache(context->resolveCacheCapacity ? std::make_unique<ResolveCache>(context->resolveCacheCapacity) : nullptr)
     {
     }
 
     StorageNode::~StorageNode()
     {
+        delete _mountedNodes.load(std::memory_order_relaxed);
     }
 
     StorageNodePtr StorageNode::getChild(const std::string_view& name) const
     {
         std::shared_lock lock(_mutex);
 
-        auto it = _children.find(name);
-        return (it != _children.end()) ? it->second : StorageNodePtr();
+        if (!_pendingLayers.empty())
+        {
+            lock.unlock();
+            _expand();
+            lock.lock();
+        }
+
+        const StorageNodePtr* child = _children.find(name);
+        return child ? *child : StorageNodePtr();
     }
 
-    void StorageNode::_mountVirtual(const std::string_view& path, const NodePtr& node, uint32_t priority)
+    StorageNode* StorageNode::_mountVirtual(const std::string_view& path, const NodePtr& node, uint64_t priority)
     {
         size_t length = path.length();
 
         if (length == 0)
         {
-            return _mount(node, 0, priority);
+            _mount(node, 0, priority, true);
+            return this;
         }
 
         size_t end = path.find(_pathSeparator);
@@ -53,23 +73,19 @@ namespace jbkvs
 
         ++_virtualMountCounter;
 
-        StorageNodePtr& child = _children[std::move(childName)];
-        if (!child)
-        {
-            child = _create();
-        }
+        const StorageNodePtr& child = _getOrCreateChild(childName);
 
         std::string_view subPath = (end == length) ? std::string_view() : path.substr(end + 1);
-        child->_mountVirtual(subPath, node, priority);
+        return child->_mountVirtual(subPath, node, priority);
     }
 
-    bool StorageNode::_unmountVirtual(const std::string_view& path, const NodePtr& node)
+    bool StorageNode::_unmountVirtual(const std::string_view& path, const NodePtr& node, uint64_t priority)
     {
         size_t length = path.length();
 
         if (length == 0)
         {
-            return _unmount(node, 0);
+            return _unmount(node, 0, priority);
         }
 
         size_t end = path.find(_pathSeparator);
@@ -81,16 +97,15 @@ namespace jbkvs
 
         std::unique_lock lock(_mutex);
 
-        auto childIt = _children.find(childName);
-        assert(childIt != _children.end());
+        const StorageNodePtr* child = _children.find(childName);
+        assert(child);
 
-        const StorageNodePtr& child = childIt->second;
         std::string_view subPath = (end == length) ? std::string_view() : path.substr(end + 1);
-        bool detachChild = child->_unmountVirtual(subPath, node);
+        bool detachChild = (*child)->_unmountVirtual(subPath, node, priority);
 
         if (detachChild)
         {
-            _children.erase(childIt);
+            _eraseChild(childName);
         }
 
         assert(_virtualMountCounter > 0);
@@ -100,96 +115,371 @@ namespace jbkvs
         return detach;
     }
 
-    void StorageNode::_mount(const NodePtr& node, size_t depth, uint32_t priority)
+    void StorageNode::_mount(const NodePtr& node, size_t depth, uint64_t priority, bool lazy)
     {
         std::unique_lock lock(_mutex);
 
-        node->_onMounting(this, depth, priority);
+        Node::MountPoints::iterator mountPoint = node->_onMounting(this, depth, priority);
 
-        auto it = std::lower_bound(_mountedNodes.begin(), _mountedNodes.end(), priority, [](const MountedNode& mountedNode, uint32_t p)
-        {
-            return mountedNode.priority < p;
-        });
+        MountedNodes mountedNodes = _getMountedNodes();
 
-        _mountedNodes.emplace(it, node, depth, priority);
+        mountedNodes.emplace(_findMountedNode(mountedNodes, priority), node, depth, priority, mountPoint);
+        _publishMountedNodes(std::move(mountedNodes));
 
-        for (const auto& [childName, childNode] : node->_children)
+        if (lazy)
         {
-            StorageNodePtr& child = _children[childName];
-            if (!child)
+            if (!_children.empty())
             {
-                child = _create();
+                // Paths resolved below were resolved without the layer; resolving them again through getChild()
+                // materializes it.
+                _context->removalGeneration.fetch_add(1, std::memory_order_release);
             }
+            _pendingLayers.emplace_back(node, depth, priority, mountPoint);
+            return;
+        }
 
-            child->_mount(childNode, depth + 1, priority);
+        for (const auto& [childName, childNode] : node->_children)
+        {
+            _getOrCreateChild(childName)->_mount(childNode, depth + 1, priority, false);
         }
     }
 
-    bool StorageNode::_unmount(const NodePtr& node, size_t depth)
+    bool StorageNode::_unmount(const NodePtr& node, size_t depth, uint64_t priority)
     {
         std::unique_lock lock(_mutex);
 
-        for (auto it = node->_children.rbegin(); it != node->_children.rend(); ++it)
-        {
-            const auto& [childName, childNode] = *it;
+        MountedNodes mountedNodes = _getMountedNodes();
 
-            auto childIt = _children.find(childName);
-            assert(childIt != _children.end());
+        auto it = _findMountedNode(mountedNodes, priority);
+        assert(it != mountedNodes.end() && it->priority == priority && it->node == node && it->depth == depth);
+        Node::MountPoints::iterator mountPoint = it->mountPoint;
 
-            const StorageNodePtr& child = childIt->second;
-            bool detachChild = child->_unmount(childNode, depth + 1);
+        auto pendingIt = std::find_if(_pendingLayers.begin(), _pendingLayers.end(), [&](const MountedNode& pendingLayer)
+        {
+            return pendingLayer.priority == priority && pendingLayer.depth == depth;
+        });
 
-            if (detachChild)
+        if (pendingIt != _pendingLayers.end())
+        {
+            // None of its children was materialized.
+            _pendingLayers.erase(pendingIt);
+        }
+        else
+        {
+            for (const auto& [childName, childNode] : node->_children)
             {
-                _children.erase(childIt);
+                const StorageNodePtr* child = _findChildLayer(childName, priority);
+                if (!child)
+                {
+                    // Attached to the node, but the attachment is still queued.
+                    continue;
+                }
+
+                bool detachChild = (*child)->_unmount(childNode, depth + 1, priority);
+
+                if (detachChild)
+                {
+                    _eraseChild(childName);
+                }
             }
         }
 
-        auto it = std::find_if(_mountedNodes.rbegin(), _mountedNodes.rend(), [&](const MountedNode& mountedNode)
-        {
-            return mountedNode.node == node && mountedNode.depth == depth;
-        });
-        assert(it != _mountedNodes.rend());
+        mountedNodes.erase(it);
+        _publishMountedNodes(std::move(mountedNodes));
 
-        _mountedNodes.erase(std::next(it).base());
-
-        node->_onUnmounted(this, depth);
+        node->_onUnmounted(mountPoint);
 
         bool detach = _isReadyForDetach();
         return detach;
     }
 
-    void StorageNode::_attachMountedNodeChild(size_t depth, uint32_t priority, const std::string& childName, const NodePtr& childNode)
+    void StorageNode::_attachMountedNodeChild(size_t depth, uint64_t priority, Node& parent, const std::string& childName, const NodePtr& childNode)
     {
+        if (_context->changeQueue)
+        {
+            // The layer of the parent keeps this node alive while the parent is locked.
+            _context->changeQueue->push({ shared_from_this(), depth, priority, parent.shared_from_this(), childName, childNode });
+            return;
+        }
+
         std::unique_lock lock(_mutex);
 
-        StorageNodePtr& child = _children[childName];
-        if (!child)
+        if (_isPending(depth, priority))
         {
-            child = _create();
+            // Materialized with the other children of the layer.
+            return;
         }
 
-        child->_mount(childNode, depth + 1, priority);
+        // The node was just created, so it has no children to leave for later.
+        _getOrCreateChild(childName)->_mount(childNode, depth + 1, priority, false);
     }
 
-    void StorageNode::_detachMountedNodeChild(size_t depth, const std::string& childName, const NodePtr& childNode)
+    void StorageNode::_detachMountedNodeChild(size_t depth, uint64_t priority, const std::string& childName, const NodePtr& childNode)
     {
         std::unique_lock lock(_mutex);
 
-        auto childIt = _children.find(childName);
-        assert(childIt != _children.end());
+        if (_isPending(depth, priority))
+        {
+            return;
+        }
 
-        bool detachChild = childIt->second->_unmount(childNode, depth + 1);
+        const StorageNodePtr* child = _findChildLayer(childName, priority);
+        if (!child)
+        {
+            // The queued attachment finds the child detached and is dropped.
+            return;
+        }
+
+        bool detachChild = (*child)->_unmount(childNode, depth + 1, priority);
 
         if (detachChild)
         {
-            _children.erase(childIt);
+            _eraseChild(childName);
+        }
+    }
+
+    void StorageNode::_applyAttachments(std::vector<Attachment>& attachments)
+    {
+        // Groups the attachments by the layer they go to.
+        std::sort(attachments.begin(), attachments.end(), [](const Attachment& left, const Attachment& right)
+        {
+            return std::tie(left.storageNode, left.priority) < std::tie(right.storageNode, right.priority);
+        });
+
+        for (auto begin = attachments.begin(), end = begin; begin != attachments.end(); begin = end)
+        {
+            while (end != attachments.end() && end->storageNode == begin->storageNode && end->priority == begin->priority)
+            {
+                ++end;
+            }
+
+            StorageNode& storageNode = *begin->storageNode;
+            const NodePtr& parent = begin->parent;
+
+            // The parent keeps its children while it is locked. The children are locked one at a time, so that no
+            // order among them is needed.
+            std::shared_lock parentLock(parent->_mutex);
+            for (auto it = begin; it != end; ++it)
+            {
+                const NodePtr* child = parent->_children.find(it->childName);
+                if (!child || *child != it->child)
+                {
+                    // Detached before it was mounted.
+                    continue;
+                }
+
+                std::unique_lock childLock(it->child->_mutex);
+                std::unique_lock lock(storageNode._mutex);
+
+                const MountedNodes& mountedNodes = storageNode._getMountedNodes();
+                bool isMounted = std::any_of(mountedNodes.begin(), mountedNodes.end(), [&](const MountedNode& layer)
+                {
+                    return layer.priority == it->priority && layer.depth == it->depth && layer.node == parent;
+                });
+                if (!isMounted || storageNode._isPending(it->depth, it->priority) || storageNode._findChildLayer(it->childName, it->priority))
+                {
+                    // Unmounted, left for the layer to be expanded, or mounted by its expansion.
+                    continue;
+                }
+
+                // Children attached since it was queued are materialized on demand.
+                bool lazy = !it->child->_children.empty();
+                storageNode._getOrCreateChild(it->childName)->_mount(it->child, it->depth + 1, it->priority, lazy);
+            }
+        }
+    }
+
+    const StorageNodePtr* StorageNode::_findChildLayer(const std::string_view& childName, uint64_t priority) const noexcept
+    {
+        const StorageNodePtr* child = _children.find(childName);
+        if (!child)
+        {
+            return nullptr;
+        }
+
+        // Children only change their layers while this node is locked.
+        const MountedNodes& mountedNodes = (*child)->_getMountedNodes();
+        bool hasLayer = std::any_of(mountedNodes.begin(), mountedNodes.end(), [priority](const MountedNode& layer)
+        {
+            return layer.priority == priority;
+        });
+        return hasLayer ? child : nullptr;
+    }
+
+    void StorageNode::_expand() const
+    {
+        std::vector<MountedNode> pendingLayers;
+        {
+            std::shared_lock lock(_mutex);
+            pendingLayers = _pendingLayers;
+        }
+
+        for (const MountedNode& layer : pendingLayers)
+        {
+            _expandLayer(layer);
+        }
+    }
+
+    void StorageNode::_expandLayer(const MountedNode& layer) const
+    {
+        // Nodes are locked before StorageNodes. The layer keeps its children while it is locked, and the children
+        // are locked for the StorageNodes of this mount to register with them.
+        std::shared_lock layerLock(layer.node->_mutex);
+        std::vector<std::unique_lock<std::shared_mutex>> childLocks;
+        childLocks.reserve(layer.node->_children.size());
+        for (const auto& [childName, childNode] : layer.node->_children)
+        {
+            childLocks.emplace_back(childNode->_mutex);
+        }
+
+        std::unique_lock lock(_mutex);
+
+        auto it = std::find_if(_pendingLayers.begin(), _pendingLayers.end(), [&layer](const MountedNode& pendingLayer)
+        {
+            return pendingLayer.priority == layer.priority && pendingLayer.depth == layer.depth;
+        });
+        if (it == _pendingLayers.end())
+        {
+            // Expanded by another thread, or unmounted.
+            return;
+        }
+        _pendingLayers.erase(it);
+
+        for (const auto& [childName, childNode] : layer.node->_children)
+        {
+            _getOrCreateChild(childName)->_mount(childNode, layer.depth + 1, layer.priority, true);
+        }
+    }
+
+    void StorageNode::_materialize(uint64_t priority) const
+    {
+        std::optional<MountedNode> pendingLayer;
+        {
+            std::shared_lock lock(_mutex);
+
+            auto it = std::find_if(_pendingLayers.begin(), _pendingLayers.end(), [priority](const MountedNode& layer)
+            {
+                return layer.priority == priority;
+            });
+            if (it != _pendingLayers.end())
+            {
+                pendingLayer = *it;
+            }
+        }
+
+        if (pendingLayer)
+        {
+            _expandLayer(*pendingLayer);
         }
+
+        std::vector<StorageNodePtr> children;
+        {
+            std::shared_lock lock(_mutex);
+            detail::EpochGuard guard;
+
+            for (const auto& [childName, child] : _children)
+            {
+                const MountedNodes& mountedNodes = *child->_mountedNodes.load(std::memory_order_acquire);
+                bool isMounted = std::any_of(mountedNodes.begin(), mountedNodes.end(), [priority](const MountedNode& mountedNode)
+                {
+                    return mountedNode.priority == priority;
+                });
+                if (isMounted)
+                {
+                    children.push_back(child);
+                }
+            }
+        }
+
+        for (const StorageNodePtr& child : children)
+        {
+            child->_materialize(priority);
+        }
+    }
+
+    bool StorageNode::_isPending(size_t depth, uint64_t priority) const noexcept
+    {
+        return std::any_of(_pendingLayers.begin(), _pendingLayers.end(), [depth, priority](const MountedNode& pendingLayer)
+        {
+            return pendingLayer.priority == priority && pendingLayer.depth == depth;
+        });
+    }
+
+    bool StorageNode::_isExpanded(size_t depth, uint64_t priority) const
+    {
+        std::shared_lock lock(_mutex);
+
+        return !_isPending(depth, priority);
+    }
+
+    StorageNode::MountedNodes::iterator StorageNode::_findMountedNode(MountedNodes& mountedNodes, uint64_t priority) noexcept
+    {
+        // Sorted by priority, and a mount has one layer per StorageNode at most.
+        return std::lower_bound(mountedNodes.begin(), mountedNodes.end(), priority, [](const MountedNode& mountedNode, uint64_t p)
+        {
+            return mountedNode.priority < p;
+        });
+    }
+
+    const StorageNode::MountedNodes& StorageNode::_getMountedNodes() const noexcept
+    {
+        // Only writers holding _mutex replace the list, so they may access it without a guard.
+        return *_mountedNodes.load(std::memory_order_relaxed);
+    }
+
+    void StorageNode::_publishMountedNodes(MountedNodes&& mountedNodes)
+    {
+        ++mountedNodes.generation;
+        const MountedNodes* oldMountedNodes = _mountedNodes.exchange(new MountedNodes(std::move(mountedNodes)), std::memory_order_acq_rel);
+        detail::Epoch::retire(oldMountedNodes);
     }
 
     bool StorageNode::_isReadyForDetach() const noexcept
     {
-        return _virtualMountCounter == 0 && _mountedNodes.empty();
+        return _virtualMountCounter == 0 && _getMountedNodes().empty();
+    }
+
+    const StorageNodePtr& StorageNode::_getOrCreateChild(const std::string_view& name) const
+    {
+        StorageNodePtr& child = _children[name];
+        if (!child)
+        {
+            child = _create(_context);
+            // Readers that see the new generation walk to the child under _mutex, so they find it mounted.
+            _context->additionGeneration.fetch_add(1, std::memory_order_release);
+        }
+        return child;
+    }
+
+    void StorageNode::_eraseChild(const std::string_view& name)
+    {
+        _children.erase(name);
+        _context->removalGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    StorageNodePtr StorageNode::_resolvePath(const StorageNodePtr& root, const std::string_view& path)
+    {
+        size_t length = path.length();
+
+        StorageNodePtr current = root;
+
+        for (size_t start = 1, end; start < length; start = end + 1)
+        {
+            end = path.find(_pathSeparator, start);
+
+            if (end == std::string_view::npos)
+            {
+                end = length;
+            }
+
+            current = current->getChild(path.substr(start, end - start));
+            if (!current)
+            {
+                return StorageNodePtr();
+            }
+        }
+
+        return current;
     }
 
 } // namespace jbkvs
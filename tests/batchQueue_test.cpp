@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <jbkvs/detail/batchQueue.h>
+
+using jbkvs::detail::BatchQueue;
+
+TEST(BatchQueueTest, FlushWaitsForPushedItems)
+{
+    const size_t itemCount = 10000;
+
+    std::vector<size_t> applied;
+    BatchQueue<size_t> queue([&applied](std::vector<size_t>& batch)
+    {
+        applied.insert(applied.end(), batch.begin(), batch.end());
+    });
+
+    for (size_t i = 0; i < itemCount; ++i)
+    {
+        queue.push(size_t(i));
+    }
+    queue.flush();
+
+    ASSERT_EQ(applied.size(), itemCount);
+    for (size_t i = 0; i < itemCount; ++i)
+    {
+        EXPECT_EQ(applied[i], i);
+    }
+}
+
+TEST(BatchQueueTest, ItemsPushedWhileApplyingFormOneBatch)
+{
+    const size_t itemCount = 100;
+
+    std::atomic<bool> started = false;
+    std::atomic<bool> released = false;
+    std::vector<size_t> batchSizes;
+    BatchQueue<size_t> queue([&](std::vector<size_t>& batch)
+    {
+        started.store(true);
+        while (!released.load())
+        {
+            std::this_thread::yield();
+        }
+        batchSizes.push_back(batch.size());
+    });
+
+    queue.push(0);
+    while (!started.load())
+    {
+        std::this_thread::yield();
+    }
+    for (size_t i = 1; i <= itemCount; ++i)
+    {
+        queue.push(size_t(i));
+    }
+    released.store(true);
+    queue.flush();
+
+    EXPECT_EQ(batchSizes, (std::vector<size_t>{ 1, itemCount }));
+}
+
+TEST(BatchQueueTest, DestructionDropsQueuedItems)
+{
+    const size_t itemCount = 10000;
+
+    std::vector<size_t> applied;
+    {
+        BatchQueue<size_t> queue([&applied](std::vector<size_t>& batch)
+        {
+            applied.insert(applied.end(), batch.begin(), batch.end());
+        });
+
+        for (size_t i = 0; i < itemCount; ++i)
+        {
+            queue.push(size_t(i));
+        }
+    }
+
+    // Whatever was applied before the queue stopped was applied in order.
+    ASSERT_LE(applied.size(), itemCount);
+    for (size_t i = 0; i < applied.size(); ++i)
+    {
+        EXPECT_EQ(applied[i], i);
+    }
+}
@@ -1,16 +1,32 @@
 #include <gtest/gtest.h>
 #include "testUtils.h"
 
+#include <algorithm>
 #include <string>
 #include <thread>
+#include <variant>
 
 #include <jbkvs/detail/concurrentMap.h>
 
 using namespace std::literals::string_literals;
 
-TEST(ConcurrentMapTest, PutChangesState)
+template <typename TMap>
+class ConcurrentMapTest : public testing::Test
 {
-    jbkvs::detail::ConcurrentMap<uint32_t, std::string> map;
+};
+
+using ConcurrentMapImplementations = testing::Types<
+    jbkvs::detail::SharedMutexMap<uint32_t, std::string>,
+    jbkvs::detail::SharedMutexMap<uint32_t, std::string, std::map<uint32_t, std::string, std::less<>>>,
+    jbkvs::detail::LockFreeHashMap<uint32_t, std::string>,
+    jbkvs::detail::ShardedMap<uint32_t, std::string, 8>,
+    jbkvs::detail::PersistentMap<uint32_t, std::string>
+>;
+TYPED_TEST_SUITE(ConcurrentMapTest, ConcurrentMapImplementations);
+
+TYPED_TEST(ConcurrentMapTest, PutChangesState)
+{
+    TypeParam map;
 
     uint32_t key = 123u;
 
@@ -23,9 +39,9 @@ TEST(ConcurrentMapTest, PutChangesState)
     EXPECT_EQ(map.size(), 1);
 }
 
-TEST(ConcurrentMapTest, GetAfterPutReturnsSameData)
+TYPED_TEST(ConcurrentMapTest, GetAfterPutReturnsSameData)
 {
-    jbkvs::detail::ConcurrentMap<uint32_t, std::string> map;
+    TypeParam map;
 
     const uint32_t keyStr = 123u;
     const uint32_t keyRaw = 456u;
@@ -45,9 +61,9 @@ TEST(ConcurrentMapTest, GetAfterPutReturnsSameData)
     EXPECT_EQ(*gotRaw, std::string(dataRaw));
 }
 
-TEST(ConcurrentMapTest, ConcurrentPutWorksWithSeparateKeys)
+TYPED_TEST(ConcurrentMapTest, ConcurrentPutWorksWithSeparateKeys)
 {
-    jbkvs::detail::ConcurrentMap<uint32_t, std::string> map;
+    TypeParam map;
 
     const size_t itemsToBeWrittenByOneThread = 1000;
     const std::string data = "dummy"s;
@@ -85,9 +101,9 @@ TEST(ConcurrentMapTest, ConcurrentPutWorksWithSeparateKeys)
     }
 }
 
-TEST(ConcurrentMapTest, ConcurrentPutWorksWithCollidingKeys)
+TYPED_TEST(ConcurrentMapTest, ConcurrentPutWorksWithCollidingKeys)
 {
-    jbkvs::detail::ConcurrentMap<uint32_t, std::string> map;
+    TypeParam map;
 
     const size_t itemsToBeWrittenByOneThread = 1000;
     const std::string data = "dummy"s;
@@ -125,9 +141,9 @@ TEST(ConcurrentMapTest, ConcurrentPutWorksWithCollidingKeys)
     }
 }
 
-TEST(ConcurrentMapTest, RemoveWorks)
+TYPED_TEST(ConcurrentMapTest, RemoveWorks)
 {
-    jbkvs::detail::ConcurrentMap<uint32_t, std::string> map;
+    TypeParam map;
 
     map.put(123u, "data1"s);
     map.put(456u, "data2"s);
@@ -139,9 +155,9 @@ TEST(ConcurrentMapTest, RemoveWorks)
     EXPECT_EQ(map.size(), 1);
 }
 
-TEST(ConcurrentMapTest, ClearWorks)
+TYPED_TEST(ConcurrentMapTest, ClearWorks)
 {
-    jbkvs::detail::ConcurrentMap<uint32_t, std::string> map;
+    TypeParam map;
 
     map.put(123u, "data1"s);
     map.put(456u, "data2"s);
@@ -152,3 +168,593 @@ TEST(ConcurrentMapTest, ClearWorks)
     EXPECT_EQ(!!map.get(456u), false);
     EXPECT_EQ(map.size(), 0);
 }
+
+TYPED_TEST(ConcurrentMapTest, RemoveOfMissingKeyFails)
+{
+    TypeParam map;
+
+    map.put(123u, "data"s);
+
+    EXPECT_EQ(map.remove(456u), false);
+    EXPECT_EQ(map.remove(123u), true);
+    EXPECT_EQ(map.remove(123u), false);
+    EXPECT_EQ(map.size(), 0);
+}
+
+TYPED_TEST(ConcurrentMapTest, PutAfterRemoveWorks)
+{
+    TypeParam map;
+
+    map.put(123u, "data1"s);
+    map.remove(123u);
+    map.put(123u, "data2"s);
+
+    auto got = map.get(123u);
+    ASSERT_EQ(!!got, true);
+    EXPECT_EQ(*got, "data2"s);
+    EXPECT_EQ(map.size(), 1);
+}
+
+TYPED_TEST(ConcurrentMapTest, IterationVisitsAllItems)
+{
+    TypeParam map;
+
+    const uint32_t itemCount = 10000;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        map.put(key, std::to_string(key));
+    }
+    for (uint32_t key = 0; key < itemCount; key += 2)
+    {
+        map.remove(key);
+    }
+
+    std::vector<bool> visited(itemCount);
+    size_t visitedCount = 0;
+    for (const auto& [key, value] : map)
+    {
+        ASSERT_LT(key, itemCount);
+        EXPECT_EQ(key % 2, 1);
+        EXPECT_EQ(value, std::to_string(key));
+        EXPECT_EQ(visited[key], false);
+        visited[key] = true;
+        ++visitedCount;
+    }
+
+    EXPECT_EQ(visitedCount, itemCount / 2);
+    EXPECT_EQ(map.size(), itemCount / 2);
+}
+
+TYPED_TEST(ConcurrentMapTest, PinReturnsStoredValue)
+{
+    TypeParam map;
+
+    map.put(123u, "123"s);
+
+    auto pinned = map.pin(123u);
+    ASSERT_EQ(!!pinned, true);
+    EXPECT_EQ(*pinned, "123"s);
+
+    auto moved = std::move(pinned);
+    ASSERT_EQ(!!moved, true);
+    EXPECT_EQ(moved->size(), 3u);
+
+    EXPECT_EQ(!!map.pin(456u), false);
+}
+
+TYPED_TEST(ConcurrentMapTest, VisitManyAndPutManyWork)
+{
+    TypeParam map;
+
+    std::vector<std::pair<uint32_t, std::string>> items;
+    for (uint32_t key = 0; key < 100; key += 2)
+    {
+        items.emplace_back(key, std::to_string(key));
+    }
+    items.emplace_back(0u, "last"s);
+    map.putMany(items);
+
+    EXPECT_EQ(map.size(), 50);
+    EXPECT_EQ(*map.get(0u), "last"s);
+
+    std::vector<uint32_t> keys = { 7u, 4u, 98u, 5u, 0u, 4u };
+    std::vector<std::string> results(keys.size());
+    std::vector<bool> visited(keys.size());
+    map.visitMany(keys, [&results, &visited](size_t index, const std::string& value)
+    {
+        EXPECT_EQ(visited[index], false);
+        visited[index] = true;
+        results[index] = value;
+    });
+
+    EXPECT_EQ(visited, std::vector<bool>({ false, true, true, false, true, true }));
+    EXPECT_EQ(results[1], "4"s);
+    EXPECT_EQ(results[2], "98"s);
+    EXPECT_EQ(results[4], "last"s);
+    EXPECT_EQ(results[5], "4"s);
+}
+
+TYPED_TEST(ConcurrentMapTest, VisitWorks)
+{
+    TypeParam map;
+
+    map.put(123u, "123"s);
+
+    std::string visited;
+    EXPECT_EQ(map.visit(123u, [&visited](const std::string& value) { visited = value; }), true);
+    EXPECT_EQ(visited, "123"s);
+
+    EXPECT_EQ(map.visit(456u, [](const std::string& value) { FAIL(); }), false);
+}
+
+TYPED_TEST(ConcurrentMapTest, SnapshotIsNotAffectedByLaterWrites)
+{
+    TypeParam map;
+
+    const uint32_t itemCount = 1000;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        map.put(key, std::to_string(key));
+    }
+
+    auto snapshot = map.snapshot();
+
+    for (uint32_t key = 0; key < itemCount; key += 2)
+    {
+        map.remove(key);
+    }
+    map.put(1u, "changed"s);
+    map.put(itemCount, "added"s);
+
+    EXPECT_EQ(snapshot.size(), itemCount);
+    EXPECT_EQ(*snapshot.get(0u), "0"s);
+    EXPECT_EQ(*snapshot.get(1u), "1"s);
+    EXPECT_EQ(!!snapshot.get(itemCount), false);
+
+    std::vector<bool> visited(itemCount);
+    for (const auto& [key, value] : snapshot)
+    {
+        ASSERT_LT(key, itemCount);
+        EXPECT_EQ(value, std::to_string(key));
+        EXPECT_EQ(visited[key], false);
+        visited[key] = true;
+    }
+    EXPECT_EQ(std::count(visited.begin(), visited.end(), true), itemCount);
+
+    EXPECT_EQ(map.size(), itemCount / 2 + 1);
+    EXPECT_EQ(map.snapshot().size(), itemCount / 2 + 1);
+}
+
+TYPED_TEST(ConcurrentMapTest, ConcurrentPutRemoveAndGetWork)
+{
+    TypeParam map;
+
+    const uint32_t keyCount = 256;
+    const size_t iterationCount = 20000;
+
+    std::thread threads[4];
+    SimpleLatch latch(std::size(threads));
+    std::atomic<bool> failed(false);
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&map, &latch, &failed, threadIndex, keyCount, iterationCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (size_t i = 0; i < iterationCount; ++i)
+            {
+                uint32_t key = uint32_t((i * 7 + threadIndex * 13) % keyCount);
+                switch ((i + threadIndex) % 3)
+                {
+                case 0:
+                    map.put(key, std::to_string(key));
+                    break;
+                case 1:
+                    map.remove(key);
+                    break;
+                default:
+                    auto got = map.get(key);
+                    if (got && *got != std::to_string(key))
+                    {
+                        failed = true;
+                    }
+                    break;
+                }
+            }
+        });
+    }
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex].join();
+    }
+
+    EXPECT_EQ(failed.load(), false);
+
+    size_t presentCount = 0;
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        presentCount += map.get(key) ? 1 : 0;
+    }
+    EXPECT_EQ(map.size(), presentCount);
+}
+
+TYPED_TEST(ConcurrentMapTest, UpdateWorks)
+{
+    TypeParam map;
+
+    map.update(123u, [](std::optional<std::string>& value)
+    {
+        EXPECT_EQ(!!value, false);
+        value = "1"s;
+    });
+    EXPECT_EQ(map.get(123u), "1"s);
+
+    map.update(123u, [](std::optional<std::string>& value)
+    {
+        ASSERT_EQ(!!value, true);
+        *value += "2";
+    });
+    EXPECT_EQ(map.get(123u), "12"s);
+
+    map.update(123u, [](std::optional<std::string>& value) { value.reset(); });
+    EXPECT_EQ(!!map.get(123u), false);
+    EXPECT_EQ(map.size(), 0u);
+
+    map.update(456u, [](std::optional<std::string>& value) {});
+    EXPECT_EQ(!!map.get(456u), false);
+    EXPECT_EQ(map.size(), 0u);
+}
+
+TYPED_TEST(ConcurrentMapTest, ConcurrentUpdatesAreNotLost)
+{
+    TypeParam map;
+
+    const uint32_t keyCount = 8;
+    const size_t iterationCount = 5000;
+
+    std::thread threads[4];
+    SimpleLatch latch(std::size(threads));
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&map, &latch, keyCount, iterationCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (size_t i = 0; i < iterationCount; ++i)
+            {
+                map.update(uint32_t(i % keyCount), [](std::optional<std::string>& value)
+                {
+                    value = std::to_string(value ? std::stoul(*value) + 1 : 1);
+                });
+            }
+        });
+    }
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex].join();
+    }
+
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        EXPECT_EQ(map.get(key), std::to_string(std::size(threads) * iterationCount / keyCount));
+    }
+}
+
+TEST(LockFreeHashMapTest, ConcurrentUpdatesOfInlineValuesAreNotLost)
+{
+    using TValue = std::variant<uint64_t, std::string>;
+    jbkvs::detail::LockFreeHashMap<uint32_t, TValue> map;
+
+    const uint32_t keyCount = 4;
+    const uint64_t iterationCount = 20000;
+
+    std::thread threads[4];
+    SimpleLatch latch(std::size(threads));
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&map, &latch, threadIndex, keyCount, iterationCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (uint64_t i = 0; i < iterationCount; ++i)
+            {
+                uint32_t key = uint32_t(i % keyCount);
+                if (threadIndex == 0 && i % 101 == 0)
+                {
+                    // Removals and heap-allocated values of other keys interleave with the increments.
+                    map.update(key + keyCount, [](std::optional<TValue>& value) { value.reset(); });
+                    map.put(key + keyCount, TValue("text"s));
+                }
+
+                map.update(key, [](std::optional<TValue>& value)
+                {
+                    value = TValue(value ? std::get<uint64_t>(*value) + 1 : 1);
+                });
+            }
+        });
+    }
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex].join();
+    }
+
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        auto got = map.get(key);
+        ASSERT_EQ(!!got, true);
+        EXPECT_EQ(std::get<uint64_t>(*got), std::size(threads) * iterationCount / keyCount);
+    }
+    EXPECT_EQ(map.size(), keyCount * 2);
+}
+
+TEST(LockFreeHashMapTest, ReadersDoNotWaitForUpdater)
+{
+    jbkvs::detail::LockFreeHashMap<uint32_t, uint64_t> map;
+    map.put(1u, 10u);
+
+    std::atomic<bool> updating(false);
+    std::atomic<bool> read(false);
+    std::thread updater([&map, &updating, &read]()
+    {
+        map.update(1u, [&updating, &read](std::optional<uint64_t>& value)
+        {
+            updating = true;
+            while (!read.load())
+            {
+                std::this_thread::yield();
+            }
+            *value += 1;
+        });
+    });
+
+    while (!updating.load())
+    {
+        std::this_thread::yield();
+    }
+
+    // Would never return if the read waited for the updater.
+    EXPECT_EQ(map.get(1u), 10u);
+    read = true;
+    updater.join();
+
+    EXPECT_EQ(map.get(1u), 11u);
+}
+
+TEST(LockFreeHashMapTest, ScalarAndStringValuesCanReplaceEachOther)
+{
+    using TValue = std::variant<uint64_t, double, std::string>;
+    jbkvs::detail::LockFreeHashMap<uint32_t, TValue> map;
+
+    const uint32_t keyCount = 16;
+    const uint64_t iterationCount = 20000;
+
+    std::thread threads[4];
+    SimpleLatch latch(std::size(threads));
+    std::atomic<bool> failed(false);
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&map, &latch, &failed, threadIndex, keyCount, iterationCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (uint64_t i = 0; i < iterationCount; ++i)
+            {
+                uint32_t key = uint32_t(i % keyCount);
+                if (threadIndex < 2)
+                {
+                    // Both halves of an integer are equal, so a torn read would be detected.
+                    switch (i % 3)
+                    {
+                    case 0:
+                        map.put(key, TValue(uint64_t(i << 32 | i)));
+                        break;
+                    case 1:
+                        map.put(key, TValue(double(i)));
+                        break;
+                    default:
+                        map.put(key, TValue(std::to_string(i)));
+                        break;
+                    }
+                    continue;
+                }
+
+                auto got = map.get(key);
+                if (!got)
+                {
+                    continue;
+                }
+                if (const uint64_t* integer = std::get_if<uint64_t>(&*got); integer && (*integer >> 32) != (*integer & 0xFFFFFFFF))
+                {
+                    failed = true;
+                }
+                if (const double* real = std::get_if<double>(&*got); real && uint64_t(*real) % 3 != 1)
+                {
+                    failed = true;
+                }
+            }
+        });
+    }
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex].join();
+    }
+
+    EXPECT_EQ(failed.load(), false);
+
+    map.put(0u, TValue(uint64_t(7)));
+    map.put(1u, TValue(2.5));
+    map.put(2u, TValue("text"s));
+
+    size_t visitedCount = 0;
+    for (const auto& [key, value] : map)
+    {
+        if (key == 0u)
+        {
+            EXPECT_EQ(std::get<uint64_t>(value), 7u);
+        }
+        else if (key == 1u)
+        {
+            EXPECT_EQ(std::get<double>(value), 2.5);
+        }
+        else if (key == 2u)
+        {
+            EXPECT_EQ(std::get<std::string>(value), "text"s);
+        }
+        ++visitedCount;
+    }
+    EXPECT_EQ(visitedCount, keyCount);
+    EXPECT_EQ(map.size(), keyCount);
+}
+
+TEST(LockFreeHashMapTest, PinnedValueSurvivesRemoval)
+{
+    jbkvs::detail::LockFreeHashMap<uint32_t, std::string> map;
+
+    map.put(123u, "some long long long string"s);
+
+    auto pinned = map.pin(123u);
+    ASSERT_EQ(!!pinned, true);
+
+    map.put(123u, "other"s);
+    map.remove(123u);
+    jbkvs::detail::Epoch::collect();
+    jbkvs::detail::Epoch::collect();
+    jbkvs::detail::Epoch::collect();
+
+    EXPECT_EQ(*pinned, "some long long long string"s);
+    EXPECT_EQ(!!map.pin(123u), false);
+}
+
+TEST(LockFreeHashMapTest, MissedPinHoldsNoGuard)
+{
+    struct Tracked
+    {
+        bool& destroyed;
+
+        explicit Tracked(bool& destroyed) : destroyed(destroyed) {}
+        ~Tracked() { destroyed = true; }
+    };
+
+    jbkvs::detail::LockFreeHashMap<uint32_t, std::string> map;
+
+    auto pinned = map.pin(123u);
+    ASSERT_EQ(!!pinned, false);
+
+    bool destroyed = false;
+    jbkvs::detail::Epoch::retire(new Tracked(destroyed));
+    jbkvs::detail::Epoch::collect();
+    jbkvs::detail::Epoch::collect();
+    jbkvs::detail::Epoch::collect();
+
+    EXPECT_EQ(destroyed, true);
+}
+
+TEST(LockFreeHashMapTest, PinOfInlineValueHoldsCopy)
+{
+    jbkvs::detail::LockFreeHashMap<uint32_t, uint64_t> map;
+
+    map.put(123u, 456u);
+
+    auto pinned = map.pin(123u);
+    map.put(123u, 789u);
+
+    auto moved = std::move(pinned);
+    ASSERT_EQ(!!moved, true);
+    EXPECT_EQ(*moved, 456u);
+    EXPECT_EQ(*map.pin(123u), 789u);
+}
+
+TEST(PersistentMapTest, SnapshotsStayConsistentUnderConcurrentWrites)
+{
+    jbkvs::detail::PersistentMap<uint32_t, uint64_t> map;
+
+    const uint32_t keyCount = 64;
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        map.put(key, 0u);
+    }
+
+    std::atomic<bool> stopped(false);
+    std::thread writerThread([&map, &stopped, keyCount]()
+    {
+        // Every round moves all keys to the next generation, one at a time.
+        for (uint64_t generation = 1; !stopped.load(); ++generation)
+        {
+            for (uint32_t key = 0; key < keyCount; ++key)
+            {
+                map.put(key, generation);
+            }
+        }
+    });
+
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        auto snapshot = map.snapshot();
+
+        // Keys are written in order, so a consistent snapshot sees non-increasing generations spanning at most one.
+        uint64_t first = *snapshot.get(0u);
+        uint64_t previous = first;
+        for (uint32_t key = 1; key < keyCount; ++key)
+        {
+            uint64_t current = *snapshot.get(key);
+            EXPECT_LE(current, previous);
+            EXPECT_LE(first - current, 1u);
+            previous = current;
+        }
+        EXPECT_EQ(snapshot.size(), keyCount);
+    }
+
+    stopped = true;
+    writerThread.join();
+}
+
+TEST(PersistentMapTest, CollidingHashesAreSupported)
+{
+    struct CollidingHash
+    {
+        size_t operator()(uint32_t key) const noexcept { return key % 4; }
+    };
+
+    jbkvs::detail::PersistentMap<uint32_t, uint32_t, CollidingHash> map;
+
+    for (uint32_t key = 0; key < 100; ++key)
+    {
+        map.put(key, key);
+    }
+    auto snapshot = map.snapshot();
+    for (uint32_t key = 0; key < 100; key += 3)
+    {
+        EXPECT_EQ(map.remove(key), true);
+    }
+
+    for (uint32_t key = 0; key < 100; ++key)
+    {
+        EXPECT_EQ(!!map.get(key), key % 3 != 0);
+        EXPECT_EQ(*snapshot.get(key), key);
+    }
+    EXPECT_EQ(map.size(), 66);
+    EXPECT_EQ(snapshot.size(), 100);
+
+    jbkvs::detail::PersistentMapBuilder<uint32_t, uint32_t, CollidingHash> builder;
+    for (uint32_t key = 0; key < 100; ++key)
+    {
+        builder.add(key, key);
+    }
+    auto built = builder.build();
+    size_t count = 0;
+    for (const auto& [key, value] : built)
+    {
+        EXPECT_EQ(key, value);
+        ++count;
+    }
+    EXPECT_EQ(count, 100);
+    EXPECT_EQ(*built.get(42u), 42u);
+}
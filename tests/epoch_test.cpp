@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "testUtils.h"
+
+#include <thread>
+
+#include <jbkvs/detail/epoch.h>
+
+namespace
+{
+
+    struct Tracked
+    {
+        std::atomic<size_t>& destroyed;
+
+        explicit Tracked(std::atomic<size_t>& destroyed) : destroyed(destroyed) {}
+        ~Tracked() { ++destroyed; }
+    };
+
+    void _collectRepeatedly()
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            jbkvs::detail::Epoch::collect();
+        }
+    }
+
+} // namespace
+
+TEST(EpochTest, RetiredObjectIsEventuallyDestroyed)
+{
+    std::atomic<size_t> destroyed(0);
+
+    jbkvs::detail::Epoch::retire(new Tracked(destroyed));
+    _collectRepeatedly();
+
+    EXPECT_EQ(destroyed.load(), 1);
+}
+
+TEST(EpochTest, RetiredObjectOutlivesGuardOfAnotherThread)
+{
+    std::atomic<size_t> destroyed(0);
+    SimpleLatch pinned(2);
+    std::atomic<bool> release(false);
+
+    std::thread reader([&pinned, &release]()
+    {
+        jbkvs::detail::EpochGuard guard;
+        pinned.arrive_and_wait();
+        while (!release.load())
+        {
+            std::this_thread::yield();
+        }
+    });
+
+    pinned.arrive_and_wait();
+
+    jbkvs::detail::Epoch::retire(new Tracked(destroyed));
+    _collectRepeatedly();
+
+    EXPECT_EQ(destroyed.load(), 0);
+
+    release = true;
+    reader.join();
+
+    _collectRepeatedly();
+
+    EXPECT_EQ(destroyed.load(), 1);
+}
+
+TEST(EpochTest, NestedGuardsWork)
+{
+    std::atomic<size_t> destroyed(0);
+
+    {
+        jbkvs::detail::EpochGuard outer;
+        {
+            jbkvs::detail::EpochGuard inner;
+        }
+
+        jbkvs::detail::Epoch::retire(new Tracked(destroyed));
+        _collectRepeatedly();
+
+        EXPECT_EQ(destroyed.load(), 0);
+    }
+
+    _collectRepeatedly();
+
+    EXPECT_EQ(destroyed.load(), 1);
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <jbkvs/detail/flatHashMap.h>
+
+using namespace std::literals::string_literals;
+
+TEST(FlatHashMapTest, InsertAndFindWork)
+{
+    jbkvs::detail::FlatHashMap<uint32_t, std::string> map;
+
+    EXPECT_EQ(map.find(123u), map.end());
+
+    map[123u] = "data"s;
+
+    auto it = map.find(123u);
+    ASSERT_NE(it, map.end());
+    EXPECT_EQ(it->first, 123u);
+    EXPECT_EQ(it->second, "data"s);
+    EXPECT_EQ(map.size(), 1);
+}
+
+TEST(FlatHashMapTest, GrowthPreservesItems)
+{
+    jbkvs::detail::FlatHashMap<uint32_t, std::string> map;
+
+    const uint32_t itemCount = 100000;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        map[key * 7919u] = std::to_string(key);
+    }
+
+    ASSERT_EQ(map.size(), itemCount);
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        auto it = map.find(key * 7919u);
+        ASSERT_NE(it, map.end());
+        EXPECT_EQ(it->second, std::to_string(key));
+    }
+}
+
+TEST(FlatHashMapTest, EraseWorks)
+{
+    jbkvs::detail::FlatHashMap<uint32_t, std::string> map;
+
+    map[123u] = "data1"s;
+    map[456u] = "data2"s;
+
+    EXPECT_EQ(map.erase(123u), 1);
+    EXPECT_EQ(map.erase(123u), 0);
+    EXPECT_EQ(map.find(123u), map.end());
+    EXPECT_NE(map.find(456u), map.end());
+    EXPECT_EQ(map.size(), 1);
+}
+
+TEST(FlatHashMapTest, ChurnDoesNotGrowCapacityIndefinitely)
+{
+    jbkvs::detail::FlatHashMap<uint32_t, uint64_t> map;
+
+    // Keys keep changing while the size stays constant, which leaves tombstones behind.
+    const uint32_t liveCount = 1000;
+    for (uint32_t key = 0; key < 200000; ++key)
+    {
+        map[key] = key;
+        if (key >= liveCount)
+        {
+            ASSERT_EQ(map.erase(key - liveCount), 1);
+        }
+    }
+
+    EXPECT_EQ(map.size(), liveCount);
+    for (uint32_t key = 200000 - liveCount; key < 200000; ++key)
+    {
+        auto it = map.find(key);
+        ASSERT_NE(it, map.end());
+        EXPECT_EQ(it->second, key);
+    }
+}
+
+TEST(FlatHashMapTest, IterationVisitsAllItems)
+{
+    jbkvs::detail::FlatHashMap<uint32_t, uint32_t> map;
+
+    const uint32_t itemCount = 1000;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        map[key] = key * 2;
+    }
+
+    std::vector<bool> visited(itemCount);
+    for (const auto& [key, value] : map)
+    {
+        ASSERT_LT(key, itemCount);
+        EXPECT_EQ(value, key * 2);
+        EXPECT_EQ(visited[key], false);
+        visited[key] = true;
+    }
+    EXPECT_EQ(std::count(visited.begin(), visited.end(), true), itemCount);
+}
+
+TEST(FlatHashMapTest, ClearDestroysItems)
+{
+    auto item = std::make_shared<int>(1);
+
+    jbkvs::detail::FlatHashMap<uint32_t, std::shared_ptr<int>> map;
+    for (uint32_t key = 0; key < 100; ++key)
+    {
+        map[key] = item;
+    }
+    EXPECT_EQ(item.use_count(), 101);
+
+    map.clear();
+
+    EXPECT_EQ(item.use_count(), 1);
+    EXPECT_EQ(map.size(), 0);
+    EXPECT_EQ(map.begin(), map.end());
+
+    map[1u] = item;
+    EXPECT_EQ(item.use_count(), 2);
+}
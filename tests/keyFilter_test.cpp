@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "testUtils.h"
+
+#include <thread>
+
+#include <jbkvs/detail/keyFilter.h>
+
+using KeyFilter = jbkvs::detail::KeyFilter<uint32_t>;
+
+TEST(KeyFilterTest, AddedKeysAreNeverMissedAcrossGrowth)
+{
+    KeyFilter filter;
+
+    const uint32_t keyCount = 100000;
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        if (filter.add(key) && key + 1 > filter.getCapacity())
+        {
+            filter.grow();
+        }
+    }
+    EXPECT_GE(filter.getCapacity(), keyCount);
+
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        EXPECT_EQ(filter.mayContain(key), true);
+    }
+
+    size_t falsePositiveCount = 0;
+    for (uint32_t key = keyCount; key < 2 * keyCount; ++key)
+    {
+        falsePositiveCount += filter.mayContain(key) ? 1 : 0;
+    }
+    EXPECT_LT(falsePositiveCount, keyCount / 20);
+
+    KeyFilter::Statistics statistics = filter.getStatistics();
+    EXPECT_GT(statistics.segmentCount, 1);
+    EXPECT_GT(statistics.setBitCount, 0);
+    EXPECT_LT(statistics.setBitCount, statistics.bitCount);
+    EXPECT_LT(statistics.estimatedFalsePositiveRate, 0.05);
+    EXPECT_EQ(statistics.falsePositiveCount, 0);
+
+    filter.reportFalsePositive();
+    EXPECT_EQ(filter.getStatistics().falsePositiveCount, 1);
+}
+
+TEST(KeyFilterTest, ConcurrentAddsAreVisibleToQueries)
+{
+    KeyFilter filter;
+
+    const uint32_t keyCount = 50000;
+    std::atomic<uint32_t> addedKeyCounts[4] = {};
+
+    std::thread threads[std::size(addedKeyCounts)];
+    SimpleLatch latch(std::size(threads) + 1);
+    std::atomic<bool> failed(false);
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&filter, &latch, &addedKeyCounts, threadIndex, keyCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (uint32_t i = 0; i < keyCount; ++i)
+            {
+                uint32_t key = uint32_t(threadIndex * keyCount + i);
+                if (filter.add(key))
+                {
+                    filter.grow();
+                }
+                addedKeyCounts[threadIndex].store(i + 1, std::memory_order_release);
+            }
+        });
+    }
+
+    latch.arrive_and_wait();
+
+    for (size_t round = 0; round < 20000; ++round)
+    {
+        size_t threadIndex = round % std::size(threads);
+        uint32_t addedKeyCount = addedKeyCounts[threadIndex].load(std::memory_order_acquire);
+        if (addedKeyCount && !filter.mayContain(uint32_t(threadIndex * keyCount + round % addedKeyCount)))
+        {
+            failed = true;
+        }
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(failed.load(), false);
+    for (uint32_t key = 0; key < std::size(threads) * keyCount; ++key)
+    {
+        EXPECT_EQ(filter.mayContain(key), true);
+    }
+}
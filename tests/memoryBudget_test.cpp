@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include "testUtils.h"
+
+#include <string>
+#include <thread>
+
+#include <jbkvs/memoryBudget.h>
+#include <jbkvs/node.h>
+
+using namespace std::literals::string_literals;
+
+TEST(MemoryBudgetTest, UsageCoversNodesKeysAndValues)
+{
+    jbkvs::MemoryBudgetPtr budget = jbkvs::MemoryBudget::create(1 << 20);
+
+    {
+        jbkvs::NodePtr root = jbkvs::Node::create(budget);
+        size_t emptyUsage = budget->getUsage();
+        EXPECT_GT(emptyUsage, 0);
+
+        jbkvs::NodePtr child = jbkvs::Node::create(root, "child");
+        EXPECT_EQ(child->getMemoryBudget(), budget);
+        size_t usageWithChild = budget->getUsage();
+        EXPECT_GT(usageWithChild, emptyUsage);
+
+        std::string value(1000, 'x');
+        child->put(1u, value);
+        EXPECT_GE(budget->getUsage(), usageWithChild + value.size());
+
+        uint8_t data[5000] = {};
+        root->put(2u, jbkvs::types::Blob::create(data, sizeof(data)));
+        EXPECT_GE(budget->getUsage(), usageWithChild + value.size() + sizeof(data));
+
+        child->put(1u, 1u);
+        root->remove(2u);
+        EXPECT_LT(budget->getUsage(), usageWithChild + 100);
+
+        child->put(1u, value);
+        child->detach();
+    }
+
+    EXPECT_EQ(budget->getUsage(), 0);
+}
+
+TEST(MemoryBudgetTest, EvictionKeepsUsageNearLimitAndSparesReadKeys)
+{
+    const size_t limit = 64 * 1024;
+    jbkvs::MemoryBudgetPtr budget = jbkvs::MemoryBudget::create(limit);
+    jbkvs::NodePtr root = jbkvs::Node::create(budget);
+
+    const uint32_t itemCount = 2000;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        EXPECT_EQ(root->put(key, std::string(100, 'x')), true);
+
+        for (uint32_t hotKey = 0; hotKey < 10 && hotKey <= key; ++hotKey)
+        {
+            EXPECT_EQ(!!root->get<std::string>(hotKey), true);
+        }
+    }
+
+    EXPECT_LE(budget->getUsage(), limit + limit / 10);
+
+    size_t presentCount = 0;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        presentCount += root->contains<std::string>(key) ? 1 : 0;
+    }
+    EXPECT_GT(presentCount, 0);
+    EXPECT_LT(presentCount, itemCount);
+
+    for (uint32_t hotKey = 0; hotKey < 10; ++hotKey)
+    {
+        EXPECT_EQ(root->contains<std::string>(hotKey), true);
+    }
+}
+
+TEST(MemoryBudgetTest, ChurningKeysUnderLimitKeepsTrackedKeysBounded)
+{
+    jbkvs::MemoryBudgetPtr budget = jbkvs::MemoryBudget::create(1 << 20);
+    jbkvs::NodePtr root = jbkvs::Node::create(budget);
+
+    const uint32_t liveKeyCount = 100;
+    for (uint32_t key = 0; key < liveKeyCount; ++key)
+    {
+        root->put(key, key);
+    }
+
+    for (uint32_t i = 0; i < 20000; ++i)
+    {
+        // The same key put again after a removal, and a key that is new every time.
+        uint32_t key = i % liveKeyCount;
+        root->remove(key);
+        root->put(key, i);
+
+        root->put(liveKeyCount + i, i);
+        root->remove(liveKeyCount + i);
+
+        // Entries of nodes that are gone are dropped too.
+        jbkvs::NodePtr child = jbkvs::Node::create(root, "child");
+        child->put(1u, i);
+        child->detach();
+    }
+
+    EXPECT_LT(budget->getUsage(), budget->getLimit());
+    EXPECT_LE(budget->getTrackedKeyCount(), 4096);
+}
+
+TEST(MemoryBudgetTest, NestedEvictingBudgetsKeepTrackedKeysBounded)
+{
+    jbkvs::MemoryBudgetPtr parent = jbkvs::MemoryBudget::create(1 << 30);
+    jbkvs::MemoryBudgetPtr child = jbkvs::MemoryBudget::create(4000, jbkvs::MemoryBudget::Policy::Evict, parent);
+    jbkvs::NodePtr root = jbkvs::Node::create(child);
+
+    const uint32_t hotKeyCount = 8;
+    const uint32_t fillerKeyCount = 64;
+    for (uint32_t i = 0; i < 20000; ++i)
+    {
+        // The child evicts, so its hand drops the entries of the removed keys while the parent keeps them.
+        uint32_t hotKey = i % hotKeyCount;
+        root->remove(hotKey);
+        root->put(hotKey, i);
+        root->put(hotKeyCount + i % fillerKeyCount, i);
+    }
+
+    EXPECT_LE(child->getUsage(), child->getLimit() + child->getLimit() / 10);
+    EXPECT_LE(parent->getTrackedKeyCount(), 4096);
+    EXPECT_LE(child->getTrackedKeyCount(), 4096);
+}
+
+TEST(MemoryBudgetTest, RejectPolicyFailsWritesOverLimit)
+{
+    const size_t limit = 16 * 1024;
+    jbkvs::MemoryBudgetPtr budget = jbkvs::MemoryBudget::create(limit, jbkvs::MemoryBudget::Policy::Reject);
+    jbkvs::NodePtr root = jbkvs::Node::create(budget);
+
+    uint32_t storedCount = 0;
+    while (root->put(storedCount, std::string(100, 'x')))
+    {
+        ++storedCount;
+    }
+    EXPECT_GT(storedCount, 0);
+    EXPECT_LE(budget->getUsage(), limit + limit / 10);
+
+    for (uint32_t key = 0; key < storedCount; ++key)
+    {
+        EXPECT_EQ(root->contains<std::string>(key), true);
+    }
+
+    // Writes that don't grow the usage still succeed.
+    EXPECT_EQ(root->put(0u, "small"s), true);
+    EXPECT_EQ(root->update(1u, [](auto& value) { value.reset(); }), true);
+    EXPECT_EQ(root->contains<std::string>(1u), false);
+
+    EXPECT_EQ(root->update(0u, [](auto& value) { value = std::string(100000, 'x'); }), false);
+    EXPECT_EQ(root->get<std::string>(0u), "small"s);
+
+    EXPECT_EQ(!!jbkvs::Node::create(root, std::string(100000, 'x')), false);
+}
+
+TEST(MemoryBudgetTest, ParentBudgetCapsAllChildBudgets)
+{
+    const size_t limit = 16 * 1024;
+    jbkvs::MemoryBudgetPtr storageBudget = jbkvs::MemoryBudget::create(limit, jbkvs::MemoryBudget::Policy::Reject);
+    jbkvs::NodePtr firstRoot = jbkvs::Node::create(jbkvs::MemoryBudget::create(1 << 20, jbkvs::MemoryBudget::Policy::Evict, storageBudget));
+    jbkvs::NodePtr secondRoot = jbkvs::Node::create(jbkvs::MemoryBudget::create(1 << 20, jbkvs::MemoryBudget::Policy::Evict, storageBudget));
+
+    uint32_t storedCount = 0;
+    while (firstRoot->put(storedCount, std::string(100, 'x')) && secondRoot->put(storedCount, std::string(100, 'x')))
+    {
+        ++storedCount;
+    }
+    EXPECT_GT(storedCount, 0);
+    EXPECT_LE(storageBudget->getUsage(), limit + limit / 10);
+    EXPECT_EQ(storageBudget->getUsage(), firstRoot->getMemoryBudget()->getUsage() + secondRoot->getMemoryBudget()->getUsage());
+}
+
+TEST(MemoryBudgetTest, ConcurrentPutsWithEvictionWork)
+{
+    const size_t limit = 256 * 1024;
+    jbkvs::MemoryBudgetPtr budget = jbkvs::MemoryBudget::create(limit);
+    jbkvs::NodePtr root = jbkvs::Node::create(budget);
+
+    const uint32_t iterationCount = 20000;
+
+    std::thread threads[4];
+    SimpleLatch latch(std::size(threads));
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&root, &latch, threadIndex, iterationCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (uint32_t i = 0; i < iterationCount; ++i)
+            {
+                uint32_t key = uint32_t(threadIndex * iterationCount + i);
+                root->put(key, std::string(100, 'x'));
+                root->get<std::string>(key / 2);
+                if (i % 7 == 0)
+                {
+                    root->remove(key - 3);
+                }
+            }
+        });
+    }
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex].join();
+    }
+
+    // Stripes of other threads are folded late, so eviction may stop short of the limit by a few fold thresholds.
+    EXPECT_LE(budget->getUsage(), limit + limit / 4);
+
+    root.reset();
+    EXPECT_EQ(budget->getUsage(), 0);
+}
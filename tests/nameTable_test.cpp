@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jbkvs/detail/childrenMap.h>
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/nameTable.h>
+#include <jbkvs/detail/reclaimer.h>
+
+using jbkvs::detail::ChildrenMap;
+using jbkvs::detail::EpochGuard;
+using jbkvs::detail::InternedName;
+using jbkvs::detail::NameTable;
+using jbkvs::detail::Reclaimer;
+
+TEST(NameTableTest, EqualStringsShareANameUntilReleased)
+{
+    // Nodes of earlier tests destroyed in the background release names meanwhile.
+    Reclaimer::drain();
+    size_t size = NameTable::getSize();
+
+    const InternedName* name = NameTable::acquire("nameTableTest");
+    const InternedName* sameName = NameTable::acquire(std::string("nameTable") + "Test");
+    const InternedName* otherName = NameTable::acquire("nameTableTest2");
+
+    EXPECT_EQ(name, sameName);
+    EXPECT_NE(name, otherName);
+    EXPECT_EQ(name->getValue(), "nameTableTest");
+    EXPECT_EQ(NameTable::getSize(), size + 2);
+
+    NameTable::release(sameName);
+    NameTable::release(otherName);
+    {
+        EpochGuard guard;
+        EXPECT_EQ(NameTable::find("nameTableTest"), name);
+        EXPECT_EQ(NameTable::find("nameTableTest2"), nullptr);
+    }
+
+    NameTable::release(name);
+    {
+        EpochGuard guard;
+        EXPECT_EQ(NameTable::find("nameTableTest"), nullptr);
+    }
+    EXPECT_EQ(NameTable::getSize(), size);
+}
+
+TEST(NameTableTest, ConcurrentHoldersShareNames)
+{
+    const size_t threadCount = 8;
+    const size_t nameCount = 64;
+    const size_t iterations = 20000;
+
+    Reclaimer::drain();
+    size_t size = NameTable::getSize();
+
+    // Holds every name for the whole test, so that the threads must always see the same names.
+    std::vector<const InternedName*> pinnedNames;
+    for (size_t i = 0; i < nameCount; i += 2)
+    {
+        pinnedNames.push_back(NameTable::acquire("pinned" + std::to_string(i)));
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                size_t index = (i * 7 + t) % nameCount;
+                std::string value = "pinned" + std::to_string(index);
+
+                const InternedName* name = NameTable::acquire(value);
+                ASSERT_EQ(name->getValue(), value);
+                if (index % 2 == 0)
+                {
+                    ASSERT_EQ(name, pinnedNames[index / 2]);
+                }
+                NameTable::release(name);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(NameTable::getSize(), size + nameCount / 2);
+    for (const InternedName* name : pinnedNames)
+    {
+        NameTable::release(name);
+    }
+    EXPECT_EQ(NameTable::getSize(), size);
+}
+
+TEST(NameTableTest, ChildrenMapFindsIteratesAndErasesByName)
+{
+    const size_t childCount = 10000;
+
+    Reclaimer::drain();
+    size_t size = NameTable::getSize();
+    {
+        ChildrenMap<int> children;
+        for (size_t i = 0; i < childCount; ++i)
+        {
+            children["child" + std::to_string(i)] = int(i);
+        }
+        EXPECT_EQ(children.size(), childCount);
+        EXPECT_EQ(NameTable::getSize(), size + childCount);
+
+        ASSERT_NE(children.find("child42"), nullptr);
+        EXPECT_EQ(*children.find("child42"), 42);
+        EXPECT_EQ(children.find("child10000"), nullptr);
+
+        std::map<std::string, int> iterated;
+        for (const auto& [name, value] : children)
+        {
+            iterated.emplace(name, value);
+        }
+        ASSERT_EQ(iterated.size(), childCount);
+        EXPECT_EQ(iterated["child1234"], 1234);
+
+        EXPECT_TRUE(children.erase("child42"));
+        EXPECT_FALSE(children.erase("child42"));
+        EXPECT_FALSE(children.erase("child10000"));
+        EXPECT_EQ(children.find("child42"), nullptr);
+        EXPECT_EQ(children.size(), childCount - 1);
+        EXPECT_EQ(NameTable::getSize(), size + childCount - 1);
+    }
+    EXPECT_EQ(NameTable::getSize(), size);
+}
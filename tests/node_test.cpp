@@ -3,6 +3,9 @@
 
 #include <thread>
 
+#include <jbkvs/detail/epoch.h>
+#include <jbkvs/detail/expiryReaper.h>
+#include <jbkvs/detail/reclaimer.h>
 #include <jbkvs/node.h>
 #include <jbkvs/storage.h>
 
@@ -229,6 +232,376 @@ TEST(NodeTest, MultipleValueTypesAreSupported)
     }
 }
 
+TEST(NodeTest, ViewReturnsStoredValues)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    std::string s = "some long long long string"s;
+    uint8_t blobData[] = { 0, 1, 2, 3 };
+    jbkvs::types::BlobPtr blob = jbkvs::types::Blob::create(blobData, std::size(blobData));
+
+    node->put(1u, 456u);
+    node->put(2u, s);
+    node->put(3u, blob);
+
+    {
+        auto view = node->view<uint32_t>(1u);
+        ASSERT_EQ(!!view, true);
+        EXPECT_EQ(*view, 456u);
+    }
+
+    {
+        auto view = node->view<std::string>(2u);
+        ASSERT_EQ(!!view, true);
+        EXPECT_EQ(std::string_view(*view), s);
+        EXPECT_EQ(view->size(), s.size());
+    }
+
+    {
+        auto view = node->view<jbkvs::types::BlobPtr>(3u);
+        ASSERT_EQ(!!view, true);
+        EXPECT_EQ((*view)->data(), blob->data());
+        EXPECT_EQ(blob.use_count(), 2);
+    }
+
+    EXPECT_EQ(!!node->view<std::string>(1u), false);
+    EXPECT_EQ(!!node->view<uint32_t>(2u), false);
+    EXPECT_EQ(!!node->view<uint32_t>(4u), false);
+}
+
+TEST(NodeTest, GetManyAndPutManyWork)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->putMany(std::vector<std::pair<uint32_t, uint32_t>>({ { 1u, 10u }, { 2u, 20u }, { 3u, 30u } }));
+    node->put(4u, "string"s);
+
+    std::vector<std::optional<uint32_t>> results;
+    node->getMany(std::vector<uint32_t>({ 3u, 4u, 5u, 1u }), results);
+
+    ASSERT_EQ(results.size(), 4);
+    EXPECT_EQ(results[0], std::optional<uint32_t>(30u));
+    EXPECT_EQ(results[1], std::optional<uint32_t>());
+    EXPECT_EQ(results[2], std::optional<uint32_t>());
+    EXPECT_EQ(results[3], std::optional<uint32_t>(10u));
+}
+
+TEST(NodeTest, VisitAndContainsWork)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->put(1u, 456u);
+    node->put(2u, "string"s);
+
+    size_t visitedSize = 0;
+    bool visited = node->visit(2u, [&visitedSize](const auto& value)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>)
+        {
+            visitedSize = value.size();
+        }
+    });
+    EXPECT_EQ(visited, true);
+    EXPECT_EQ(visitedSize, 6);
+
+    EXPECT_EQ(node->visit(3u, [](const auto& value) { FAIL(); }), false);
+
+    EXPECT_EQ(node->contains<uint32_t>(1u), true);
+    EXPECT_EQ(node->contains<std::string>(1u), false);
+    EXPECT_EQ(node->contains<std::string>(2u), true);
+    EXPECT_EQ(node->contains<std::string>(3u), false);
+}
+
+TEST(NodeTest, FetchAddCompareExchangeAndUpdateWork)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    EXPECT_EQ(node->fetchAdd<uint64_t>(1u, 5), 0u);
+    EXPECT_EQ(node->fetchAdd<uint64_t>(1u, 2), 5u);
+    EXPECT_EQ(node->get<uint64_t>(1u), 7u);
+
+    node->put(2u, "string"s);
+    EXPECT_EQ(!!node->fetchAdd<uint64_t>(2u, 1), false);
+    EXPECT_EQ(node->get<std::string>(2u), "string"s);
+
+    EXPECT_EQ(node->fetchAdd<double>(3u, 1.5), 0.0);
+    EXPECT_EQ(node->get<double>(3u), 1.5);
+
+    uint64_t expected = 6;
+    EXPECT_EQ(node->compareExchange<uint64_t>(1u, expected, 10), false);
+    EXPECT_EQ(expected, 7u);
+    EXPECT_EQ(node->compareExchange<uint64_t>(1u, expected, 10), true);
+    EXPECT_EQ(node->get<uint64_t>(1u), 10u);
+    EXPECT_EQ(node->compareExchange<uint64_t>(4u, expected, 10), false);
+    EXPECT_EQ(node->contains<uint64_t>(4u), false);
+
+    node->update(2u, [](auto& value)
+    {
+        ASSERT_EQ(!!value, true);
+        value = std::to_string(std::get<std::string>(*value).size());
+    });
+    EXPECT_EQ(node->get<std::string>(2u), "6"s);
+
+    node->update(2u, [](auto& value) { value.reset(); });
+    EXPECT_EQ(node->contains<std::string>(2u), false);
+}
+
+TEST(NodeTest, ConcurrentFetchAddDoesNotLoseUpdates)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    const uint64_t iterationCount = 20000;
+
+    std::thread threads[4];
+    SimpleLatch latch(std::size(threads));
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex] = std::thread([&node, &latch, iterationCount]()
+        {
+            latch.arrive_and_wait();
+
+            for (uint64_t i = 0; i < iterationCount; ++i)
+            {
+                node->fetchAdd<uint64_t>(1u, 1);
+                node->fetchAdd<double>(2u, 0.5);
+            }
+        });
+    }
+
+    for (size_t threadIndex = 0; threadIndex < std::size(threads); ++threadIndex)
+    {
+        threads[threadIndex].join();
+    }
+
+    EXPECT_EQ(node->get<uint64_t>(1u), std::size(threads) * iterationCount);
+    EXPECT_EQ(node->get<double>(2u), std::size(threads) * iterationCount * 0.5);
+}
+
+TEST(NodeTest, PutWithTtlExpires)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->put(1u, "short"s, std::chrono::milliseconds(20));
+    node->put(2u, "long"s, std::chrono::hours(1));
+    node->put(3u, "persistent"s);
+    node->put(4u, 4u, std::chrono::milliseconds(20));
+    node->put(4u, 5u);
+
+    EXPECT_EQ(node->get<std::string>(1u), "short"s);
+    EXPECT_EQ(node->contains<std::string>(1u), true);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(!!node->get<std::string>(1u), false);
+    EXPECT_EQ(node->contains<std::string>(1u), false);
+    EXPECT_EQ(!!node->view<std::string>(1u), false);
+    EXPECT_EQ(node->remove(1u), false);
+    EXPECT_EQ(node->get<std::string>(2u), "long"s);
+    EXPECT_EQ(node->get<std::string>(3u), "persistent"s);
+    // A put without a TTL makes the key persistent.
+    EXPECT_EQ(node->get<uint32_t>(4u), 5u);
+}
+
+TEST(NodeTest, ExpiredKeysAreReapedWithoutAccess)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    const uint32_t itemCount = 100;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        node->put(key, key, std::chrono::milliseconds(key % 2 ? 10 : 60000));
+    }
+
+    for (size_t i = 0; i < 100 && node->snapshot().size() != itemCount / 2; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(node->snapshot().size(), itemCount / 2);
+}
+
+TEST(NodeTest, PutWithoutTtlRacingWithFirstTtlPutStaysPersistent)
+{
+    const size_t nodeCount = 200;
+    // Copying a large value widens the window between the check for TTLs and the write.
+    const std::string value(64 * 1024, 'x');
+
+    std::vector<jbkvs::NodePtr> nodes;
+    std::vector<std::unique_ptr<SimpleLatch>> latches;
+    for (size_t i = 0; i < nodeCount; ++i)
+    {
+        nodes.push_back(jbkvs::Node::create());
+        latches.push_back(std::make_unique<SimpleLatch>(2));
+    }
+
+    // Each node gets its first put with a TTL at the same time as a put without one.
+    std::thread ttlWriter([&nodes, &latches]()
+    {
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            latches[i]->arrive_and_wait();
+            nodes[i]->put(1u, 2u, std::chrono::milliseconds(100));
+        }
+    });
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        latches[i]->arrive_and_wait();
+        nodes[i]->put(1u, value);
+    }
+    ttlWriter.join();
+
+    // Nodes where the put without a TTL was the last write must keep the key.
+    std::vector<jbkvs::NodePtr> persistentNodes;
+    for (const jbkvs::NodePtr& node : nodes)
+    {
+        if (node->contains<std::string>(1u))
+        {
+            persistentNodes.push_back(node);
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+    for (const jbkvs::NodePtr& node : persistentNodes)
+    {
+        EXPECT_EQ(node->contains<std::string>(1u), true);
+    }
+}
+
+TEST(NodeTest, RefreshingTtlDoesNotAccumulateTimers)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->put(1u, 0u, std::chrono::hours(1));
+    int64_t timerCount = int64_t(jbkvs::detail::ExpiryReaper::getTimerCount());
+
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        node->put(1u, i, std::chrono::hours(1));
+    }
+
+    EXPECT_LE(int64_t(jbkvs::detail::ExpiryReaper::getTimerCount()) - timerCount, 0);
+}
+
+TEST(NodeTest, ExtendedTtlIsReapedWithoutAccess)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->put(1u, 1u, std::chrono::milliseconds(10));
+    // Reuses the pending timer, which reschedules itself when it finds the later deadline.
+    node->put(1u, 2u, std::chrono::milliseconds(40));
+
+    for (size_t i = 0; i < 100 && node->snapshot().size() != 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(node->snapshot().size(), 0);
+}
+
+TEST(NodeTest, UpdateKeepsTtlAndSeesExpiredKeysAsAbsent)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->put(1u, uint64_t(10), std::chrono::milliseconds(30));
+    EXPECT_EQ(node->fetchAdd<uint64_t>(1u, 1), 10u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+
+    EXPECT_EQ(node->fetchAdd<uint64_t>(1u, 1), 0u);
+    EXPECT_EQ(node->get<uint64_t>(1u), 1u);
+}
+
+TEST(NodeTest, ScanReturnsItemsInRangeInOrder)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    const uint32_t itemCount = 2000;
+    for (uint32_t key = itemCount; key > 0; --key)
+    {
+        node->put(key * 2, key * 2);
+    }
+    node->put(1u, "string"s);
+
+    uint32_t expectedKey = 100u;
+    for (const auto& [key, value] : node->scan(100u, 3001u))
+    {
+        EXPECT_EQ(key, expectedKey);
+        EXPECT_EQ(std::get<uint32_t>(value), expectedKey);
+        expectedKey += 2;
+    }
+    EXPECT_EQ(expectedKey, 3002u);
+
+    size_t count = 0;
+    for (const auto& [key, value] : node->scan(0u, ~0u))
+    {
+        EXPECT_EQ(key == 1u, std::holds_alternative<std::string>(value));
+        ++count;
+    }
+    EXPECT_EQ(count, itemCount + 1);
+
+    count = 0;
+    for ([[maybe_unused]] const auto& item : node->scan(5000u, 6000u))
+    {
+        ++count;
+    }
+    EXPECT_EQ(count, 0);
+}
+
+TEST(NodeTest, ScanDoesNotBlockWriters)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    const uint32_t itemCount = 1000;
+    for (uint32_t key = 0; key < itemCount; ++key)
+    {
+        node->put(key, key);
+    }
+
+    size_t count = 0;
+    for (const auto& [key, value] : node->scan(0u, itemCount))
+    {
+        // Writes from the scanning thread would deadlock if the scan held the lock.
+        node->put(key + itemCount, key);
+        node->remove(key);
+        ++count;
+    }
+    EXPECT_EQ(count, itemCount);
+    EXPECT_EQ(node->get<uint32_t>(0u).has_value(), false);
+    EXPECT_EQ(node->get<uint32_t>(itemCount).has_value(), true);
+}
+
+TEST(NodeTest, SnapshotIsNotAffectedByLaterWrites)
+{
+    jbkvs::NodePtr node = jbkvs::Node::create();
+
+    node->put(1u, 1u);
+    node->put(2u, "string"s);
+
+    jbkvs::Node::Snapshot snapshot = node->snapshot();
+
+    node->put(1u, 10u);
+    node->remove(2u);
+    node->put(3u, 3u);
+
+    EXPECT_EQ(snapshot.size(), 2);
+    EXPECT_EQ(snapshot.get<uint32_t>(1u), std::optional<uint32_t>(1u));
+    EXPECT_EQ(snapshot.get<std::string>(2u), std::optional<std::string>("string"s));
+    EXPECT_EQ(snapshot.contains<uint32_t>(2u), false);
+    EXPECT_EQ(snapshot.contains<uint32_t>(3u), false);
+
+    size_t count = 0;
+    for (const auto& [key, value] : snapshot)
+    {
+        EXPECT_EQ(key == 2u, std::holds_alternative<std::string>(value));
+        ++count;
+    }
+    EXPECT_EQ(count, 2);
+
+    EXPECT_EQ(node->get<uint32_t>(1u), std::optional<uint32_t>(10u));
+    EXPECT_EQ(node->snapshot().size(), 2);
+}
+
 TEST(NodeTest, CreationOfMountedNodeChildShoudBeAllowed)
 {
     jbkvs::NodePtr node = jbkvs::Node::create();
@@ -384,3 +757,75 @@ TEST(NodeTest, ConcurrentDetachWorks)
     ASSERT_EQ(successfulDetachCounter.load(), 1u);
     EXPECT_EQ(child->getParent(), jbkvs::NodePtr());
 }
+
+TEST(NodeTest, DeepTreesAreDestroyedWithoutRecursion)
+{
+    // Deep enough to overflow the stack if every node destroyed its children recursively.
+    const size_t depth = 200000;
+
+    for (bool isBudgeted : { false, true })
+    {
+        jbkvs::MemoryBudgetPtr budget = isBudgeted ? jbkvs::MemoryBudget::create(size_t(1) << 30) : jbkvs::MemoryBudgetPtr();
+        jbkvs::NodePtr root = jbkvs::Node::create(budget);
+        jbkvs::NodePtr current = root;
+        for (size_t i = 0; i < depth; ++i)
+        {
+            current = jbkvs::Node::create(current, "child");
+        }
+        current->put(1u, "leaf"s);
+
+        std::weak_ptr<jbkvs::Node> leaf = current;
+        current.reset();
+        root.reset();
+
+        if (isBudgeted)
+        {
+            // Destroyed on this thread, so that the budget is credited at once.
+            EXPECT_EQ(budget->getUsage(), 0);
+        }
+        jbkvs::detail::Reclaimer::drain();
+        EXPECT_EQ(leaf.expired(), true);
+    }
+}
+
+TEST(NodeTest, DetachedSubtreesAreDestroyedOnceDropped)
+{
+    for (bool isBudgeted : { false, true })
+    {
+        jbkvs::MemoryBudgetPtr budget = isBudgeted ? jbkvs::MemoryBudget::create(size_t(1) << 30) : jbkvs::MemoryBudgetPtr();
+        jbkvs::NodePtr root = jbkvs::Node::create(budget);
+        size_t usageBeforeSubtree = isBudgeted ? budget->getUsage() : 0;
+
+        jbkvs::Storage storage;
+        ASSERT_EQ(storage.mount("/", root), true);
+
+        jbkvs::NodePtr subtree = jbkvs::Node::create(root, "subtree");
+        std::weak_ptr<jbkvs::Node> leaf;
+        for (size_t i = 0; i < 100; ++i)
+        {
+            jbkvs::NodePtr child = jbkvs::Node::create(subtree, std::to_string(i));
+            child->put(1u, "value"s);
+            leaf = child;
+        }
+        ASSERT_EQ(!!storage.getNode("/subtree/99"), true);
+
+        EXPECT_EQ(subtree->detach(), true);
+        EXPECT_EQ(!!storage.getNode("/subtree"), false);
+        subtree.reset();
+        // The layer lists of the Storage that referred to the subtree are reclaimed by this thread.
+        jbkvs::detail::Epoch::collect();
+        jbkvs::detail::Epoch::collect();
+        jbkvs::detail::Epoch::collect();
+
+        if (isBudgeted)
+        {
+            // Destroyed by the thread that dropped the last reference, so that the budget is credited at once.
+            EXPECT_EQ(leaf.expired(), true);
+            EXPECT_EQ(budget->getUsage(), usageBeforeSubtree);
+        }
+
+        // Otherwise destroyed in the background.
+        jbkvs::detail::Reclaimer::drain();
+        EXPECT_EQ(leaf.expired(), true);
+    }
+}
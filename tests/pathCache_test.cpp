@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include <jbkvs/detail/pathCache.h>
+
+using PathCache = jbkvs::detail::PathCache<std::shared_ptr<int>>;
+
+TEST(PathCacheTest, EntriesMatchTheirPathAndGenerationOnly)
+{
+    PathCache cache(16);
+    std::shared_ptr<int> value = std::make_shared<int>(1);
+
+    EXPECT_EQ(cache.find("/a/b", 0), nullptr);
+
+    cache.store("/a/b", value, 0);
+    EXPECT_EQ(cache.find("/a/b", 0), value);
+    EXPECT_EQ(cache.find("/a/b", 1), nullptr);
+    EXPECT_EQ(cache.find("/a/c", 0), nullptr);
+
+    std::shared_ptr<int> newValue = std::make_shared<int>(2);
+    cache.store("/a/b", newValue, 1);
+    EXPECT_EQ(cache.find("/a/b", 0), nullptr);
+    EXPECT_EQ(cache.find("/a/b", 1), newValue);
+}
+
+TEST(PathCacheTest, CollidingPathsReplaceEachOther)
+{
+    PathCache cache(1);
+    std::shared_ptr<int> first = std::make_shared<int>(1);
+    std::shared_ptr<int> second = std::make_shared<int>(2);
+
+    cache.store("/first", first, 0);
+    cache.store("/second", second, 0);
+
+    EXPECT_EQ(cache.find("/first", 0), nullptr);
+    EXPECT_EQ(cache.find("/second", 0), second);
+}
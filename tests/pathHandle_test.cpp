@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include "testUtils.h"
+
+#include <memory>
+#include <thread>
+
+#include <jbkvs/storage.h>
+
+using namespace std::literals::string_literals;
+
+TEST(PathHandleTest, ResolveWithInvalidPathFails)
+{
+    jbkvs::Storage storage;
+
+    EXPECT_EQ(!!storage.resolve(""), false);
+    EXPECT_EQ(!!storage.resolve("foo/bar"), false);
+    EXPECT_EQ(!!storage.resolve("/"), true);
+}
+
+TEST(PathHandleTest, OperationsGoToResolvedNode)
+{
+    jbkvs::NodePtr root = jbkvs::Node::create();
+    jbkvs::NodePtr child = jbkvs::Node::create(root, "b");
+    child->put(1u, 10u);
+    child->put(2u, "two"s);
+
+    jbkvs::Storage storage;
+    storage.mount("/a", root);
+
+    jbkvs::PathHandlePtr handle = storage.resolve("/a/b");
+    ASSERT_EQ(!!handle, true);
+    EXPECT_EQ(handle->getPath(), "/a/b");
+    EXPECT_EQ(handle->getNode(), storage.getNode("/a/b"));
+
+    EXPECT_EQ(handle->get<uint32_t>(1u), 10u);
+    EXPECT_EQ(handle->get<std::string>(1u), std::nullopt);
+    EXPECT_EQ(handle->contains<std::string>(2u), true);
+
+    std::string visited;
+    EXPECT_EQ(handle->visit(2u, [&visited](const auto& value)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(value)>, std::string>)
+        {
+            visited = value;
+        }
+    }), true);
+    EXPECT_EQ(visited, "two"s);
+
+    {
+        // Released before the writes below, which lock-based backends would block on.
+        jbkvs::Node::ValueView<std::string> view = handle->view<std::string>(2u);
+        ASSERT_EQ(!!view, true);
+        EXPECT_EQ(*view, "two"s);
+    }
+
+    std::vector<std::optional<uint32_t>> results;
+    handle->getMany<uint32_t>({ 1u, 3u }, results);
+    EXPECT_EQ(results[0], 10u);
+    EXPECT_EQ(results[1], std::nullopt);
+
+    EXPECT_EQ(handle->fetchAdd<uint32_t>(1u, 5u), 10u);
+    EXPECT_EQ(child->get<uint32_t>(1u), 15u);
+
+    uint32_t expected = 15u;
+    EXPECT_EQ(handle->compareExchange<uint32_t>(1u, expected, 20u), true);
+    EXPECT_EQ(handle->update(1u, [](auto& value) { value.reset(); }), true);
+    EXPECT_EQ(child->contains<uint32_t>(1u), false);
+}
+
+TEST(PathHandleTest, HandleRebindsAfterTreeChanges)
+{
+    std::unique_ptr<jbkvs::Storage> storage = std::make_unique<jbkvs::Storage>();
+
+    jbkvs::PathHandlePtr handle = storage->resolve("/x/y");
+    ASSERT_EQ(!!handle, true);
+    EXPECT_EQ(!!handle->getNode(), false);
+    EXPECT_EQ(handle->get<uint32_t>(1u), std::nullopt);
+
+    jbkvs::NodePtr root = jbkvs::Node::create();
+    jbkvs::NodePtr child = jbkvs::Node::create(root, "y");
+    child->put(1u, 1u);
+
+    storage->mount("/x", root);
+    EXPECT_EQ(handle->get<uint32_t>(1u), 1u);
+
+    child->detach();
+    EXPECT_EQ(handle->get<uint32_t>(1u), std::nullopt);
+    EXPECT_EQ(!!handle->getNode(), false);
+
+    child = jbkvs::Node::create(root, "y");
+    child->put(1u, 2u);
+    EXPECT_EQ(handle->get<uint32_t>(1u), 2u);
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    jbkvs::Node::create(overlayRoot, "y")->put(1u, 3u);
+    storage->mount("/x", overlayRoot);
+    EXPECT_EQ(handle->get<uint32_t>(1u), 3u);
+
+    storage->unmount("/x", overlayRoot);
+    EXPECT_EQ(handle->get<uint32_t>(1u), 2u);
+
+    storage->unmount("/x", root);
+    EXPECT_EQ(handle->get<uint32_t>(1u), std::nullopt);
+
+    storage->mount("/x", root);
+    EXPECT_EQ(handle->get<uint32_t>(1u), 2u);
+
+    storage.reset();
+    EXPECT_EQ(handle->get<uint32_t>(1u), std::nullopt);
+}
+
+TEST(PathHandleTest, SharedHandleWorksConcurrentlyWithMountAndUnmount)
+{
+    jbkvs::NodePtr root = jbkvs::Node::create();
+    jbkvs::NodePtr dataRoot = jbkvs::Node::create();
+    dataRoot->put(1u, 1u);
+
+    jbkvs::Storage storage;
+    storage.mount("/a", root);
+
+    jbkvs::PathHandlePtr handle = storage.resolve("/a/b");
+    ASSERT_EQ(!!handle, true);
+
+    std::thread readerThreads[3];
+    SimpleLatch latch(std::size(readerThreads) + 1);
+    // 1 modulo 4 while the data root stays mounted and 3 while it stays unmounted.
+    std::atomic<uint32_t> mountSequence(0);
+    std::atomic<bool> stopped(false);
+    std::atomic<bool> failed(false);
+
+    for (std::thread& readerThread : readerThreads)
+    {
+        readerThread = std::thread([&handle, &latch, &mountSequence, &stopped, &failed]()
+        {
+            latch.arrive_and_wait();
+
+            while (!stopped.load())
+            {
+                uint32_t sequence = mountSequence.load();
+                std::optional<uint32_t> value = handle->get<uint32_t>(1u);
+
+                // While the data root stays mounted, or unmounted, the handle must see exactly that.
+                bool stable = mountSequence.load() == sequence;
+                if (stable && ((sequence % 4 == 1 && !value) || (sequence % 4 == 3 && value)))
+                {
+                    failed = true;
+                }
+                if (value && *value != 1u)
+                {
+                    failed = true;
+                }
+            }
+        });
+    }
+
+    latch.arrive_and_wait();
+
+    for (uint32_t i = 0; i < 5000; ++i)
+    {
+        storage.mount("/a/b", dataRoot);
+        mountSequence.fetch_add(1);
+        mountSequence.fetch_add(1);
+        storage.unmount("/a/b", dataRoot);
+        mountSequence.fetch_add(1);
+        mountSequence.fetch_add(1);
+    }
+
+    stopped = true;
+    for (std::thread& readerThread : readerThreads)
+    {
+        readerThread.join();
+    }
+
+    EXPECT_EQ(failed.load(), false);
+    EXPECT_EQ(handle->get<uint32_t>(1u), std::nullopt);
+}
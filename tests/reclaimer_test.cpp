@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <jbkvs/detail/reclaimer.h>
+
+using jbkvs::detail::Reclaimer;
+
+namespace
+{
+
+    // Link of a chain that hands the rest of the chain to the reclaimer when destroyed.
+    struct Link
+    {
+        static inline thread_local size_t nesting = 0;
+
+        std::unique_ptr<Link> next;
+        bool background;
+        std::atomic<size_t>& destroyed;
+        std::atomic<size_t>& maxNesting;
+        std::thread::id& threadId;
+
+        Link(bool background, std::atomic<size_t>& destroyed, std::atomic<size_t>& maxNesting, std::thread::id& threadId)
+            : next()
+            , background(background)
+            , destroyed(destroyed)
+            , maxNesting(maxNesting)
+            , threadId(threadId)
+        {
+        }
+
+        ~Link()
+        {
+            ++nesting;
+            maxNesting.store(std::max(maxNesting.load(), nesting));
+            threadId = std::this_thread::get_id();
+
+            if (next)
+            {
+                if (background)
+                {
+                    Reclaimer::retire(std::move(next));
+                }
+                else
+                {
+                    Reclaimer::destroy(std::move(next));
+                }
+            }
+
+            ++destroyed;
+            --nesting;
+        }
+    };
+
+    std::unique_ptr<Link> _makeChain(size_t length, bool background, std::atomic<size_t>& destroyed, std::atomic<size_t>& maxNesting, std::thread::id& threadId)
+    {
+        std::unique_ptr<Link> head;
+        for (size_t i = 0; i < length; ++i)
+        {
+            std::unique_ptr<Link> link = std::make_unique<Link>(background, destroyed, maxNesting, threadId);
+            link->next = std::move(head);
+            head = std::move(link);
+        }
+        return head;
+    }
+
+} // namespace
+
+TEST(ReclaimerTest, DestroyRunsCascadesIterativelyOnTheCallingThread)
+{
+    const size_t length = 100000;
+
+    std::atomic<size_t> destroyed(0);
+    std::atomic<size_t> maxNesting(0);
+    std::thread::id threadId;
+
+    Reclaimer::destroy(_makeChain(length, false, destroyed, maxNesting, threadId));
+
+    EXPECT_EQ(destroyed.load(), length);
+    EXPECT_EQ(maxNesting.load(), 1);
+    EXPECT_EQ(threadId, std::this_thread::get_id());
+}
+
+TEST(ReclaimerTest, RetireRunsCascadesIterativelyInTheBackground)
+{
+    const size_t length = 100000;
+
+    std::atomic<size_t> destroyed(0);
+    std::atomic<size_t> maxNesting(0);
+    std::thread::id threadId;
+
+    Reclaimer::retire(_makeChain(length, true, destroyed, maxNesting, threadId));
+    Reclaimer::drain();
+
+    EXPECT_EQ(destroyed.load(), length);
+    EXPECT_EQ(maxNesting.load(), 1);
+    EXPECT_NE(threadId, std::this_thread::get_id());
+}
+
+TEST(ReclaimerTest, ConcurrentRetirementsAreAllDestroyed)
+{
+    const size_t threadCount = 8;
+    const size_t chainCount = 1000;
+    const size_t length = 10;
+
+    std::atomic<size_t> destroyed(0);
+    std::atomic<size_t> maxNesting(0);
+    std::thread::id threadIds[threadCount];
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (size_t i = 0; i < chainCount; ++i)
+            {
+                Reclaimer::retire(_makeChain(length, i % 2 == 0, destroyed, maxNesting, threadIds[t]));
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    Reclaimer::drain();
+
+    EXPECT_EQ(destroyed.load(), threadCount * chainCount * length);
+    EXPECT_EQ(maxNesting.load(), 1);
+}
@@ -0,0 +1,39 @@
+#include <gtest/gtest.h>
+
+#include <jbkvs/detail/resolveCache.h>
+
+using ResolveCache = jbkvs::detail::ResolveCache<uint32_t>;
+
+TEST(ResolveCacheTest, FindReturnsStoredEntries)
+{
+    ResolveCache cache(100);
+    ResolveCache::Entry entry;
+
+    EXPECT_EQ(cache.find(1u, 0, 1, entry), false);
+
+    cache.store(1u, 0, { 3, 1, 42 });
+    ASSERT_EQ(cache.find(1u, 0, 1, entry), true);
+    EXPECT_EQ(entry.layer, 3u);
+    EXPECT_EQ(entry.stamp, 42u);
+
+    cache.store(1u, 2, { ResolveCache::noLayer, 1, 7 });
+    ASSERT_EQ(cache.find(1u, 2, 1, entry), true);
+    EXPECT_EQ(entry.layer, ResolveCache::noLayer);
+
+    // Entries apply to the list generation they were resolved in only.
+    EXPECT_EQ(cache.find(1u, 0, 2, entry), false);
+    EXPECT_EQ(cache.find(2u, 0, 1, entry), false);
+}
+
+TEST(ResolveCacheTest, CollidingKeysReplaceEachOther)
+{
+    ResolveCache cache(1);
+    ResolveCache::Entry entry;
+
+    cache.store(1u, 0, { 1, 1, 1 });
+    cache.store(2u, 0, { 2, 1, 2 });
+
+    EXPECT_EQ(cache.find(1u, 0, 1, entry), false);
+    ASSERT_EQ(cache.find(2u, 0, 1, entry), true);
+    EXPECT_EQ(entry.layer, 2u);
+}
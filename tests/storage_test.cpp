@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "testUtils.h"
 
+#include <memory>
 #include <thread>
 
 #include <jbkvs/storage.h>
@@ -782,3 +783,893 @@ TEST(StorageTest, GetMountPointsWorks)
     EXPECT_EQ(mountPoints[3].path, "/bar"s);
     EXPECT_EQ(mountPoints[3].node, root1);
 }
+
+TEST(StorageTest, GetWorksConcurrentlyWithMountAndUnmount)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    baseRoot->put(123u, 1u);
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    overlayRoot->put(123u, 2u);
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    SimpleLatch latch(2);
+    std::atomic<bool> stopped(false);
+    std::atomic<bool> failed(false);
+
+    std::thread readerThread([&latch, &stopped, &failed, &storageRoot]()
+    {
+        latch.arrive_and_wait();
+
+        while (!stopped.load())
+        {
+            auto data = storageRoot->get<uint32_t>(123u);
+            if (!data || (*data != 1u && *data != 2u))
+            {
+                failed = true;
+            }
+        }
+    });
+
+    latch.arrive_and_wait();
+
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        storage.mount("/", overlayRoot);
+        storage.unmount("/", overlayRoot);
+    }
+
+    stopped = true;
+    readerThread.join();
+
+    EXPECT_EQ(failed.load(), false);
+
+    auto data = storageRoot->get<uint32_t>(123u);
+    ASSERT_EQ(!!data, true);
+    EXPECT_EQ(*data, 1u);
+}
+
+TEST(StorageTest, ViewFollowsMergePriorityAndOutlivesUnmount)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    baseRoot->put(1u, "base"s);
+    baseRoot->put(2u, "base"s);
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    overlayRoot->put(1u, "overlay"s);
+    overlayRoot->put(2u, 2u);
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+    storage.mount("/", overlayRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    auto view = storageRoot->view<std::string>(1u);
+    ASSERT_EQ(!!view, true);
+    EXPECT_EQ(*view, "overlay"s);
+
+    auto fallbackView = storageRoot->view<std::string>(2u);
+    ASSERT_EQ(!!fallbackView, true);
+    EXPECT_EQ(*fallbackView, "base"s);
+
+    EXPECT_EQ(!!storageRoot->view<std::string>(3u), false);
+
+    storage.unmount("/", overlayRoot);
+    overlayRoot.reset();
+
+    EXPECT_EQ(*view, "overlay"s);
+}
+
+TEST(StorageTest, GetManyFollowsMergePriority)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    baseRoot->putMany(std::vector<std::pair<uint32_t, std::string>>({ { 1u, "base1"s }, { 2u, "base2"s }, { 3u, "base3"s } }));
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    overlayRoot->put(1u, "overlay1"s);
+    overlayRoot->put(2u, 2u);
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+    storage.mount("/", overlayRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    std::vector<std::optional<std::string>> results;
+    storageRoot->getMany(std::vector<uint32_t>({ 4u, 3u, 2u, 1u }), results);
+
+    ASSERT_EQ(results.size(), 4);
+    EXPECT_EQ(results[0], std::optional<std::string>());
+    EXPECT_EQ(results[1], std::optional<std::string>("base3"s));
+    EXPECT_EQ(results[2], std::optional<std::string>("base2"s));
+    EXPECT_EQ(results[3], std::optional<std::string>("overlay1"s));
+}
+
+TEST(StorageTest, VisitAndContainsFollowMergePriority)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    baseRoot->put(1u, "base"s);
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    overlayRoot->put(1u, 1u);
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+    storage.mount("/", overlayRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    bool visitedOverlay = false;
+    bool visited = storageRoot->visit(1u, [&visitedOverlay](const auto& value)
+    {
+        visitedOverlay = std::is_same_v<std::decay_t<decltype(value)>, uint32_t>;
+    });
+    EXPECT_EQ(visited, true);
+    EXPECT_EQ(visitedOverlay, true);
+
+    EXPECT_EQ(storageRoot->visit(2u, [](const auto& value) { FAIL(); }), false);
+
+    EXPECT_EQ(storageRoot->contains<uint32_t>(1u), true);
+    EXPECT_EQ(storageRoot->contains<std::string>(1u), true);
+    EXPECT_EQ(storageRoot->contains<double>(1u), false);
+
+    auto data = storageRoot->get<std::string>(1u);
+    ASSERT_EQ(!!data, true);
+    EXPECT_EQ(*data, "base"s);
+}
+
+TEST(StorageTest, ReadModifyWriteGoesToWinningLayer)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    baseRoot->put(1u, uint64_t(10));
+    baseRoot->put(2u, uint64_t(20));
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    overlayRoot->put(1u, "overlay"s);
+    overlayRoot->put(2u, uint64_t(200));
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+    storage.mount("/", overlayRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    EXPECT_EQ(storageRoot->fetchAdd<uint64_t>(1u, 1), 10u);
+    EXPECT_EQ(baseRoot->get<uint64_t>(1u), 11u);
+    EXPECT_EQ(overlayRoot->get<std::string>(1u), "overlay"s);
+
+    EXPECT_EQ(storageRoot->fetchAdd<uint64_t>(2u, 1), 200u);
+    EXPECT_EQ(baseRoot->get<uint64_t>(2u), 20u);
+    EXPECT_EQ(overlayRoot->get<uint64_t>(2u), 201u);
+
+    EXPECT_EQ(!!storageRoot->fetchAdd<uint64_t>(3u, 1), false);
+    EXPECT_EQ(baseRoot->contains<uint64_t>(3u), false);
+    EXPECT_EQ(overlayRoot->contains<uint64_t>(3u), false);
+
+    uint64_t expected = 11;
+    EXPECT_EQ(storageRoot->compareExchange<uint64_t>(1u, expected, 12), true);
+    EXPECT_EQ(baseRoot->get<uint64_t>(1u), 12u);
+
+    EXPECT_EQ(storageRoot->update(1u, [](auto& value) { value = "updated"s; }), true);
+    EXPECT_EQ(overlayRoot->get<std::string>(1u), "updated"s);
+    EXPECT_EQ(baseRoot->get<uint64_t>(1u), 12u);
+
+    EXPECT_EQ(storageRoot->update(3u, [](auto& value) { FAIL(); }), false);
+}
+
+TEST(StorageTest, ExpiredKeysFallThroughToLowerLayers)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    baseRoot->put(1u, "base"s);
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    overlayRoot->put(1u, "overlay"s, std::chrono::milliseconds(20));
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+    storage.mount("/", overlayRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    EXPECT_EQ(storageRoot->get<std::string>(1u), "overlay"s);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(storageRoot->get<std::string>(1u), "base"s);
+
+    std::vector<std::optional<std::string>> results;
+    storageRoot->getMany<std::string>({ 1u }, results);
+    EXPECT_EQ(results[0], "base"s);
+}
+
+TEST(StorageTest, ResolveCacheFollowsWritesAndMounts)
+{
+    jbkvs::NodePtr layers[4];
+    for (jbkvs::NodePtr& layer : layers)
+    {
+        layer = jbkvs::Node::create();
+    }
+    layers[0]->put(1u, "base"s);
+    layers[0]->put(2u, 2u);
+
+    jbkvs::Storage storage(1024);
+    storage.mount("/", layers[0]);
+    storage.mount("/", layers[1]);
+    storage.mount("/", layers[2]);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        EXPECT_EQ(storageRoot->get<std::string>(1u), "base"s);
+        EXPECT_EQ(storageRoot->get<uint32_t>(1u), std::nullopt);
+        EXPECT_EQ(storageRoot->contains<uint32_t>(3u), false);
+    }
+
+    layers[2]->put(1u, "top"s);
+    EXPECT_EQ(storageRoot->get<std::string>(1u), "top"s);
+
+    layers[1]->put(1u, 1u);
+    EXPECT_EQ(storageRoot->get<std::string>(1u), "top"s);
+    EXPECT_EQ(storageRoot->get<uint32_t>(1u), 1u);
+
+    layers[2]->remove(1u);
+    EXPECT_EQ(storageRoot->get<std::string>(1u), "base"s);
+
+    layers[0]->remove(1u);
+    EXPECT_EQ(storageRoot->get<std::string>(1u), std::nullopt);
+    EXPECT_EQ(storageRoot->contains<uint32_t>(1u), true);
+
+    layers[0]->put(3u, 3u);
+    EXPECT_EQ(storageRoot->contains<uint32_t>(3u), true);
+
+    layers[3]->put(2u, 4u);
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 2u);
+    storage.mount("/", layers[3]);
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 4u);
+    storage.unmount("/", layers[3]);
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 2u);
+
+    layers[1]->put(2u, 5u, std::chrono::milliseconds(20));
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 5u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 2u);
+
+    EXPECT_EQ(storageRoot->fetchAdd<uint32_t>(2u, 1u), 2u);
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 3u);
+}
+
+TEST(StorageTest, ResolveCacheNeverServesOverwrittenLayers)
+{
+    jbkvs::NodePtr layers[8];
+    for (jbkvs::NodePtr& layer : layers)
+    {
+        layer = jbkvs::Node::create();
+    }
+    layers[0]->put(1u, uint64_t(0));
+
+    jbkvs::Storage storage(64);
+    for (const jbkvs::NodePtr& layer : layers)
+    {
+        storage.mount("/", layer);
+    }
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    const uint64_t writeCount = 20000;
+
+    std::thread readerThreads[3];
+    SimpleLatch latch(std::size(readerThreads) + 1);
+    std::atomic<bool> stopped(false);
+    std::atomic<bool> failed(false);
+
+    for (std::thread& readerThread : readerThreads)
+    {
+        readerThread = std::thread([&latch, &stopped, &failed, &storageRoot]()
+        {
+            latch.arrive_and_wait();
+
+            // Values only grow through the layers, so a stale layer would show a smaller value.
+            uint64_t last = 0;
+            while (!stopped.load())
+            {
+                std::optional<uint64_t> value = storageRoot->get<uint64_t>(1u);
+                if (!value || *value < last)
+                {
+                    failed = true;
+                }
+                last = value ? *value : last;
+            }
+        });
+    }
+
+    latch.arrive_and_wait();
+
+    for (uint64_t i = 1; i <= writeCount; ++i)
+    {
+        layers[1 + i * (std::size(layers) - 1) / (writeCount + 1)]->put(1u, i);
+    }
+
+    stopped = true;
+    for (std::thread& readerThread : readerThreads)
+    {
+        readerThread.join();
+    }
+
+    EXPECT_EQ(failed.load(), false);
+    EXPECT_EQ(storageRoot->get<uint64_t>(1u), writeCount);
+}
+
+TEST(StorageTest, KeyFiltersSkipLayersWithoutTheKey)
+{
+    const uint32_t keysPerLayer = 1000;
+
+    jbkvs::NodePtr layers[16];
+    for (size_t i = 0; i < std::size(layers); ++i)
+    {
+        layers[i] = jbkvs::Node::create();
+        for (uint32_t j = 0; j < keysPerLayer; ++j)
+        {
+            layers[i]->put(uint32_t(i * keysPerLayer + j), uint32_t(i));
+        }
+    }
+
+    jbkvs::Storage storage;
+    for (const jbkvs::NodePtr& layer : layers)
+    {
+        storage.mount("/", layer);
+    }
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    const uint32_t keyCount = uint32_t(std::size(layers)) * keysPerLayer;
+    for (uint32_t key = 0; key < keyCount; ++key)
+    {
+        EXPECT_EQ(storageRoot->get<uint32_t>(key), key / keysPerLayer);
+    }
+    for (uint32_t key = keyCount; key < 2 * keyCount; ++key)
+    {
+        EXPECT_EQ(storageRoot->contains<uint32_t>(key), false);
+    }
+
+    uint64_t falsePositiveCount = 0;
+    for (const jbkvs::NodePtr& layer : layers)
+    {
+        jbkvs::Node::KeyFilterStatistics statistics = layer->getKeyFilterStatistics();
+        EXPECT_LT(statistics.estimatedFalsePositiveRate, 0.05);
+        falsePositiveCount += statistics.falsePositiveCount;
+    }
+    // Every layer a key is not in is probed only for a false positive.
+    EXPECT_LT(falsePositiveCount, uint64_t(keyCount) * std::size(layers) / 20);
+
+    layers[0]->remove(0u);
+    EXPECT_EQ(storageRoot->contains<uint32_t>(0u), false);
+    layers[15]->put(0u, 15u);
+    EXPECT_EQ(storageRoot->get<uint32_t>(0u), 15u);
+}
+
+TEST(StorageTest, CachedPathsFollowDetachAndUnmount)
+{
+    jbkvs::NodePtr root = jbkvs::Node::create();
+    jbkvs::NodePtr child = jbkvs::Node::create(jbkvs::Node::create(root, "a"), "b");
+    child->put(123u, 1u);
+
+    jbkvs::Storage storage;
+    storage.mount("/x", root);
+
+    jbkvs::StorageNodePtr storageNode = storage.getNode("/x/a/b");
+    ASSERT_EQ(!!storageNode, true);
+    EXPECT_EQ(storage.getNode("/x/a/b"), storageNode);
+
+    child->detach();
+    EXPECT_EQ(!!storage.getNode("/x/a/b"), false);
+
+    child = jbkvs::Node::create(root->getChild("a"), "b");
+    child->put(123u, 2u);
+
+    jbkvs::StorageNodePtr newStorageNode = storage.getNode("/x/a/b");
+    ASSERT_EQ(!!newStorageNode, true);
+    EXPECT_NE(newStorageNode, storageNode);
+    EXPECT_EQ(newStorageNode->get<uint32_t>(123u), 2u);
+    EXPECT_EQ(storage.getNode("/x/a/b"), newStorageNode);
+
+    storage.unmount("/x", root);
+    EXPECT_EQ(!!storage.getNode("/x/a/b"), false);
+    EXPECT_EQ(!!storage.getNode("/x"), false);
+}
+
+TEST(StorageTest, CachedPathsNeverResolveToRemovedNodes)
+{
+    jbkvs::NodePtr root = jbkvs::Node::create();
+    jbkvs::NodePtr dataRoot = jbkvs::Node::create();
+    dataRoot->put(1u, 1u);
+
+    jbkvs::Storage storage;
+    storage.mount("/a", root);
+
+    std::thread readerThreads[3];
+    SimpleLatch latch(std::size(readerThreads) + 1);
+    // Odd while an unmount is in progress.
+    std::atomic<uint32_t> unmountSequence(0);
+    std::atomic<bool> stopped(false);
+    std::atomic<bool> failed(false);
+
+    for (std::thread& readerThread : readerThreads)
+    {
+        readerThread = std::thread([&storage, &latch, &unmountSequence, &stopped, &failed]()
+        {
+            latch.arrive_and_wait();
+
+            while (!stopped.load())
+            {
+                uint32_t sequence = unmountSequence.load();
+                jbkvs::StorageNodePtr storageNode = storage.getNode("/a/b");
+                bool contains = storageNode && storageNode->contains<uint32_t>(1u);
+
+                // A live node at the path always has the data root mounted, a removed one has nothing.
+                if (storageNode && !contains && !(sequence & 1) && unmountSequence.load() == sequence)
+                {
+                    failed = true;
+                }
+            }
+        });
+    }
+
+    latch.arrive_and_wait();
+
+    for (uint32_t i = 0; i < 10000; ++i)
+    {
+        storage.mount("/a/b", dataRoot);
+        unmountSequence.fetch_add(1);
+        storage.unmount("/a/b", dataRoot);
+        unmountSequence.fetch_add(1);
+    }
+
+    stopped = true;
+    for (std::thread& readerThread : readerThreads)
+    {
+        readerThread.join();
+    }
+
+    EXPECT_EQ(failed.load(), false);
+    EXPECT_EQ(!!storage.getNode("/a/b"), false);
+    EXPECT_EQ(!!storage.getNode("/a"), true);
+}
+
+TEST(StorageTest, ScanMergesLayersByPriority)
+{
+    const uint32_t keyCount = 3000;
+
+    // Layer i holds the multiples of i + 1, so that keys are shadowed by any number of layers.
+    jbkvs::NodePtr layers[3];
+    for (size_t i = 0; i < std::size(layers); ++i)
+    {
+        layers[i] = jbkvs::Node::create();
+        for (uint32_t key = 0; key < keyCount; key += uint32_t(i + 1))
+        {
+            layers[i]->put(key, uint32_t(i));
+        }
+    }
+    layers[0]->put(1u, "base"s);
+
+    jbkvs::Storage storage;
+    storage.mount("/", layers[0]);
+    storage.mount("/", layers[2]);
+    storage.mount("/", layers[1]);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    // Mounted later, layer 1 wins over layer 2.
+    uint32_t expectedKey = 100;
+    for (const auto& [key, value] : storageRoot->scan(100u, 2000u))
+    {
+        ASSERT_EQ(key, expectedKey);
+        uint32_t expectedLayer = (key % 2 == 0) ? 1 : (key % 3 == 0) ? 2 : 0;
+        ASSERT_EQ(std::get<uint32_t>(value), expectedLayer);
+        ++expectedKey;
+    }
+    EXPECT_EQ(expectedKey, 2001u);
+
+    size_t count = 0;
+    for (const auto& [key, value] : storageRoot->scan(0u, 1u))
+    {
+        EXPECT_EQ(key, count);
+        ++count;
+    }
+    EXPECT_EQ(count, 2);
+    EXPECT_EQ(std::get<std::string>((*storageRoot->scan(1u, 1u).begin()).second), "base"s);
+
+    storage.unmount("/", layers[0]);
+    storage.unmount("/", layers[1]);
+    storage.unmount("/", layers[2]);
+    for ([[maybe_unused]] const auto& item : storageRoot->scan(0u, keyCount))
+    {
+        FAIL();
+    }
+}
+
+TEST(StorageTest, ScanKeepsLayersMountedWhenItStarted)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    for (uint32_t key = 0; key < 1000; ++key)
+    {
+        baseRoot->put(key, 0u);
+        overlayRoot->put(key * 2, 1u);
+    }
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+    storage.mount("/", overlayRoot);
+
+    jbkvs::StorageNodePtr storageRoot = storage.getNode("/");
+    ASSERT_EQ(!!storageRoot, true);
+
+    uint32_t expectedKey = 0;
+    for (const auto& [key, value] : storageRoot->scan(0u, 999u))
+    {
+        if (key == 0)
+        {
+            // Neither unmounting nor writing blocks on the scan.
+            storage.unmount("/", overlayRoot);
+            baseRoot->put(5000u, 0u);
+        }
+        ASSERT_EQ(key, expectedKey);
+        EXPECT_EQ(std::get<uint32_t>(value), (key % 2 == 0) ? 1u : 0u);
+        ++expectedKey;
+    }
+    EXPECT_EQ(expectedKey, 1000u);
+    EXPECT_EQ(storageRoot->get<uint32_t>(2u), 0u);
+}
+
+TEST(StorageTest, LazyMountMaterializesPathsOnDemand)
+{
+    jbkvs::NodePtr volumeRoot = jbkvs::Node::create();
+    jbkvs::NodePtr a = jbkvs::Node::create(volumeRoot, "a");
+    jbkvs::NodePtr ab = jbkvs::Node::create(a, "b");
+    volumeRoot->put(1u, 1u);
+    ab->put(1u, 2u);
+
+    jbkvs::Storage storage;
+    ASSERT_EQ(storage.mount("/v", volumeRoot, jbkvs::Storage::MountMode::Lazy), true);
+
+    jbkvs::StorageNodePtr v = storage.getNode("/v");
+    ASSERT_EQ(!!v, true);
+    EXPECT_EQ(v->get<uint32_t>(1u), 1u);
+
+    // Created before and after the StorageNodes of its parent are materialized.
+    jbkvs::NodePtr x = jbkvs::Node::create(volumeRoot, "x");
+    jbkvs::StorageNodePtr vab = storage.getNode("/v/a/b");
+    ASSERT_EQ(!!vab, true);
+    EXPECT_EQ(vab->get<uint32_t>(1u), 2u);
+    EXPECT_EQ(!!storage.getNode("/v/x"), true);
+    jbkvs::NodePtr ac = jbkvs::Node::create(a, "c");
+    EXPECT_EQ(!!storage.getNode("/v/a/c"), true);
+
+    EXPECT_EQ(ab->detach(), true);
+    EXPECT_EQ(!!storage.getNode("/v/a/b"), false);
+    EXPECT_EQ(x->detach(), true);
+    EXPECT_EQ(!!storage.getNode("/v/x"), false);
+
+    EXPECT_EQ(storage.unmount("/v", volumeRoot), true);
+    EXPECT_EQ(!!storage.getNode("/v"), false);
+
+    // Mounting again starts over, and unmounting before anything is materialized leaves nothing behind.
+    ASSERT_EQ(storage.mount("/v", volumeRoot, jbkvs::Storage::MountMode::Lazy), true);
+    EXPECT_EQ(!!storage.getNode("/v/a/c"), true);
+    EXPECT_EQ(!!storage.getNode("/v/a/b"), false);
+    EXPECT_EQ(storage.unmount("/v", volumeRoot), true);
+    ASSERT_EQ(storage.mount("/v", volumeRoot, jbkvs::Storage::MountMode::Lazy), true);
+    EXPECT_EQ(storage.unmount("/v", volumeRoot), true);
+    EXPECT_EQ(!!storage.getNode("/v"), false);
+    EXPECT_EQ(!!storage.getNode("/"), true);
+}
+
+TEST(StorageTest, LazyMountOverMaterializedNodesTakesPrecedence)
+{
+    jbkvs::NodePtr baseRoot = jbkvs::Node::create();
+    jbkvs::NodePtr baseChild = jbkvs::Node::create(baseRoot, "a");
+    baseChild->put(1u, 1u);
+
+    jbkvs::NodePtr overlayRoot = jbkvs::Node::create();
+    jbkvs::NodePtr overlayChild = jbkvs::Node::create(overlayRoot, "a");
+    jbkvs::NodePtr overlayGrandChild = jbkvs::Node::create(overlayChild, "b");
+    overlayChild->put(1u, 2u);
+
+    jbkvs::Storage storage;
+    storage.mount("/", baseRoot);
+
+    jbkvs::StorageNodePtr child = storage.getNode("/a");
+    ASSERT_EQ(!!child, true);
+    EXPECT_EQ(child->get<uint32_t>(1u), 1u);
+    jbkvs::PathHandlePtr handle = storage.resolve("/a");
+    EXPECT_EQ(handle->get<uint32_t>(1u), 1u);
+
+    storage.mount("/", overlayRoot, jbkvs::Storage::MountMode::Lazy);
+
+    // The cached path and the handle resolve again, which materializes the overlay in the same StorageNode.
+    EXPECT_EQ(storage.getNode("/a"), child);
+    EXPECT_EQ(child->get<uint32_t>(1u), 2u);
+    EXPECT_EQ(handle->get<uint32_t>(1u), 2u);
+    EXPECT_EQ(!!storage.getNode("/a/b"), true);
+
+    storage.unmount("/", overlayRoot);
+    EXPECT_EQ(child->get<uint32_t>(1u), 1u);
+    EXPECT_EQ(!!storage.getNode("/a/b"), false);
+}
+
+TEST(StorageTest, LazyMountWorksConcurrentlyWithStructureChanges)
+{
+    const size_t iterations = 300;
+    const size_t childCount = 16;
+
+    jbkvs::NodePtr volumeRoot = jbkvs::Node::create();
+    jbkvs::NodePtr directory = jbkvs::Node::create(volumeRoot, "d");
+
+    jbkvs::Storage storage;
+    storage.mount("/v", volumeRoot, jbkvs::Storage::MountMode::Lazy);
+
+    std::atomic<bool> done = false;
+    std::thread structureThread([&]()
+    {
+        for (size_t i = 0; !done.load(); ++i)
+        {
+            jbkvs::NodePtr child = jbkvs::Node::create(directory, std::to_string(i % childCount));
+            if (child)
+            {
+                jbkvs::Node::create(child, "leaf");
+            }
+            if (i % 3 == 0)
+            {
+                jbkvs::NodePtr oldChild = directory->getChild(std::to_string((i / 3) % childCount));
+                if (oldChild)
+                {
+                    oldChild->detach();
+                }
+            }
+        }
+    });
+
+    std::thread readThread([&]()
+    {
+        for (size_t i = 0; !done.load(); ++i)
+        {
+            storage.getNode("/v/d/" + std::to_string(i % childCount) + "/leaf");
+        }
+    });
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        storage.getNode("/v/d/" + std::to_string(i % childCount));
+        storage.unmount("/v", volumeRoot);
+        storage.mount("/v", volumeRoot, (i % 2 == 0) ? jbkvs::Storage::MountMode::Lazy : jbkvs::Storage::MountMode::Eager);
+    }
+
+    done.store(true);
+    structureThread.join();
+    readThread.join();
+
+    // Every child present once the threads stopped resolves, whether or not it was materialized before.
+    for (const auto& [name, child] : directory->getChildren())
+    {
+        EXPECT_EQ(!!storage.getNode("/v/d/" + name + "/leaf"), !!child->getChild("leaf"));
+    }
+    storage.unmount("/v", volumeRoot);
+    EXPECT_EQ(!!storage.getNode("/v"), false);
+}
+
+TEST(StorageTest, StructureChangesLockOnlyMaterializedNodes)
+{
+    jbkvs::NodePtr volumeRoot = jbkvs::Node::create();
+    jbkvs::NodePtr a = jbkvs::Node::create(volumeRoot, "a");
+    jbkvs::NodePtr ab = jbkvs::Node::create(a, "b");
+    jbkvs::NodePtr abc = jbkvs::Node::create(ab, "c");
+    jbkvs::NodePtr abcd = jbkvs::Node::create(abc, "d");
+
+    jbkvs::Storage storage;
+    ASSERT_EQ(storage.mount("/v", volumeRoot, jbkvs::Storage::MountMode::Lazy), true);
+    ASSERT_EQ(!!storage.getNode("/v/a"), true);
+
+    {
+        // Iterating over the children of a node keeps it locked for reading, which a lock on the whole subtree
+        // being detached or unmounted would wait for on this very thread.
+        auto children = abc->getChildren();
+        auto it = children.begin();
+
+        EXPECT_EQ(ab->detach(), true);
+        EXPECT_EQ(!!storage.getNode("/v/a/b"), false);
+        EXPECT_EQ(storage.unmount("/v", volumeRoot), true);
+        EXPECT_EQ(!!storage.getNode("/v"), false);
+
+        EXPECT_EQ((*it).first, "d"s);
+    }
+
+    // Structure changes below the detached node go on without the mount.
+    EXPECT_EQ(abcd->detach(), true);
+    EXPECT_EQ(!!abc->getChild("d"), false);
+}
+
+TEST(StorageTest, ManyMountsUnmountInAnyOrder)
+{
+    const size_t tenantCount = 2000;
+
+    jbkvs::NodePtr shared = jbkvs::Node::create();
+    jbkvs::NodePtr sharedChild = jbkvs::Node::create(shared, "child");
+    sharedChild->put(1u, 1u);
+
+    std::vector<jbkvs::NodePtr> tenants;
+    jbkvs::Storage storage;
+    for (size_t i = 0; i < tenantCount; ++i)
+    {
+        tenants.push_back(jbkvs::Node::create());
+        tenants.back()->put(1u, uint32_t(i));
+        std::string path = "/t" + std::to_string(i);
+        ASSERT_EQ(storage.mount(path, shared), true);
+        ASSERT_EQ(storage.mount(path, tenants.back()), true);
+        ASSERT_EQ(storage.mount(path, shared, jbkvs::Storage::MountMode::Lazy), true);
+    }
+    EXPECT_EQ(storage.getMountPoints().size(), 3 * tenantCount);
+
+    // The latest mount of a node at a path goes first, wherever the others are.
+    for (size_t i = 0; i < tenantCount; i += 2)
+    {
+        std::string path = "/t" + std::to_string(i);
+        ASSERT_EQ(storage.unmount(path, shared), true);
+        EXPECT_EQ(storage.getNode(path)->get<uint32_t>(1u), uint32_t(i));
+        ASSERT_EQ(storage.unmount(path, tenants[i]), true);
+        EXPECT_EQ(storage.unmount(path, tenants[i]), false);
+        EXPECT_EQ(storage.getNode(path)->get<uint32_t>(1u), std::nullopt);
+        EXPECT_EQ(storage.getNode(path + "/child")->get<uint32_t>(1u), 1u);
+    }
+
+    std::vector<jbkvs::Storage::MountPoint> mountPoints = storage.getMountPoints();
+    ASSERT_EQ(mountPoints.size(), 2 * tenantCount);
+    for (size_t i = 1; i < mountPoints.size(); ++i)
+    {
+        EXPECT_LT(mountPoints[i - 1].priority, mountPoints[i].priority);
+    }
+    EXPECT_EQ(mountPoints[0].path, "/t0"s);
+    EXPECT_EQ(mountPoints[0].node, shared);
+    EXPECT_EQ(mountPoints[1].path, "/t1"s);
+    EXPECT_EQ(mountPoints[1].node, shared);
+    EXPECT_EQ(mountPoints[2].node, tenants[1]);
+
+    for (size_t i = 0; i < tenantCount; i += 2)
+    {
+        std::string path = "/t" + std::to_string(i);
+        ASSERT_EQ(storage.unmount(path, shared), true);
+        EXPECT_EQ(!!storage.getNode(path), false);
+    }
+
+    // The other mounts of the shared node still see its structure changes.
+    jbkvs::NodePtr newChild = jbkvs::Node::create(shared, "newChild");
+    EXPECT_EQ(!!storage.getNode("/t1/newChild"), true);
+    EXPECT_EQ(!!storage.getNode("/t0/newChild"), false);
+    EXPECT_EQ(newChild->detach(), true);
+    EXPECT_EQ(!!storage.getNode("/t1/newChild"), false);
+}
+
+TEST(StorageTest, AsynchronousPropagationShowsAttachedNodesAfterSync)
+{
+    jbkvs::NodePtr volumeRoot = jbkvs::Node::create();
+    jbkvs::NodePtr a = jbkvs::Node::create(volumeRoot, "a");
+
+    jbkvs::Storage storage(0, jbkvs::Storage::Propagation::Asynchronous);
+    ASSERT_EQ(storage.mount("/v", volumeRoot), true);
+    EXPECT_EQ(!!storage.getNode("/v/a"), true);
+
+    jbkvs::NodePtr ab = jbkvs::Node::create(a, "b");
+    jbkvs::NodePtr abc = jbkvs::Node::create(ab, "c");
+    abc->put(1u, 1u);
+    storage.sync();
+    ASSERT_EQ(!!storage.getNode("/v/a/b/c"), true);
+    EXPECT_EQ(storage.getNode("/v/a/b/c")->get<uint32_t>(1u), 1u);
+
+    // Detaches are synchronous.
+    EXPECT_EQ(ab->detach(), true);
+    EXPECT_EQ(!!storage.getNode("/v/a/b"), false);
+
+    EXPECT_EQ(storage.unmount("/v", volumeRoot), true);
+    EXPECT_EQ(!!storage.getNode("/v"), false);
+}
+
+TEST(StorageTest, AsynchronousPropagationDropsNodesDetachedBeforeApplied)
+{
+    const size_t iterations = 1000;
+
+    jbkvs::NodePtr volumeRoot = jbkvs::Node::create();
+
+    jbkvs::Storage storage(0, jbkvs::Storage::Propagation::Asynchronous);
+    ASSERT_EQ(storage.mount("/v", volumeRoot), true);
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        jbkvs::NodePtr child = jbkvs::Node::create(volumeRoot, "child");
+        ASSERT_EQ(!!child, true);
+        EXPECT_EQ(child->detach(), true);
+    }
+    jbkvs::NodePtr kept = jbkvs::Node::create(volumeRoot, "kept");
+    storage.sync();
+
+    EXPECT_EQ(!!storage.getNode("/v/child"), false);
+    EXPECT_EQ(!!storage.getNode("/v/kept"), true);
+}
+
+TEST(StorageTest, AsynchronousPropagationWorksConcurrentlyWithMounts)
+{
+    const size_t storageCount = 8;
+    const size_t iterations = 300;
+    const size_t childCount = 16;
+
+    jbkvs::NodePtr volumeRoot = jbkvs::Node::create();
+    jbkvs::NodePtr directory = jbkvs::Node::create(volumeRoot, "d");
+
+    std::vector<std::unique_ptr<jbkvs::Storage>> storages;
+    for (size_t i = 0; i < storageCount; ++i)
+    {
+        storages.push_back(std::make_unique<jbkvs::Storage>(0, jbkvs::Storage::Propagation::Asynchronous));
+        storages.back()->mount("/v", volumeRoot, (i % 2 == 0) ? jbkvs::Storage::MountMode::Lazy : jbkvs::Storage::MountMode::Eager);
+    }
+
+    std::atomic<bool> done = false;
+    std::thread structureThread([&]()
+    {
+        for (size_t i = 0; !done.load(); ++i)
+        {
+            jbkvs::NodePtr child = jbkvs::Node::create(directory, std::to_string(i % childCount));
+            if (child)
+            {
+                jbkvs::Node::create(child, "leaf");
+            }
+            if (i % 3 == 0)
+            {
+                jbkvs::NodePtr oldChild = directory->getChild(std::to_string((i / 3) % childCount));
+                if (oldChild)
+                {
+                    oldChild->detach();
+                }
+            }
+        }
+    });
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        jbkvs::Storage& storage = *storages[i % storageCount];
+        storage.getNode("/v/d/" + std::to_string(i % childCount) + "/leaf");
+        storage.unmount("/v", volumeRoot);
+        storage.mount("/v", volumeRoot, (i % 2 == 0) ? jbkvs::Storage::MountMode::Lazy : jbkvs::Storage::MountMode::Eager);
+    }
+
+    done.store(true);
+    structureThread.join();
+
+    // Once synced, every Storage shows the children present, and none of those detached.
+    for (const std::unique_ptr<jbkvs::Storage>& storage : storages)
+    {
+        storage->sync();
+        for (size_t i = 0; i < childCount; ++i)
+        {
+            std::string name = std::to_string(i);
+            jbkvs::NodePtr child = directory->getChild(name);
+            EXPECT_EQ(!!storage->getNode("/v/d/" + name), !!child);
+            EXPECT_EQ(!!storage->getNode("/v/d/" + name + "/leaf"), child && child->getChild("leaf"));
+        }
+        storage->unmount("/v", volumeRoot);
+        EXPECT_EQ(!!storage->getNode("/v"), false);
+    }
+}
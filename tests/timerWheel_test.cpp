@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include <jbkvs/detail/timerWheel.h>
+
+TEST(TimerWheelTest, TimersExpireAtTheirDeadlines)
+{
+    const uint64_t start = 1000;
+    jbkvs::detail::TimerWheel<uint64_t> wheel(start);
+
+    const uint64_t distances[] = { 1, 2, 63, 64, 65, 127, 4095, 4096, 4097, 262143, 262144, 1000000 };
+    for (uint64_t distance : distances)
+    {
+        wheel.schedule(start + distance, start + distance);
+    }
+    EXPECT_EQ(wheel.size(), std::size(distances));
+
+    std::vector<uint64_t> expired;
+    for (uint64_t now = start + 1; now <= start + 1000000; ++now)
+    {
+        wheel.advance(now, [&expired, now](uint64_t deadline)
+        {
+            EXPECT_EQ(deadline, now);
+            expired.push_back(deadline);
+        });
+    }
+
+    EXPECT_EQ(expired.size(), std::size(distances));
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheelTest, PassedDeadlineExpiresAtNextTick)
+{
+    jbkvs::detail::TimerWheel<int> wheel(100);
+
+    wheel.schedule(50, 1);
+
+    size_t expiredCount = 0;
+    wheel.advance(100, [&expiredCount](int timer) { ++expiredCount; });
+    EXPECT_EQ(expiredCount, 0);
+    wheel.advance(101, [&expiredCount](int timer) { ++expiredCount; });
+    EXPECT_EQ(expiredCount, 1);
+}
+
+TEST(TimerWheelTest, DeadlinesBeyondRangeAreRescheduled)
+{
+    jbkvs::detail::TimerWheel<int> wheel(0);
+
+    const uint64_t deadline = (uint64_t(1) << 37) + 5;
+    wheel.schedule(deadline, 1);
+
+    size_t expiredCount = 0;
+    wheel.advance(deadline - 1, [&expiredCount](int timer) { ++expiredCount; });
+    EXPECT_EQ(expiredCount, 0);
+    EXPECT_EQ(wheel.now(), deadline - 1);
+
+    wheel.advance(deadline, [&expiredCount](int timer) { ++expiredCount; });
+    EXPECT_EQ(expiredCount, 1);
+}
+
+TEST(TimerWheelTest, AdvanceInJumpsExpiresEveryTimerOnce)
+{
+    jbkvs::detail::TimerWheel<uint64_t> wheel(0);
+    std::mt19937_64 random(42);
+
+    const size_t timerCount = 10000;
+    std::vector<size_t> expiredCounts(timerCount);
+    std::vector<uint64_t> deadlines(timerCount);
+
+    uint64_t now = 0;
+    size_t scheduledCount = 0;
+    while (now < 2000000)
+    {
+        for (size_t i = 0; i < 10 && scheduledCount < timerCount; ++i, ++scheduledCount)
+        {
+            deadlines[scheduledCount] = now + random() % 100000;
+            wheel.schedule(deadlines[scheduledCount], scheduledCount);
+        }
+
+        uint64_t previousNow = now;
+        now += random() % 500;
+        wheel.advance(now, [&expiredCounts, &deadlines, previousNow, now](uint64_t timer)
+        {
+            // Neither early nor later than the advance that reaches the deadline.
+            EXPECT_LE(deadlines[timer], now);
+            EXPECT_GE(deadlines[timer], previousNow);
+            ++expiredCounts[timer];
+        });
+    }
+
+    EXPECT_EQ(scheduledCount, timerCount);
+    EXPECT_EQ(wheel.size(), 0);
+    for (size_t count : expiredCounts)
+    {
+        EXPECT_EQ(count, 1);
+    }
+}